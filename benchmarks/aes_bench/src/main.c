@@ -0,0 +1,221 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "cheric.h"
+#include "syscalls.h"
+#include "assert.h"
+#include "stdio.h"
+#include "string.h"
+#include "misc.h"
+#include "aes.h"
+
+// Compares the byte-wise CBC cipher that block_cache used to use against the table driven XTS mode it now uses.
+// Before timing anything the table driven cipher and XTS are checked against the published known answers.
+
+#define BENCH_SECTOR_SIZE   512
+#define BENCH_BUF_SIZE      (64 * 1024)
+#define BENCH_ITERATIONS    16
+
+static uint8_t bench_buf[BENCH_BUF_SIZE];
+static uint8_t check_buf[BENCH_BUF_SIZE];
+
+static const uint8_t bench_key[AES_KEYLEN] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                             0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+static const uint8_t bench_iv[AES_BLOCKLEN] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                              0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+
+static struct AES_ctx cbc_ctx;
+static struct AES_XTS_ctx xts_ctx;
+
+// AES-128 examples from FIPS-197 (Appendix B and Appendix C.1)
+static const struct {
+    const char* key;
+    const char* pt;
+    const char* ct;
+} aes_vectors[] = {
+    {"2b7e151628aed2a6abf7158809cf4f3c", "3243f6a8885a308d313198a2e0370734", "3925841d02dc09fbdc118597196a0b32"},
+    {"000102030405060708090a0b0c0d0e0f", "00112233445566778899aabbccddeeff", "69c4e0d86a7b0430d8cdb78070b4c55a"},
+};
+
+// XTS-AES-128 vectors 1 to 4 from IEEE 1619-2007 Annex B. The data unit is one sector. A NULL ptx is the bytes
+// 0x00 to 0xff counting up and wrapping.
+static const struct {
+    const char* key1;
+    const char* key2;
+    uint64_t dusn;
+    uint32_t length;
+    const char* ptx;
+    const char* ctx;
+} xts_vectors[] = {
+    {"00000000000000000000000000000000", "00000000000000000000000000000000", 0, 32,
+         "0000000000000000000000000000000000000000000000000000000000000000",
+         "917cf69ebd68b2ec9b9fe9a3eadda692cd43d2f59598ed858c02c2652fbf922e"},
+    {"11111111111111111111111111111111", "22222222222222222222222222222222", 0x3333333333, 32,
+         "4444444444444444444444444444444444444444444444444444444444444444",
+         "c454185e6a16936e39334038acef838bfb186fff7480adc4289382ecd6d394f0"},
+    {"fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "22222222222222222222222222222222", 0x3333333333, 32,
+         "4444444444444444444444444444444444444444444444444444444444444444",
+         "af85336b597afc1a900b2eb21ec949d292df4c047e0b21532186a5971a227a89"},
+    {"27182818284590452353602874713526", "31415926535897932384626433832795", 0, 512,
+         NULL,
+         "27a7479befa1d476489f308cd4cfa6e2a96e4bbe3208ff25287dd3819616e89cc78cf7f5e543445f8333d8fa7f560000"
+         "05279fa5d8b5e4ad40e736ddb4d35412328063fd2aab53e5ea1e0a9f332500a5df9487d07a5c92cc512c8866c7e860ce"
+         "93fdf166a24912b422976146ae20ce846bb7dc9ba94a767aaef20c0d61ad02655ea92dc4c4e41a8952c651d33174be51"
+         "a10c421110e6d81588ede82103a252d8a750e8768defffed9122810aaeb99f9172af82b604dc4b8e51bcb08235a6f434"
+         "1332e4ca60482a4ba1a03b3e65008fc5da76b70bf1690db4eae29c5f1badd03c5ccf2a55d705ddcd86d449511ceb7ec3"
+         "0bf12b1fa35b913f9f747a8afd1b130e94bff94effd01a91735ca1726acd0b197c4e5b03393697e126826fb6bbde8ecc"
+         "1e08298516e2c9ed03ff3c1b7860f6de76d4cecd94c8119855ef5297ca67e9f3e7ff72b1e99785ca0a7e7720c5b36dc6"
+         "d72cac9574c8cbbc2f801e23e56fd344b07f22154beba0f08ce8891e643ed995c94d9a69c9f1b5f499027a78572aeebd"
+         "74d20cc39881c213ee770b1010e4bea718846977ae119f7a023ab58cca0ad752afe656bb3c17256a9f6e9bf19fdd5a38"
+         "fc82bbe872c5539edb609ef4f79c203ebb140f2e583cb2ad15b4aa5b655016a8449277dbd477ef2c8d6c017db738b18d"
+         "eb4a427d1923ce3ff262735779a418f20a282df920147beabe421ee5319d0568"},
+};
+
+static void report(const char* name, uint64_t clocks) {
+    uint64_t bytes = (uint64_t)BENCH_BUF_SIZE * BENCH_ITERATIONS;
+    printf("******BENCH: %s: %lx bytes in %lx clocks (%lx bytes per 1k clocks)\n",
+           name, bytes, clocks, clocks ? (bytes * 1000) / clocks : 0);
+}
+
+static uint64_t bench_cbc(int decrypt) {
+    uint64_t start = syscall_now();
+    for(int i = 0; i != BENCH_ITERATIONS; i++) {
+        AES_ctx_set_iv(&cbc_ctx, bench_iv);
+        if(decrypt) AES_CBC_decrypt_buffer(&cbc_ctx, bench_buf, BENCH_BUF_SIZE);
+        else AES_CBC_encrypt_buffer(&cbc_ctx, bench_buf, BENCH_BUF_SIZE);
+    }
+    return syscall_now() - start;
+}
+
+static uint64_t bench_xts(int decrypt) {
+    uint64_t start = syscall_now();
+    for(int i = 0; i != BENCH_ITERATIONS; i++) {
+        if(decrypt) AES_XTS_decrypt_buffer(&xts_ctx, 0, bench_buf, BENCH_BUF_SIZE);
+        else AES_XTS_encrypt_buffer(&xts_ctx, 0, bench_buf, BENCH_BUF_SIZE);
+    }
+    return syscall_now() - start;
+}
+
+static void from_hex(const char* hex, uint8_t* out, size_t n) {
+    for(size_t i = 0; i != n; i++) {
+        uint8_t byte = 0;
+        for(size_t j = 0; j != 2; j++) {
+            char c = hex[(i * 2) + j];
+            byte = (uint8_t)((byte << 4) | ((c <= '9') ? (c - '0') : (c - 'a' + 10)));
+        }
+        out[i] = byte;
+    }
+}
+
+static void check_aes_known_answers(void) {
+    struct AES_fast_ctx ctx;
+    uint8_t key[AES_KEYLEN];
+    uint8_t pt[AES_BLOCKLEN];
+    uint8_t ct[AES_BLOCKLEN];
+    uint8_t out[AES_BLOCKLEN];
+
+    for(size_t v = 0; v != countof(aes_vectors); v++) {
+        from_hex(aes_vectors[v].key, key, AES_KEYLEN);
+        from_hex(aes_vectors[v].pt, pt, AES_BLOCKLEN);
+        from_hex(aes_vectors[v].ct, ct, AES_BLOCKLEN);
+
+        AES_fast_init_ctx(&ctx, key);
+
+        AES_fast_encrypt_block(&ctx, pt, out);
+        assert(memcmp(out, ct, AES_BLOCKLEN) == 0);
+        AES_fast_decrypt_block(&ctx, ct, out);
+        assert(memcmp(out, pt, AES_BLOCKLEN) == 0);
+    }
+}
+
+static void check_xts_known_answers(void) {
+    struct AES_XTS_ctx ctx;
+    uint8_t key1[AES_KEYLEN];
+    uint8_t key2[AES_KEYLEN];
+
+    for(size_t v = 0; v != countof(xts_vectors); v++) {
+        uint32_t length = xts_vectors[v].length;
+        uint64_t offset = xts_vectors[v].dusn * length;
+        uint32_t half = length / 2;
+
+        from_hex(xts_vectors[v].key1, key1, AES_KEYLEN);
+        from_hex(xts_vectors[v].key2, key2, AES_KEYLEN);
+        AES_XTS_init_ctx(&ctx, key1, key2, length);
+
+        if(xts_vectors[v].ptx) from_hex(xts_vectors[v].ptx, check_buf, length);
+        else for(size_t i = 0; i != length; i++) check_buf[i] = (uint8_t)i;
+
+        memcpy(bench_buf, check_buf, length);
+        AES_XTS_encrypt_buffer(&ctx, offset, bench_buf, length);
+        from_hex(xts_vectors[v].ctx, check_buf + length, length);
+        assert(memcmp(bench_buf, check_buf + length, length) == 0);
+
+        // Also start part way through the data unit, in the order a random access would
+        AES_XTS_decrypt_buffer(&ctx, offset + half, bench_buf + half, length - half);
+        AES_XTS_decrypt_buffer(&ctx, offset, bench_buf, half);
+        assert(memcmp(bench_buf, check_buf, length) == 0);
+    }
+}
+
+// Sectors are independent under XTS, so decrypting them in reverse order must give the same result
+static void check_xts_random_access(void) {
+    for(size_t i = 0; i != BENCH_BUF_SIZE; i++) check_buf[i] = (uint8_t)(i * 7);
+    memcpy(bench_buf, check_buf, BENCH_BUF_SIZE);
+
+    AES_XTS_encrypt_buffer(&xts_ctx, 0, bench_buf, BENCH_BUF_SIZE);
+    assert(memcmp(bench_buf, check_buf, BENCH_BUF_SIZE) != 0);
+
+    for(size_t off = BENCH_BUF_SIZE; off != 0; off -= BENCH_SECTOR_SIZE) {
+        size_t sector_off = off - BENCH_SECTOR_SIZE;
+        AES_XTS_decrypt_buffer(&xts_ctx, sector_off, bench_buf + sector_off, BENCH_SECTOR_SIZE);
+    }
+
+    assert(memcmp(bench_buf, check_buf, BENCH_BUF_SIZE) == 0);
+}
+
+int main(void) {
+    AES_init_ctx_iv(&cbc_ctx, bench_key, bench_iv);
+    AES_XTS_init_ctx_iv(&xts_ctx, bench_key, bench_iv, BENCH_SECTOR_SIZE);
+
+    check_aes_known_answers();
+    check_xts_known_answers();
+    check_xts_random_access();
+
+    // Warm up
+    bench_cbc(0);
+    bench_xts(0);
+
+    report("AES-CBC encrypt", bench_cbc(0));
+    report("AES-CBC decrypt", bench_cbc(1));
+    report("AES-XTS encrypt", bench_xts(0));
+    report("AES-XTS decrypt", bench_xts(1));
+
+    return 0;
+}
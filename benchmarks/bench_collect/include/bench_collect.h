@@ -82,4 +82,10 @@ static inline void bench_finish(void) {
     message_send(0, 0, 0, 0, NULL, NULL, NULL, NULL, act, SYNC_CALL, 4);
 }
 
+// Ship everything in the kernel trace rings to the host now. Finishing a benchmark also does this.
+static inline void bench_drain_trace(void) {
+    act_kt act = get_bench_collect_act();
+    message_send(0, 0, 0, 0, NULL, NULL, NULL, NULL, act, SYNC_CALL, 5);
+}
+
 #endif //CHERIOS_TEMPLATE_H
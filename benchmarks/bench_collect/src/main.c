@@ -34,6 +34,7 @@
 #include "bench_collect.h"
 #include "cheristd.h"
 #include "misc.h"
+#include "trace.h"
 
 typedef struct {
     unix_net_sock* sock;
@@ -50,6 +51,8 @@ con_state state;
 //  StartFile: 'S'CNH. C = 64 columns. N = null terminated name. H = null terminated headers
 //  Send Values: 'D'CV. C = 64 number values, V = 64 values
 //  EndFile: 'E'
+//  Trace: 'T'CLNV. C = 64 cpu, L = 64 events lost, N = 64 number of events, V = N trace_event_t's
+//         Only sent when built with TRACE_RINGS
 
 static inline void connect_to_host(void) {
 
@@ -146,10 +149,48 @@ static inline void b_add_csv(uint64_t* values, size_t nvalues) {
 
 
 
+#if (TRACE_RINGS)
+
+static uint64_t trace_tails[SMP_CORES];
+static trace_event_t trace_buf[TRACE_RING_ENTRIES];
+
+static void b_drain_trace(void) {
+    requester_t req = state.sock->sock.write.push_writer;
+
+    for(int cpu = 0; cpu != SMP_CORES; cpu++) {
+        trace_ring_t* ring = syscall_trace_ring(cpu);
+
+        if(ring == NULL) break;
+
+        uint64_t header[3];
+        header[0] = (uint64_t)cpu;
+        header[1] = 0;
+        header[2] = trace_ring_drain(ring, &trace_tails[cpu], trace_buf, TRACE_RING_ENTRIES, &header[1]);
+
+        if(header[1] == 0 && header[2] == 0) continue;
+
+        W(3);
+        char c = 'T';
+        socket_request_im(req, 1, NULL, &c, 0);
+        socket_request_ind(req, (char*)header, sizeof(header), 0);
+        if(header[2] != 0) socket_request_ind(req, (char*)trace_buf, header[2] * sizeof(trace_event_t), 0);
+
+        socket_requester_wait_all_finish(req, 0);
+    }
+}
+
+#else
+
+static void b_drain_trace(void) {}
+
+#endif
+
 static inline void b_finish(void) {
 
     b_finish_file();
 
+    b_drain_trace();
+
     socket_flush_drb(&state.sock->sock);
 
     state.doing_bench--;
@@ -161,12 +202,19 @@ static inline void b_finish(void) {
 }
 
 int main(void) {
+#if (TRACE_RINGS)
+    // Claim the trace rings before anything else can
+    syscall_trace_ring(-1);
+#endif
+
     connect_to_host();
 
     namespace_register(namespace_num_bench, act_self_ref);
 
     do {
         msg_entry(MS_TO_CLOCK(5000), 0);
+        // Quiet for a while. Ship whatever has been traced so it is not lost when the rings wrap.
+        b_drain_trace();
     } while(state.doing_bench);
 
     con_finish();
@@ -174,7 +222,7 @@ int main(void) {
     return 0;
 }
 
-void (*msg_methods[]) = {b_start, b_add_file, b_add_csv, b_finish_file, b_finish};
+void (*msg_methods[]) = {b_start, b_add_file, b_add_csv, b_finish_file, b_finish, b_drain_trace};
 size_t msg_methods_nb = countof(msg_methods);
 void (*ctrl_methods[]) = {NULL};
 size_t ctrl_methods_nb = countof(ctrl_methods);
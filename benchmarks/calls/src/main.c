@@ -72,8 +72,8 @@ __attribute__((noinline)) void lib_calls(void_f* f, uint64_t* column) {
 
     for(int tms = 0; tms != SYNC_TIMES; tms++) {
 
-        // Calling may require the unsafe stack. Consume it.
-        if(tms % 100 == 99) sleep(MS_TO_CLOCK(3000));
+        // Calling may require the unsafe stack. Consume it. Replacing it is a pool pop as long as we keep the pool full.
+        temporal_pool_refill();
         replace_usp();
 
         for(int i = 0; i != 32; i++) {
@@ -105,8 +105,8 @@ __attribute__((noinline)) void lib_calls_leaf(void_f* f, capability  data, uint6
 
     for(int tms = 0; tms != SYNC_TIMES; tms++) {
 
-        // Calling may require the unsafe stack. Consume it.
-        if(tms % 100 == 99) sleep(MS_TO_CLOCK(3000));
+        // Calling may require the unsafe stack. Keep spares ready so a replacement never goes to memmgt mid sample.
+        temporal_pool_refill();
 
         for(int i = 0; i != 32; i++) {
             LIGHTWEIGHT_CCALL_FUNC(v, f, data, 0, 0);
@@ -57,6 +57,7 @@ typedef struct result_s {
     uint64_t phy_scanned;
     uint64_t virt_size;
     uint64_t time;
+    uint64_t phy_skipped;
 } result_t;
 
 
@@ -122,6 +123,7 @@ capability cause_revoke(result_t* result, size_t size, enum type e) {
     result->phy_scanned = msg->a0;
     result->virt_size = msg->a1;
     result->time = msg->a2;
+    result->phy_skipped = msg->a3;
 
     next_msg();
 
@@ -129,7 +131,7 @@ capability cause_revoke(result_t* result, size_t size, enum type e) {
 }
 
 void print(result_t* r) {
-    printf("0x%lx,0x%lx,0x%lx\n", r->phy_scanned, r->virt_size, r->time);
+    printf("0x%lx,0x%lx,0x%lx,0x%lx\n", r->phy_scanned, r->virt_size, r->time, r->phy_skipped);
     socket_requester_wait_all_finish(stdout->write.push_writer, 0);
 }
 
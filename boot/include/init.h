@@ -68,6 +68,11 @@ typedef struct init_elem_s {
 	act_control_kt ctrl;
 	void*        carg;
 	const char*  file_data;
+	const int*   needs;     // If set, start once these services have registered instead of after all earlier fences
+	size_t       n_needs;
+	int          done;      // Started, or for fences, passed
+	uint8_t      cpu;
+	register_t   done_time;
 } init_elem_t;
 
 /*
@@ -69,6 +69,7 @@
 #define B_BENCH_EXPS    0
 #define B_BENCH_REVOKE  0
 #define B_BENCH_PINGER  0
+#define B_BENCH_AES     0
 
 
 #define B_BENCH_COLLECT (B_BENCH_MS | B_BENCH_CALLS | B_BENCH_EXPS)
@@ -125,6 +126,15 @@ const char* nginx_args[] = {"nginx",NULL};
 #define B_WAIT_FOR_NAME(X) \
     {m_fence, 1, #X, 0, 0, 0, NULL, NULL, NULL},
 
+/* Entries that know exactly which services they need do not have to wait for every fence above them */
+#define B_NEEDS(...) (const int[]){__VA_ARGS__}, sizeof((const int[]){__VA_ARGS__}) / sizeof(int)
+#define B_ENTRY_NEEDS(_type, _name, _arg, _daemon, _cond, ...) \
+	{_type,	_cond, #_name, _arg, _daemon, 0, NULL, NULL, &SYM_FOR_FILE(_name), B_NEEDS(__VA_ARGS__)},
+#define B_DENTRY_NEEDS(_type, _name, _arg, _cond, ...) \
+	 B_ENTRY_NEEDS(_type, _name, _arg, 1, _cond, __VA_ARGS__)
+#define B_PENTRY_NEEDS(_type, _name, _arg, _cond, ...) \
+	 B_ENTRY_NEEDS(_type, _name, _arg, 0, _cond, __VA_ARGS__)
+
 init_elem_t init_list[] = {
   /*
    * The namespace-mgr and mem-mgr and proc_manager are mutually dependent.
@@ -185,7 +195,8 @@ init_elem_t init_list[] = {
     B_DENTRY(DEFAULT_TO(m_secure) | m_user, block_cache, 0, !B_DEMO)
 #if (B_DEMO == 0)
     B_WAIT_FOR(namespace_num_blockcache)
-    B_PENTRY(m_virtnet | DEFAULT_TO(m_user), lwip, 0, 1 && BUILD_WITH_NET)
+    // The network stack has nothing to do with the block stack, so it comes up alongside it
+    B_PENTRY_NEEDS(m_virtnet | DEFAULT_TO(m_user), lwip, 0, 1 && BUILD_WITH_NET, namespace_num_tman)
 	B_FENCE
 	B_DENTRY(m_fs | DEFAULT_TO(m_user),	FS_ELF	,		0,	1)
 	B_FENCE
@@ -204,6 +215,7 @@ init_elem_t init_list[] = {
     B_DENTRY(m_user, message_send, 0, B_BENCH_MS)
     B_DENTRY(m_user, exceptions, 0, B_BENCH_EXPS)
     B_DENTRY(m_user, revoke_bench, 0, B_BENCH_REVOKE)
+    B_DENTRY(m_user, aes_bench, 0, B_BENCH_AES)
 #endif
 //	B_DENTRY(m_user,	test1b,		0,	B_T1)
 //	B_PENTRY(m_user,	prga,		1,	B_SO)
@@ -219,6 +231,8 @@ init_elem_t init_list[] = {
     B_PENTRY(m_user,    socket_test, 0 ,!B_BENCH && TESTS)
     B_PENTRY(m_user, fs_test, 0, !B_BENCH && TESTS)
     B_PENTRY(m_user, pthread_test, 0, !B_BENCH && TESTS)
+    B_PENTRY(m_user, namespace_test, 0, !B_BENCH && TESTS)
+    B_PENTRY(m_user, udp_test, 0, !B_BENCH && TESTS && BUILD_WITH_NET)
 //    B_DENTRY(m_user, server, 0, 1)
 //    B_PENTRY(m_user, client, 0, 1)
     B_PENTRY(m_user,    churn,        0,  0)
@@ -327,7 +341,132 @@ static void * get_act_cap(init_elem_t* elem, init_info_t* info) {
     }
 }
 
-#define PAUSE sleep(MS_TO_CLOCK(100))
+/* How long to sleep between checks if nobody wakes us. The namespace notifies us on every registration so this is
+ * just a backstop. */
+#define WAIT_BACKSTOP MS_TO_CLOCK(100)
+
+static register_t boot_start;
+static uint8_t next_cpu;
+
+static void mark_done(init_elem_t* be, uint8_t cpu) {
+    be->done = 1;
+    be->cpu = cpu;
+    be->done_time = syscall_now() - boot_start;
+}
+
+static void wait_for_registration(int nb) {
+    while(namespace_get_ref(nb) == NULL) {
+        syscall_cond_wait(0, WAIT_BACKSTOP);
+    }
+}
+
+static int fence_open(init_elem_t* be) {
+    if(be->name) return namespace_get_ref_by_name(be->name) != NULL;
+    if(be->arg) return namespace_get_ref((int)be->arg) != NULL;
+    return 1;
+}
+
+static int needs_met(init_elem_t* be) {
+    for(size_t i = 0; i != be->n_needs; i++) {
+        if(namespace_get_ref(be->needs[i]) == NULL) return 0;
+    }
+    return 1;
+}
+
+static void start_module(init_elem_t* be, init_info_t* init_info) {
+    int secure = (be->type & m_secure) == m_secure;
+    module_t type = be->type & ~m_secure;
+
+    startup_desc_t desc;
+    desc.arg = be->arg;
+    desc.carg = get_act_cap(be, init_info);
+    desc.stack_args = NULL;
+    desc.stack_args_size = 0;
+    desc.flags = STARTUP_NONE;
+    desc.inv = NULL;
+
+    if(type == m_virtblk || type == m_virtnet) {
+        desc.cpu_hint = 0; // Some things really like to scheduled on core0 for interrupts
+    } else {
+        // Spread everything else out so services that come up together initialise in parallel
+        desc.cpu_hint = next_cpu;
+        next_cpu = (uint8_t)((next_cpu + 1) % SMP_CORES);
+    }
+
+    /* This version allows the process to spawn new threads */
+    be->ctrl = thread_start_process(thread_create_process(be->name, be->file_data, secure), &desc);
+
+    if(type == m_dedup) {
+        dedup_act = syscall_act_ctrl_get_ref(be->ctrl);
+    }
+
+    mark_done(be, desc.cpu_hint);
+    printf("Module ready: %s\n", be->name);
+}
+
+/* The list after the core services is treated as a dependency graph. A fence passes once everything above it is done
+ * and whatever it waits for has registered. An entry can start once the last fence above it has passed, or, if it says
+ * what it needs, as soon as those have registered. Everything that can start does, and we only sleep when nothing
+ * can make progress. */
+static void load_graph(init_elem_t* first, init_elem_t* end, init_info_t* init_info) {
+    size_t remaining = 0;
+
+    for(init_elem_t* be = first; be != end; be++) {
+        if(be->cond) remaining++;
+    }
+
+    while(remaining != 0) {
+        int progress = 0;
+        int all_done = 1;
+        init_elem_t* gate = NULL;
+
+        for(init_elem_t* be = first; be != end; be++) {
+            if(be->cond == 0) continue;
+
+            int is_fence = (be->type & ~m_secure) == m_fence;
+
+            if(!be->done) {
+                if(is_fence) {
+                    if(all_done && fence_open(be)) mark_done(be, 0);
+                } else if(be->needs ? needs_met(be) : (gate == NULL || gate->done)) {
+                    start_module(be, init_info);
+                }
+
+                if(be->done) {
+                    progress = 1;
+                    remaining--;
+                }
+            }
+
+            if(is_fence) gate = be;
+            if(!be->done) all_done = 0;
+        }
+
+        if(!progress) {
+            syscall_cond_wait(0, WAIT_BACKSTOP);
+        }
+    }
+}
+
+static void print_boot_timeline(void) {
+    printf("Boot timeline (ms):\n");
+
+    for(size_t i = 0; i != init_list_len; i++) {
+        init_elem_t* be = init_list + i;
+
+        if(!be->done) continue;
+
+        uint64_t ms = CLOCK_TO_MS(be->done_time);
+
+        if((be->type & ~m_secure) != m_fence) {
+            printf("%8ld  started  %-20s cpu %d\n", ms, be->name, be->cpu);
+        } else if(be->name) {
+            printf("%8ld  ready    %-20s\n", ms, be->name);
+        } else if(be->arg) {
+            printf("%8ld  ready    service %-12ld\n", ms, be->arg);
+        }
+    }
+}
 
 static void load_modules(init_info_t * init_info) {
     /* This got a little complicated and has been taken out the loop */
@@ -353,6 +492,8 @@ static void load_modules(init_info_t * init_info) {
     image namespace_im;
     image proc_im;
 
+    boot_start = syscall_now();
+
     /* Namespace */
     namebe->ctrl =
             simple_start(&env, namebe->name, namebe->file_data,
@@ -360,6 +501,10 @@ static void load_modules(init_info_t * init_info) {
 
 
     namespace_init(syscall_act_ctrl_get_ref(namebe->ctrl));
+    mark_done(namebe, 0);
+
+    /* From here on the namespace wakes us whenever something registers */
+    namespace_watch_registrations(act_self_notify_ref, 1);
 
     /* Proc */
 
@@ -378,9 +523,9 @@ static void load_modules(init_info_t * init_info) {
     /* Wait for registration */
 
     printf("Waiting for proc manager to register \n");
-    while(namespace_get_ref(namespace_num_proc_manager) == NULL) {
-        nssleep(3);
-    }printf("proc manager registered \n");
+    wait_for_registration(namespace_num_proc_manager);
+    mark_done(procbe, 0);
+    printf("proc manager registered \n");
 
     /* Memmgt */
 
@@ -398,9 +543,8 @@ static void load_modules(init_info_t * init_info) {
     /* Wait for registration */
 
     printf("Waiting for memory manager to register \n");
-    while(namespace_get_ref(namespace_num_memmgt) == NULL) {
-        nssleep(3);
-    }
+    wait_for_registration(namespace_num_memmgt);
+    mark_done(memgtbe, 0);
 
     try_init_memmgt_ref();
 
@@ -461,53 +605,13 @@ static void load_modules(init_info_t * init_info) {
         __unused act_control_kt ctrl = thread_start_process(thread_create_process(idle_name,idle_addr,0), &desc);
     }
 
-    /* Now load the rest (for fun on a different CPU) */
-
-	for(; i<init_list_len; i++) {
-        init_elem_t * be = init_list + i;
-
-		if(be->cond == 0)
-			continue;
-
-		int secure = (be->type & m_secure) == m_secure;
-		module_t type = be->type & ~m_secure;
-
-		if(type == m_fence) {
-		    if(be->name) {
-                while(namespace_get_ref_by_name(be->name) == NULL) {
-                    PAUSE;
-                }
-		    } else if(be->arg) {
-                while(namespace_get_ref((int)be->arg) == NULL) {
-                    PAUSE;
-                }
-            } else {
-                PAUSE;
-            }
-			continue;
-		}
-
-        void *carg = get_act_cap(be, init_info);
-        const char*  addr = be->file_data;
-
-        desc.arg = be->arg;
-        desc.carg = carg;
-        desc.stack_args = NULL;
-        desc.stack_args_size = 0;
-        desc.cpu_hint = SMP_CORES-1;
-        desc.flags = STARTUP_NONE;
-        desc.inv = NULL;
+    /* Now load the rest, spread across the cores */
 
-        if(type == m_virtblk || type == m_virtnet) desc.cpu_hint = 0; // Some things really like to scheduled on core0 for interrupts
+    load_graph(init_list + i, init_list + init_list_len, init_info);
 
-        /* This version allows the process to spawn new threads */
-        be->ctrl = thread_start_process(thread_create_process(be->name, addr, secure), &desc);
+    namespace_watch_registrations(act_self_notify_ref, 0);
 
-        if(type == m_dedup) {
-            dedup_act = syscall_act_ctrl_get_ref(be->ctrl);
-        }
-		printf("Module ready: %s\n", be->name);
-	}
+    print_boot_timeline();
 }
 
 // Init will not have a TLS segment provided
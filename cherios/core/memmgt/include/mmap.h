@@ -47,6 +47,9 @@
 #define REVOKE_TIME 0
 #define REVOKE_PRIO PRIO_IDLE
 
+// Physical memory is swept in this many slices, one per core. The revoke worker does the first.
+#define REVOKE_SWEEP_SLICES SMP_CORES
+
 // Measured in virtual pages
 #define MIN_REVOKE (0x20000)
 #define REVOKE_SANITY 0
@@ -216,6 +219,7 @@ extern act_kt general_act;
 extern act_kt commit_act;
 extern act_kt revoke_act;
 extern act_kt clean_act;
+extern act_kt sweep_acts[REVOKE_SWEEP_SLICES];
 
 size_t vmem_commit_vmem_range(size_t addr, size_t pages, mem_request_flags flags);
 
@@ -223,6 +227,9 @@ void revoke(void);
 void revoke_finish(res_t res);
 void __revoke(void);
 void __revoke_finish(res_t res);
+void revoke_sweep(size_t slice, size_t from, size_t to);
+void revoke_sweep_wait(void);
+void __revoke_sweep(size_t from, size_t to, size_t slice);
 
 int __mem_claim(size_t base, size_t length, size_t times, mop_t mop_sealed);
 int __mem_release(size_t base, size_t length, size_t times, mop_t mop_sealed);
@@ -37,12 +37,13 @@
 #include "vmem.h"
 #include "pmem.h"
 #include "mmap.h"
+#include "pthread.h"
 
 __thread int worker_id = 0;
 
 /* FIXME: Any thread will accidentally run any of these. They should be thread local */
 void (*msg_methods[]) = {__mem_request, __mem_release, vmem_commit_vmem, full_dump, virtual_to_physical, __mem_claim,
-						 NULL, __mem_makemop, __get_physical_capability, __mem_reclaim_mop, __revoke, __revoke_finish, __vmem_commit_vmem_range, __revoke_bench, __get_tracking};
+						 NULL, __mem_makemop, __get_physical_capability, __mem_reclaim_mop, __revoke, __revoke_finish, __vmem_commit_vmem_range, __revoke_bench, __get_tracking, __revoke_sweep};
 
 size_t msg_methods_nb = countof(msg_methods);
 void (*ctrl_methods[]) = {NULL, ctor_null, dtor_null};
@@ -53,6 +54,9 @@ act_kt commit_act;  // Only for commit   (worker id 0)
 act_kt revoke_act;  // Only for revoke   (worker if 2)
 act_kt clean_act; 	// Only for clean 	 (worker id 3)
 act_kt clean_notify;
+act_kt sweep_acts[REVOKE_SWEEP_SLICES]; // Only for sweeping a slice of memory during revoke (worker id 4)
+
+static pthread_barrier_t sweep_barrier;
 
 static void worker_start(__unused register_t arg, capability carg) {
 
@@ -87,6 +91,18 @@ void revoke_finish(res_t res) {
     message_send(0, 0, 0, 0, res, NULL, NULL, NULL, general_act, SEND, 11);
 }
 
+void revoke_sweep(size_t slice, size_t from, size_t to) {
+    // The barrier needs every worker, so a revoke that comes in early waits for them to start rather than doing a slice
+    while(((volatile act_kt*)sweep_acts)[slice] == NULL) {
+        sleep(0);
+    }
+    message_send(from, to, slice, 0, NULL, NULL, NULL, NULL, sweep_acts[slice], SEND, 15);
+}
+
+void revoke_sweep_wait(void) {
+    pthread_barrier_wait(&sweep_barrier);
+}
+
 size_t vmem_commit_vmem_range(size_t addr, size_t pages, mem_request_flags flags) {
 	assert(commit_act != NULL);
 	return message_send(addr, pages, flags, 0, NULL, NULL, NULL, NULL, commit_act, SYNC_CALL, 12);
@@ -107,6 +123,16 @@ static void revoke_worker_start(__unused register_t arg, __unused capability car
 	syscall_change_priority(act_self_ctrl, REVOKE_PRIO);
 }
 
+static void sweep_worker_start(register_t arg, __unused capability carg) {
+    worker_id = 4;
+    sweep_acts[arg] = act_self_ref;
+
+    /* This thread sweeps its slice of physical memory when the revoke worker asks */
+    msg_enable = 1;
+
+    syscall_change_priority(act_self_ctrl, REVOKE_PRIO);
+}
+
 static void clean_worker_start(__unused register_t arg, __unused capability carg) {
 	worker_id = 3;
 	clean_act = act_self_ref;
@@ -134,6 +160,14 @@ int main(__unused int dummy, memmgt_init_t* mem_init) {
 
 	thread_new("memmgt_revoke", 0, 0, &revoke_worker_start);
 
+	/* With more than one core, the physical sweep is split between a worker on each core */
+
+	pthread_barrier_init(&sweep_barrier, NULL, REVOKE_SWEEP_SLICES);
+
+	for(uint8_t core = 1; core < REVOKE_SWEEP_SLICES; core++) {
+	    thread_new_hint("memmgt_sweep", core, NULL, &sweep_worker_start, core);
+	}
+
 	/* And also a worker that will zero pages. */
 	thread_new("memmgt_clean", 0, 0, &clean_worker_start);
 
@@ -1590,11 +1590,71 @@ void __revoke_bench(__unused act_kt act) {
 #endif
 }
 
+#if (REVOKE_SWEEP_SLICES > 1)
+
+static revoke_scan_t sweep_scans[REVOKE_SWEEP_SLICES];
+
+void __revoke_sweep(size_t from, size_t to, size_t slice) {
+    assert(worker_id == 4);
+
+    __unused int er = rescap_revoke_sweep(from, to, &sweep_scans[slice]);
+
+    assert(er == 0);
+
+    revoke_sweep_wait();
+}
+
+static res_t revoke_parallel(revoke_scan_t* scan) {
+
+    int er = rescap_revoke_prepare();
+
+    if(er != 0) return (res_t)cheri_setoffset(NULL, er);
+
+    // Split physical memory into page aligned slices. Worker i sweeps slice i, we do the first.
+    size_t pages_per_slice = (TOTAL_PHY_PAGES + REVOKE_SWEEP_SLICES - 1) / REVOKE_SWEEP_SLICES;
+
+    for(size_t i = 0; i != REVOKE_SWEEP_SLICES; i++) {
+        size_t from = i * pages_per_slice;
+        size_t to = from + pages_per_slice;
+        if(from > TOTAL_PHY_PAGES) from = TOTAL_PHY_PAGES;
+        if(to > TOTAL_PHY_PAGES) to = TOTAL_PHY_PAGES;
+
+        sweep_scans[i].bytes_scanned = sweep_scans[i].bytes_skipped = 0;
+
+        if(i == 0) continue;
+
+        revoke_sweep(i, from << PHY_PAGE_SIZE_BITS, to << PHY_PAGE_SIZE_BITS);
+    }
+
+    er = rescap_revoke_sweep(0, (pages_per_slice < TOTAL_PHY_PAGES ? pages_per_slice : TOTAL_PHY_PAGES) << PHY_PAGE_SIZE_BITS,
+                             &sweep_scans[0]);
+
+    assert(er == 0);
+
+    // Every slice must be done before finish restores the vtables
+    revoke_sweep_wait();
+
+    for(size_t i = 0; i != REVOKE_SWEEP_SLICES; i++) {
+        scan->bytes_scanned += sweep_scans[i].bytes_scanned;
+        scan->bytes_skipped += sweep_scans[i].bytes_skipped;
+    }
+
+    return rescap_revoke_finish(scan);
+}
+
+#else
+
+void __revoke_sweep(__unused size_t from, __unused size_t to, __unused size_t slice) {
+    assert(0);
+}
+
+#endif
+
 void __revoke(void) {
 
     assert(worker_id == 2);
 
-    uint64_t scanned = 0;
+    revoke_scan_t scan = {0, 0};
 
 #if(REVOKE_BENCH)
     tracking.revokes_started ++;
@@ -1606,7 +1666,11 @@ void __revoke(void) {
     if(revoke_bench_act) before = syscall_now();
 #endif
 
-    res_t  res = rescap_revoke_finish(&scanned);
+#if (REVOKE_SWEEP_SLICES > 1)
+    res_t  res = revoke_parallel(&scan);
+#else
+    res_t  res = rescap_revoke_finish(&scan);
+#endif
 
 #if (REVOKE_BENCH)
     res_nfo_t nfo = rescap_nfo(res);
@@ -1617,7 +1681,8 @@ void __revoke(void) {
     if(revoke_bench_act) {
         after = syscall_now();
 
-        message_send(scanned, length, after - before, 0, NULL, NULL, NULL, NULL, revoke_bench_act, SEND, 0);
+        message_send(scan.bytes_scanned, length, after - before, scan.bytes_skipped,
+                     NULL, NULL, NULL, NULL, revoke_bench_act, SEND, 0);
     }
 #endif
 #endif
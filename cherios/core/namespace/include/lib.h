@@ -28,6 +28,7 @@
  * SUCH DAMAGE.
  */
 
+#include "sys/types.h"
 #include "nano/nanotypes.h"
 
 void	ns_init(void);
@@ -39,3 +40,8 @@ int ns_register_found_id(cert_t cert);
 found_id_t* ns_get_found_id(int nb);
 int ns_register_name(const char* name, void* ref);
 void * ns_get_ref_by_name(const char* name);
+int ns_register_instance(int nb, void * act_reference, int policy, capability key);
+int ns_register_name_instance(const char* name, void* ref, int policy, capability key);
+int ns_report_load(int nb, const char* name, void* ref, size_t load, capability key);
+void * ns_lookup(int nb, const char* name, int* joinable);
+int ns_watch_registrations(act_notify_kt waiter, int watch);
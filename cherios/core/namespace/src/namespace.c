@@ -37,27 +37,53 @@
 #include "stdio.h"
 #include "string.h"
 #include "crt.h"
+#include "stdlib.h"
+
+/* Several instances of a service may register under the same number or name. Lookups hand them out either
+ * round-robin or to whichever instance currently reports the least load.
+ * Only groups started by an instance registration can be joined. The first instance picks a key, any capability it
+ * likes, and joining or reporting load requires presenting the same capability. Services registered the old way
+ * (ns_register / ns_register_name) have no key and nobody else can ever join them. */
+#define GROUP_MAX 0x8
+
+typedef struct {
+    void * act_reference;
+    size_t load;
+} instance_t;
 
 typedef struct {
-	void * act_reference;
-} bind_t;
+    instance_t instances[GROUP_MAX];
+    capability key;
+    uint8_t n;
+    uint8_t next;
+    uint8_t policy;
+} group_t;
 
 #define BIND_LEN 0x80
-bind_t bind[BIND_LEN];
+group_t bind[BIND_LEN];
 found_id_t* ids[BIND_LEN];
 int count;
 
-#define DYNAMIC_BINDS 0x10
+/* Names live in an open addressed table that starts static (we are up before memmgt) and moves to the heap when it
+ * needs to grow */
+#define DYNAMIC_BINDS 0x20
 #define MAX_NAME_LENGTH 0x30
 
 typedef struct {
-    void * act_reference;
     char name[MAX_NAME_LENGTH];
+    group_t group;
 } dynamic_bind_t;
 
 size_t dy_count;
+size_t dy_slots;
+
+dynamic_bind_t dy_binds_initial[DYNAMIC_BINDS];
+dynamic_bind_t* dy_binds;
+
+/* Waiters get a notify (not a message) every time anything registers. They then look up whatever they need. */
+#define MAX_WATCHERS 0x8
 
-dynamic_bind_t dy_binds[DYNAMIC_BINDS];
+act_notify_kt watchers[MAX_WATCHERS];
 
 void ns_init(void) {
 	/* We need to bootstrap the namespace refs ourselves using our
@@ -68,7 +94,12 @@ void ns_init(void) {
 	namespace_ref = act_self_ref;
 
 	bzero(bind, sizeof(bind));
+	bzero(watchers, sizeof(watchers));
 	count = 0;
+
+	dy_binds = dy_binds_initial;
+	dy_slots = DYNAMIC_BINDS;
+	dy_count = 0;
 }
 
 static int validate_idx(int nb) {
@@ -83,22 +114,125 @@ static int validate_act_caps(void * act_reference) {
 	return 0;
 }
 
+static int validate_policy(int policy) {
+	return (policy == NS_POLICY_ROUND_ROBIN || policy == NS_POLICY_LEAST_LOADED) ? 0 : -5;
+}
+
+static int same_key(capability a, capability b) {
+	return cheri_gettag(a) && cheri_gettag(b) &&
+		cheri_getcursor(a) == cheri_getcursor(b) &&
+		cheri_getbase(a) == cheri_getbase(b) &&
+		cheri_getlen(a) == cheri_getlen(b) &&
+		cheri_getperm(a) == cheri_getperm(b) &&
+		cheri_gettype(a) == cheri_gettype(b);
+}
+
+static void * group_pick(group_t* group) {
+	if(group->n == 0) return NULL;
+
+	instance_t* inst;
+
+	if(group->policy == NS_POLICY_LEAST_LOADED) {
+		inst = &group->instances[0];
+		for(size_t i = 1; i < group->n; i++) {
+			if(group->instances[i].load < inst->load) inst = &group->instances[i];
+		}
+	} else {
+		inst = &group->instances[group->next];
+		group->next = (uint8_t)((group->next + 1) % group->n);
+	}
+
+	/* Until the instance reports otherwise, count each hand out as a unit of load */
+	inst->load++;
+
+	return inst->act_reference;
+}
+
+/* key is NULL for an exclusive registration */
+static int group_add(group_t* group, void * act_reference, int policy, capability key) {
+	if(group->n == 0) {
+		group->policy = (uint8_t)policy;
+		group->key = key;
+	} else if(key == NULL || !same_key(group->key, key)) {
+		return -4;
+	} else if(group->policy != policy) {
+		return -6;
+	}
+
+	if(group->n == GROUP_MAX) return -7;
+
+	for(size_t i = 0; i != group->n; i++) {
+		if(group->instances[i].act_reference == act_reference) return -4;
+	}
+
+	/* Start new instances at the lowest load in the group so they do not take every request until they catch up */
+	size_t load = group->n ? (size_t)-1 : 0;
+	for(size_t i = 0; i != group->n; i++) {
+		if(group->instances[i].load < load) load = group->instances[i].load;
+	}
+
+	group->instances[group->n].act_reference = act_reference;
+	group->instances[group->n].load = load;
+	group->n++;
+
+	return 0;
+}
+
+static int group_set_load(group_t* group, void * act_reference, size_t load, capability key) {
+	if(group->n == 0 || !same_key(group->key, key)) return -4;
+
+	for(size_t i = 0; i != group->n; i++) {
+		if(group->instances[i].act_reference == act_reference) {
+			group->instances[i].load = load;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void notify_watchers(void) {
+	for(size_t i = 0; i != MAX_WATCHERS; i++) {
+		if(watchers[i] != NULL) syscall_cond_notify(watchers[i]);
+	}
+}
+
+int ns_watch_registrations(act_notify_kt waiter, int watch) {
+	if(cheri_gettag(waiter) == 0) return -2;
+
+	act_notify_kt* free_slot = NULL;
+
+	for(size_t i = 0; i != MAX_WATCHERS; i++) {
+		if(watchers[i] == waiter) {
+			if(!watch) watchers[i] = NULL;
+			return 0;
+		}
+		if(watchers[i] == NULL && free_slot == NULL) free_slot = &watchers[i];
+	}
+
+	if(!watch) return -1;
+	if(free_slot == NULL) return -7;
+
+	*free_slot = waiter;
+
+	return 0;
+}
+
 /* Get reference for service 'n' */
 void * ns_get_reference(int nb) {
 	if(validate_idx(nb) != 0) {
 		return NULL;
 	}
 	/* If service not in use, will already return NULL */
-	return bind[nb].act_reference;
+	return group_pick(&bind[nb]);
 }
 
 /* Register a module a service 'nb' */
 static int ns_register_core(int nb, void * act_reference) {
-	if(bind[nb].act_reference != NULL) {
+	if(bind[nb].n != 0) {
 		return -4;
 	}
 
-	bind[nb].act_reference  = act_reference;
+	group_add(&bind[nb], act_reference, NS_POLICY_ROUND_ROBIN, NULL);
 
 	/* Use the globally accepted numbers rather than the order
 	 */
@@ -110,6 +244,7 @@ static int ns_register_core(int nb, void * act_reference) {
 	}
 
 	count++;
+	notify_watchers();
 	return 0;
 }
 
@@ -122,6 +257,30 @@ int ns_register(int nb, void * act_reference) {
 	return ns_register_core(nb, act_reference);
 }
 
+/* Join (or start) the group of instances providing service 'nb' */
+int ns_register_instance(int nb, void * act_reference, int policy, capability key) {
+
+	int ret = validate_idx(nb);
+	if(ret != 0) return ret;
+	if((ret = validate_act_caps(act_reference)) != 0) return  ret;
+	if((ret = validate_policy(policy)) != 0) return ret;
+	if(cheri_gettag(key) == 0) return -2;
+
+	/* Memmgt is tracked by the mmap layer and cannot be replicated */
+	if(nb == namespace_num_memmgt) return -4;
+
+	int first = bind[nb].n == 0;
+
+	if((ret = group_add(&bind[nb], act_reference, policy, key)) != 0) return ret;
+
+	printf("%s: instance %d registered at port %d\n", __func__, bind[nb].n - 1, nb);
+
+	if(first) count++;
+
+	notify_watchers();
+	return 0;
+}
+
 int ns_get_num_services(void) {
 	return count;
 }
@@ -148,39 +307,135 @@ const char* normalise_name(const char* name, char* tmp_buf) {
     const char* ext = strchr(name, '.');
 
     if(ext) {
-        strncpy(tmp_buf, name, (ext-name));
-        tmp_buf[ext-name] = '\0';
+        size_t len = (size_t)(ext-name) > MAX_NAME_LENGTH ? MAX_NAME_LENGTH : (size_t)(ext-name);
+        strncpy(tmp_buf, name, len);
+        tmp_buf[len] = '\0';
         return tmp_buf;
     } else return name;
 }
 
-int ns_register_name(const char* name, act_kt ref) {
-    if(dy_count == DYNAMIC_BINDS) return -1;
+static uint64_t fnv_step(uint64_t h, const uint8_t* bytes, size_t n) {
+    for(size_t i = 0; i != n; i++) {
+        h = (h ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#define FNV_INIT 0xcbf29ce484222325ULL
+
+static dynamic_bind_t* dy_find_slot(dynamic_bind_t* table, size_t slots, const char* name) {
+    size_t len = 0;
+    while(len != MAX_NAME_LENGTH && name[len] != '\0') len++;
+    size_t i = fnv_step(FNV_INIT, (const uint8_t*)name, len) & (slots - 1);
+
+    while(table[i].name[0] != '\0' && strncmp(name, table[i].name, MAX_NAME_LENGTH) != 0) {
+        i = (i + 1) & (slots - 1);
+    }
+
+    return &table[i];
+}
+
+static int dy_grow(void) {
+    size_t new_slots = dy_slots * 2;
+    dynamic_bind_t* new_binds = (dynamic_bind_t*)malloc(new_slots * sizeof(dynamic_bind_t));
+
+    if(!new_binds) return -1;
+
+    bzero(new_binds, new_slots * sizeof(dynamic_bind_t));
+
+    for(size_t i = 0; i != dy_slots; i++) {
+        if(dy_binds[i].name[0] != '\0') {
+            *dy_find_slot(new_binds, new_slots, dy_binds[i].name) = dy_binds[i];
+        }
+    }
+
+    if(dy_binds != dy_binds_initial) free(dy_binds);
+
+    dy_binds = new_binds;
+    dy_slots = new_slots;
+
+    return 0;
+}
+
+static dynamic_bind_t* dy_lookup(const char* norm) {
+    if(norm[0] == '\0') return NULL;
+    return dy_find_slot(dy_binds, dy_slots, norm);
+}
+
+static int register_name_core(const char* name, act_kt ref, int policy, capability key) {
+    int ret;
+    if((ret = validate_act_caps(ref)) != 0) return ret;
+    if((ret = validate_policy(policy)) != 0) return ret;
+
+    // Keep the table at most 3/4 full so probe chains stay short
+    if((dy_count + 1) * 4 > dy_slots * 3 && dy_grow() != 0) return -1;
 
     char tmp[MAX_NAME_LENGTH+1];
     const char* norm = normalise_name(name, tmp);
+    dynamic_bind_t* dy_bind = dy_lookup(norm);
+
+    if(!dy_bind) return -1;
+
     printf("Registering by name: %s (%s)\n", name, norm);
 
-    dynamic_bind_t* dy_bind = &dy_binds[dy_count++];
-    dy_bind->act_reference = ref;
+    int fresh = dy_bind->name[0] == '\0';
 
+    if((ret = group_add(&dy_bind->group, ref, policy, key)) != 0) return ret;
 
-    strncpy(dy_bind->name, norm, MAX_NAME_LENGTH);
+    if(fresh) {
+        strncpy(dy_bind->name, norm, MAX_NAME_LENGTH);
+        dy_count++;
+    }
 
+    notify_watchers();
     return 0;
 }
 
+int ns_register_name_instance(const char* name, act_kt ref, int policy, capability key) {
+    if(cheri_gettag(key) == 0) return -2;
+    return register_name_core(name, ref, policy, key);
+}
+
+int ns_register_name(const char* name, act_kt ref) {
+    return register_name_core(name, ref, NS_POLICY_ROUND_ROBIN, NULL);
+}
+
 act_kt ns_get_ref_by_name(const char* name) {
 
     char tmp[MAX_NAME_LENGTH+1];
-    const char* norm = normalise_name(name, tmp);
+    dynamic_bind_t* dy_bind = dy_lookup(normalise_name(name, tmp));
+
+    return dy_bind ? group_pick(&dy_bind->group) : NULL;
+}
 
-    name = norm;
+/* As the two lookups above, but also says whether the answer came from a group that can have more than one instance.
+ * Only answers for exclusive services are worth caching. */
+act_kt ns_lookup(int nb, const char* name, int* joinable) {
+    group_t* group;
+
+    if(name) {
+        char tmp[MAX_NAME_LENGTH+1];
+        dynamic_bind_t* dy_bind = dy_lookup(normalise_name(name, tmp));
+        if(!dy_bind) return NULL;
+        group = &dy_bind->group;
+    } else {
+        if(validate_idx(nb) != 0) return NULL;
+        group = &bind[nb];
+    }
+
+    if(cheri_gettag(joinable) && (cheri_getperm(joinable) & CHERI_PERM_STORE)) *joinable = group->key != NULL;
+
+    return group_pick(group);
+}
 
-    for(size_t i = 0; i != dy_count; i++) {
-        if(strncmp(name, dy_binds[i].name, MAX_NAME_LENGTH) == 0)
-            return dy_binds[i].act_reference;
+int ns_report_load(int nb, const char* name, act_kt ref, size_t load, capability key) {
+    if(name) {
+        char tmp[MAX_NAME_LENGTH+1];
+        dynamic_bind_t* dy_bind = dy_lookup(normalise_name(name, tmp));
+        return dy_bind ? group_set_load(&dy_bind->group, ref, load, key) : -1;
     }
 
-    return NULL;
-}
\ No newline at end of file
+    if(validate_idx(nb) != 0) return -1;
+
+    return group_set_load(&bind[nb], ref, load, key);
+}
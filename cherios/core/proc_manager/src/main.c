@@ -56,13 +56,87 @@ Elf_Env env;
 
 int bootstrapping = 1;
 
-static image* find_process(const char *name) {
-	for(size_t i = 0; i < processes_end; i++) {
-		if(strcmp(name, loaded_processes[i].name) == 0) return &(loaded_processes[i].im);
+/* Prepared images, keyed by name and a fingerprint of the whole ELF. Only the parts processes can share are prepared
+ * (see storage_shared), and they are loaded into our own memory, rather than that of the first process to use them, so
+ * they outlive any process. Each process gets its writable and TLS segments, or its foundation, from its own file. */
+
+#define PREPARED_IMAGES_MAX     0x20
+#define PREPARED_BUCKETS        0x20 // Power of 2
+#define PREPARED_NAME_MAX       0x20
+
+typedef struct prepared_image {
+	struct prepared_image* next;
+	uint64_t fingerprint;
+	size_t file_size;
+	int secure_load;
+	char name[PREPARED_NAME_MAX];
+	image im;
+} prepared_image;
+
+static prepared_image prepared_images[PREPARED_IMAGES_MAX];
+static size_t prepared_end = 0;
+static prepared_image* prepared_buckets[PREPARED_BUCKETS];
+
+static uint64_t fnv_step(uint64_t h, const uint8_t* bytes, size_t n) {
+	for(size_t i = 0; i != n; i++) {
+		h = (h ^ bytes[i]) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
+#define FNV_INIT 0xcbf29ce484222325ULL
+
+static size_t prepared_bucket(const char* name) {
+	size_t len = 0;
+	while(len != PREPARED_NAME_MAX && name[len] != '\0') len++;
+	return fnv_step(FNV_INIT, (const uint8_t*)name, len) & (PREPARED_BUCKETS-1);
+}
+
+// Every byte of the file, a word at a time where it can
+static uint64_t elf_fingerprint(const Elf64_Ehdr* hdr, size_t file_size) {
+	const uint64_t* words = (const uint64_t*)hdr;
+	size_t n_words = (((size_t)hdr & 7) == 0) ? file_size / 8 : 0;
+	uint64_t h = FNV_INIT;
+	for(size_t i = 0; i != n_words; i++) {
+		h = (h ^ words[i]) * 0x100000001b3ULL;
+	}
+	return fnv_step(h, ((const uint8_t*)hdr) + (n_words * 8), file_size - (n_words * 8));
+}
+
+static image* find_prepared(const char* name, uint64_t fingerprint, size_t file_size, int secure_load) {
+	for(prepared_image* p = prepared_buckets[prepared_bucket(name)]; p != NULL; p = p->next) {
+		if(p->fingerprint == fingerprint && p->file_size == file_size && p->secure_load == secure_load &&
+		   strncmp(name, p->name, PREPARED_NAME_MAX) == 0) return &p->im;
 	}
 	return NULL;
 }
 
+static image* prepare_image(const char* name, const Elf64_Ehdr* hdr, uint64_t fingerprint, size_t file_size,
+							int secure_load) {
+	if(prepared_end == PREPARED_IMAGES_MAX) return NULL;
+
+	prepared_image* p = &prepared_images[prepared_end];
+
+	env.handle = own_mop;
+
+	if(elf_loader_mem_shared(&env, hdr, &p->im, secure_load) != 0) return NULL;
+
+	// The file belongs to whoever asked for this process. Later processes bring their own.
+	p->im.hdr = NULL;
+
+	prepared_end++;
+	p->fingerprint = fingerprint;
+	p->file_size = file_size;
+	p->secure_load = secure_load;
+	strncpy(p->name, name, PREPARED_NAME_MAX);
+
+	size_t bucket = prepared_bucket(name);
+	p->next = prepared_buckets[bucket];
+	prepared_buckets[bucket] = p;
+
+	return &p->im;
+}
+
 // TODO now that we have a memory system, we should require the caller to allocate this struct.
 // TODO leaving it as use once for now
 static process_t* alloc_process(const char* name) {
@@ -252,9 +326,13 @@ process_t* create_process(const char* name, capability file, int secure_load) {
 
 	process_t* proc;
 
-	/* We can save some work by just copying an already loaded image. Later on we will allow some sharing, e.g. of
-    * const data / text */
-	image* old_im = find_process(name);
+	const Elf64_Ehdr* hdr = (const Elf64_Ehdr*)file;
+	size_t file_size = cheri_getlen(file) - cheri_getoffset(file);
+	uint64_t fingerprint = elf_fingerprint(hdr, file_size);
+
+	image* prepared = find_prepared(name, fingerprint, file_size, secure_load);
+
+	if(prepared == NULL) prepared = prepare_image(name, hdr, fingerprint, file_size, secure_load);
 
 	proc = alloc_process(name);
 
@@ -263,11 +341,14 @@ process_t* create_process(const char* name, capability file, int secure_load) {
 
 	env.handle = proc->mop;
 
-	if(old_im == NULL) {
-		elf_loader_mem(&env, (Elf64_Ehdr*)file, &proc->im, secure_load);
+	if(prepared == NULL) {
+		// Cache is full, just load a private copy
+		elf_loader_mem(&env, hdr, &proc->im, secure_load);
 	} else {
-	    assert(secure_load == old_im->secure_loaded);
-		create_image(&env, old_im, &proc->im, storage_process);
+		// Same contents as the prepared file, so the writable segments can come from this one
+		memcpy(&proc->im, prepared, sizeof(image));
+		proc->im.hdr = hdr;
+		create_image(&env, &proc->im, &proc->im, storage_process);
 	}
 
 	return seal_proc_for_user(proc);
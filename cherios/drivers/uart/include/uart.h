@@ -44,6 +44,7 @@
 char		uart_read(void);
 int		uart_readable(void);
 int		uart_writable(void);
+size_t		uart_write_space(void);	/* How many uart_writes can be done without waiting */
 void		uart_write(char ch);
 
 /*
@@ -56,6 +57,10 @@ char		uart_getc(void);
 int		uart_poll_putc(void);
 int		uart_poll_getc(void);
 void		uart_puts(const char *str);
+size_t		uart_write_bulk(const char *buf, size_t length);
+
+/* The driver's own output goes through the console ring so it stays in order with its clients' */
+void		console_putc(char ch);
 
 /* We can't just assume we have a global capability. Tell the uart interface which capability to use */
 
@@ -38,6 +38,7 @@
 #include "sockets.h"
 #include "lists.h"
 #include "stdlib.h"
+#include "string.h"
 
 static void user_putc(char c) {
 	printf(KGRN KBLD"%c"KRST, c);
@@ -49,6 +50,8 @@ static void user_puts(const char * s) {
 
 typedef struct f_list_item {
 	fulfiller_t f;
+	uint64_t dropped;			// Bytes lost because the console ring was full
+	uint64_t dropped_reported;
 	DLL_LINK(f_list_item);
 } f_list_item;
 
@@ -66,6 +69,7 @@ static f_list_item* create_f(requester_t requester) {
 	fulfiller_t f = socket_malloc_fulfiller(SOCK_TYPE_PUSH);
 
 	item->f = f;
+	item->dropped = item->dropped_reported = 0;
 
 	assert(f != NULL);
 
@@ -94,16 +98,82 @@ static int create_stderr(requester_t requester) {
 	return 0;
 }
 
+/* Everything clients write is copied into one ring as soon as it arrives, so nobody waits on the UART. The ring is
+ * drained a FIFO at a time whenever the UART has room. If the ring is full new output is dropped (but still consumed)
+ * and counted against the client that wrote it, and a note is printed once there is room again. */
+
+#define CONSOLE_RING_SIZE	0x10000
+#define CONSOLE_RING_MASK	(CONSOLE_RING_SIZE - 1)
+#define DROP_NOTE_SPACE		0x40
+#define DRAIN_WAIT			MS_TO_CLOCK(1)
+
+static char console_ring[CONSOLE_RING_SIZE];
+static size_t ring_head; // write
+static size_t ring_tail; // read
+
+static size_t ring_space(void) {
+	return CONSOLE_RING_SIZE - (ring_head - ring_tail);
+}
+
+static void ring_write(const char* buf, size_t length) {
+	size_t head = ring_head & CONSOLE_RING_MASK;
+	size_t first = CONSOLE_RING_SIZE - head;
+	if(first > length) first = length;
+
+	memcpy(console_ring + head, buf, first);
+	if(first != length) memcpy(console_ring, buf + first, length - first);
+
+	ring_head += length;
+}
+
+static void ring_drain(void) {
+	while(ring_head != ring_tail) {
+		size_t tail = ring_tail & CONSOLE_RING_MASK;
+		size_t contiguous = CONSOLE_RING_SIZE - tail;
+		if(contiguous > ring_head - ring_tail) contiguous = ring_head - ring_tail;
+
+		size_t written = uart_write_bulk(console_ring + tail, contiguous);
+		ring_tail += written;
+
+		if(written != contiguous) break;
+	}
+}
+
+void console_putc(char c) {
+	// Unlike a client's output, ours is never dropped. Wait for the UART to make room.
+	while(ring_space() == 0) ring_drain();
+	ring_write(&c, 1);
+}
+
+static void report_drops(f_list* list) {
+	DLL_FOREACH(f_list_item, item, list) {
+		if(item->dropped != item->dropped_reported && ring_space() >= DROP_NOTE_SPACE) {
+			char note[DROP_NOTE_SPACE];
+			int len = snprintf(note, DROP_NOTE_SPACE, KRED"\n[console: %lu bytes dropped]\n"KRST,
+							   item->dropped - item->dropped_reported);
+			if(len > DROP_NOTE_SPACE - 1) len = DROP_NOTE_SPACE - 1;
+			ring_write(note, (size_t)len);
+			item->dropped_reported = item->dropped;
+		}
+	}
+}
+
 extern ssize_t TRUSTED_CROSS_DOMAIN(ff)(capability arg, char* buf, uint64_t offset, uint64_t length);
-__used ssize_t ff(__unused capability arg, char* buf, __unused uint64_t offset, uint64_t length) {
-	for(size_t i = 0; i != length; i++) uart_putc(buf[i]);
+__used ssize_t ff(capability arg, char* buf, __unused uint64_t offset, uint64_t length) {
+	f_list_item* item = (f_list_item*)arg;
+	size_t space = ring_space();
+	size_t take = length < space ? length : space;
+
+	ring_write(buf, take);
+	item->dropped += length - take;
+
 	return length;
 }
 
 static int handle_f(f_list_item* item, enum poll_events event, int is_er) {
 	if(event & POLL_OUT) {
 		socket_fulfill_progress_bytes_unauthorised(item->f, SOCK_INF, F_DONT_WAIT | F_CHECK | F_PROGRESS | F_SKIP_OOB,
-											   &TRUSTED_CROSS_DOMAIN(ff), NULL, 0, NULL, NULL,
+											   &TRUSTED_CROSS_DOMAIN(ff), (capability)item, 0, NULL, NULL,
 											   TRUSTED_DATA, NULL);
 	} else if(event & POLL_HUP) {
 		socket_close_fulfiller(item->f, 0, 0);
@@ -119,7 +189,8 @@ static int handle_f(f_list_item* item, enum poll_events event, int is_er) {
 
 static void main_loop(void) {
 
-	// Poll loop that loops over both lists of sockets and calls a handle function
+	// Poll loop that loops over both lists of sockets and calls a handle function. Whilst there is output left in the
+	// ring we only sleep for as long as the UART takes to empty its FIFO.
 
 	POLL_LOOP_START(sleep_var, event_var, 1)
 		DLL_FOREACH(f_list_item, item, &f_list_out) {
@@ -130,7 +201,10 @@ static void main_loop(void) {
 			POLL_ITEM_F(event, sleep_var, event_var, item->f, POLL_OUT, 0);
 			if(event && handle_f(item, event, 1)) DLL_FOREACH_RESET(f_list_item,item, &f_list_err);
 		}
-	POLL_LOOP_END(sleep_var, event_var, 1, 0)
+		report_drops(&f_list_out);
+		report_drops(&f_list_err);
+		ring_drain();
+	POLL_LOOP_END(sleep_var, event_var, 1, ((ring_head == ring_tail) ? 0 : DRAIN_WAIT))
 }
 
 void (*msg_methods[]) = {user_putc, user_puts, create_stdout, create_stderr};
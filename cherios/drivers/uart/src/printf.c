@@ -39,7 +39,7 @@
 void
 uart_putchar(int c, void *arg __unused)
 {
-	uart_putc(c);
+	console_putc(c);
 }
 
 int
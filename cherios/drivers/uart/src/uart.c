@@ -68,6 +68,32 @@ uart_poll_getc(void)
 	return (uart_readable());
 }
 
+/*
+ * Write as much of buf as the transmitter will take without waiting, a FIFO's
+ * worth at a time. Returns how many bytes were written.
+ */
+size_t
+uart_write_bulk(const char *buf, size_t length)
+{
+	size_t written = 0;
+	size_t space;
+
+	while (written != length && (space = uart_write_space()) != 0) {
+		do {
+			/* Some devices turn a newline into two characters */
+			if (buf[written] == '\n') {
+				if (space == 1 && written != 0)
+					return (written);
+				if (space != 1)
+					space--;
+			}
+			uart_write(buf[written++]);
+		} while (--space != 0 && written != length);
+	}
+
+	return (written);
+}
+
 void
 uart_puts(const char *str)
 {
@@ -65,6 +65,14 @@ int	uart_writable(void) {
     return ((get_status() & (1 << 5)) != 0);
 }
 
+#define FIFO_DEPTH 16
+
+size_t uart_write_space(void) {
+    if(!uart_writable()) return 0;
+    // The top two bits of IIR say whether the FIFOs are on. If they are, THRE means the whole FIFO is empty.
+    return ((uart_cap[IIR_OFFSET] & 0xC0) == 0xC0) ? FIFO_DEPTH : 1;
+}
+
 void uart_write(char ch) {
     uart_cap[THR_OFFSET] = (uint8_t)ch;
 }
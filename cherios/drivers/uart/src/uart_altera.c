@@ -136,6 +136,14 @@ uart_writable(void)
 	return ((uart_control_read() & ALTERA_JTAG_UART_CONTROL_WSPACE) != 0);
 }
 
+size_t
+uart_write_space(void)
+{
+
+	return ((uart_control_read() & ALTERA_JTAG_UART_CONTROL_WSPACE) >>
+	    ALTERA_JTAG_UART_CONTROL_WSPACE_SHIFT);
+}
+
 int
 uart_readable(void)
 {
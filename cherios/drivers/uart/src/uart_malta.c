@@ -137,6 +137,19 @@ uart_writable(void)
 	return ((uart_lsr_read() & MALTA_UART_LSR_THRE) != 0);
 }
 
+#define	MALTA_UART_FIFO_DEPTH	16
+
+size_t
+uart_write_space(void)
+{
+
+	if (!uart_writable())
+		return (0);
+	/* If the FIFOs are on (top bits of IIR) then THRE means the whole FIFO is empty */
+	return (((mips_cap_ioread_uint8(uart_cap, MALTA_UART_IIFIFO_OFF) & 0xC0) == 0xC0) ?
+	    MALTA_UART_FIFO_DEPTH : 1);
+}
+
 int
 uart_readable(void)
 {
@@ -48,6 +48,10 @@ int	uart_writable(void) {
     return 1;
 }
 
+size_t uart_write_space(void) {
+    return 0x1000;
+}
+
 volatile char foo;
 void uart_write(char ch) {
     HW_TRACE_ON;
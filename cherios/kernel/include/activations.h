@@ -205,14 +205,10 @@ typedef struct act_t
 
 	char name[ACT_NAME_MAX_LEN];	/* Activation name (for debuging) */
 
+	act_kstats_t* stats;			/* Always on counters. Shared read only (see kstats.c) */
+
 #if (K_DEBUG)
 	struct act_t* last_sent_to;
-	uint64_t sent_n;
-	uint64_t recv_n;
-	uint64_t switches;
-	uint64_t had_time;
-	uint64_t had_time_epoch;
-	uint64_t commit_faults;
 #ifdef HARDWARE_fpga
 	// on FPGA we get some hardware counters
 	STAT_DEBUG_LIST(STAT_MEMBER)
@@ -45,6 +45,7 @@
 #include "string.h"
 #include "kutils.h"
 #include "syscalls.h"
+#include "trace.h"
 
 #ifdef __TRACE__
 	#define KERNEL_TRACE kernel_trace
@@ -54,6 +55,14 @@
 	#define KERNEL_VTRACE(...)
 #endif
 
+/* Binary events go into the per-core trace rings (see trace.h). These are cheap and stay on under GO_FAST. */
+#if (TRACE_RINGS)
+	#define KERNEL_TRACE_EVENT(id, a0, a1, a2) \
+		kernel_trace_event(id, (uint64_t)(a0), (uint64_t)(a1), (uint64_t)(a2))
+#else
+	#define KERNEL_TRACE_EVENT(...)
+#endif
+
 #ifndef __LITE__
 	#include "stdarg.h"
 	#define	kernel_assert(e)	((e) ? (void)0 : __kernel_assert(__func__, \
@@ -142,6 +151,17 @@ void 	kernel_timer_subscribe(act_t* act, register_t timeout);
 void 	kernel_timer_unsubcsribe(act_t* act);
 uint64_t get_high_res_time(uint8_t cpu_id);
 
+void	kernel_trace_init(void);
+void	kernel_trace_event(uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2);
+void	kernel_trace_user_event(uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2);
+trace_ring_t* kernel_get_trace_ring(int cpu_id);
+
+act_kstats_t*	kstats_alloc(act_t* act);
+void	kstats_free(act_t* act);
+pool_kstats_t*	kstats_pool(uint8_t pool_id);
+const kstats_t*	kernel_get_kstats(void);
+const act_kstats_t*	kernel_get_act_kstats(act_t* act);
+
 void	kernel_panic(const char *s) __dead2;
 
 #ifndef __LITE__
@@ -319,6 +319,8 @@ act_t * act_register(reg_frame_t *frame, queue_t *queue, const char *name,
     act->sync_state.current_sync_indir = cheri_setbounds_exact(&act->initial_indir, sizeof(sync_indirection));
     act->sync_state.alloc_block = NULL;
 
+	kstats_alloc(act);
+
 	KERNEL_TRACE("register", "image base of %s is %lx", act->name, act->image_base);
 	KERNEL_TRACE("act", "%s OK! ", __func__);
 
@@ -355,6 +357,7 @@ int act_revoke(act_control_t * ctrl) {
 		return -1;
 	}
 	ctrl->status = status_revoked;
+	ctrl->stats->status = status_revoked;
 
 	if(event_ref != NULL)
 		msg_push(MARSHALL_ARGUMENTS(act_create_sealed_ref(ctrl)), notify_revoke_port, event_ref, ctrl, NULL);
@@ -373,6 +376,8 @@ int act_terminate(act_control_t * ctrl) {
 	// need to delete from linked list
 	remove_from_list(ctrl);
 
+	kstats_free(ctrl);
+
 	/* This will never return if this is a self terminate. We will be removed from the queue and descheduled */
 	sched_delete(ctrl);
 
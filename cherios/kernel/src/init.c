@@ -141,6 +141,8 @@ int cherios_main(nano_kernel_if_t* interface,
 	init_info.mop_sealing_cap = get_sealing_cap_from_nano(MOP_SEALING_TYPE);
     init_info.top_sealing_cap = get_sealing_cap_from_nano(PROC_SEALING_TYPE);
 
+    kernel_trace_init();
+
     kernel_printf("Initialising Scheduler\n");
 	sched_init(&init_info.idle_init);
 
@@ -51,9 +51,7 @@ void kernel_exception_tlb(register_t badvaddr, act_t* kernel_curr_act) {
     // Order is important here. We need to send the message first to unblock memgt.
     // This can however result in the commit coming in before the block. sched handles this for us.
 
-#if (K_DEBUG)
-    kernel_curr_act->commit_faults++;
-#endif
+    kernel_curr_act->stats->commit_faults++;
 
     kernel_curr_act->last_vaddr_fault = badvaddr;
     kernel_curr_act->commit_early_notify = 0;
@@ -0,0 +1,101 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "klib.h"
+#include "activations.h"
+#include "spinlock.h"
+
+// Activations get a slot in here when registered and give it back when terminated. The kernel is the only writer,
+// everyone else gets a read only view with syscall_kstats.
+
+static kstats_t kstats;
+
+// Activations that did not get a slot (or have given theirs back) count into this instead. It is only read by those
+// activations through syscall_act_kstats, which have to expect counts that are too high.
+static act_kstats_t kstats_spare;
+
+static spinlock_t kstats_lock;
+
+act_kstats_t* kstats_alloc(act_t* act) {
+    act_kstats_t* stats = &kstats_spare;
+
+    spinlock_acquire(&kstats_lock);
+
+    for(size_t i = 0; i != KSTATS_MAX_ACTS; i++) {
+        if(!(kstats.acts[i].generation & 1)) {
+            stats = &kstats.acts[i];
+            if(i >= kstats.acts_end) kstats.acts_end = i + 1;
+            break;
+        }
+    }
+
+    if(stats != &kstats_spare) {
+        uint64_t generation = stats->generation;
+        bzero(stats, sizeof(act_kstats_t));
+        for(size_t i = 0; i != ACT_NAME_MAX_LEN; i++) {
+            stats->name[i] = act->name[i];
+        }
+        stats->status = act->status;
+        stats->generation = generation + 1;
+    }
+
+    spinlock_release(&kstats_lock);
+
+    act->stats = stats;
+    return stats;
+}
+
+void kstats_free(act_t* act) {
+    act_kstats_t* stats = act->stats;
+    act->stats = &kstats_spare;
+
+    if(stats == &kstats_spare) return;
+
+    stats->status = status_terminated;
+    stats->sched_status = sched_terminated;
+
+    spinlock_acquire(&kstats_lock);
+    stats->generation++;
+    spinlock_release(&kstats_lock);
+}
+
+pool_kstats_t* kstats_pool(uint8_t pool_id) {
+    return &kstats.pools[pool_id];
+}
+
+const act_kstats_t* kernel_get_act_kstats(act_t* act) {
+    act_kstats_t* view = (act_kstats_t*)cheri_setbounds_exact(act->stats, sizeof(act_kstats_t));
+    return (const act_kstats_t*)cheri_andperm(view, CHERI_PERM_LOAD);
+}
+
+const kstats_t* kernel_get_kstats(void) {
+    kstats_t* view = (kstats_t*)cheri_setbounds_exact(&kstats, sizeof(kstats_t));
+    return (const kstats_t*)cheri_andperm(view, CHERI_PERM_LOAD);
+}
@@ -73,9 +73,9 @@ int msg_push(register_t a0, register_t a1, register_t a2, register_t a3,
 
 #if (K_DEBUG)
 	src->last_sent_to = dest;
-	src->sent_n++;
-	ATOMIC_ADD_RV(&dest->recv_n, 64, 16i, 1);
 #endif
+	src->stats->sent_n++;
+	ATOMIC_ADD_RV(&dest->stats->recv_n, 64, 16i, 1);
 
 	queue_t * queue = dest->msg_queue;
 	msg_nb_t  qmask  = dest->queue_mask;
@@ -89,6 +89,7 @@ int msg_push(register_t a0, register_t a1, register_t a2, register_t a3,
 	register_t success;
 
 	uint64_t last_tsx = *tsx_ptr;
+	uint64_t fill = 0;
 
 	while(1) {
 		restart: {}
@@ -144,6 +145,7 @@ int msg_push(register_t a0, register_t a1, register_t a2, register_t a3,
 					STORE_COND(tsx_ptr, 64, tsx_fin, success);
 				} while(!success);
 
+				fill = head + 1 - start;
 				break;
 			}
 		}
@@ -157,6 +159,9 @@ int msg_push(register_t a0, register_t a1, register_t a2, register_t a3,
 		HW_YIELD; // This should look like a spin, so yield is good
 	}
 
+	// Racy, but losing an update to a concurrent sender only under reports by one or two
+	if(fill > dest->stats->queue_hwm) dest->stats->queue_hwm = fill;
+
     sched_receive_event(dest, sched_waiting);
 
 	KERNEL_TRACE("msg push", "now %u items in %s's queue", ACT_QUEUE_FILL(dest), dest->name);
@@ -201,6 +206,19 @@ void msg_queue_init(act_t * act, queue_t * queue) {
 	act->msg_queue->header.end = hd;
 	act->msg_queue->header.len = queue_len;
 	//todo: zero queue?
+
+#if (REVOKE_CAP_DIRTY)
+	/* Pushes can happen in a critical section, where the nano kernel cannot take the trap for the first capability
+	 * store to a page and so never marks it as cap dirty. A tagged store to every page now, while we still can take
+	 * it, means the sweep will never skip a page of the queue. The flag stays until the pages are unmapped. */
+	size_t first_page = PHY_PAGE_SIZE - ((size_t)queue & (PHY_PAGE_SIZE - 1));
+	for(size_t off = first_page; off < total_length_bytes; off += PHY_PAGE_SIZE) {
+		volatile capability* slot = (volatile capability*)((char*)queue + off);
+		capability keep = *slot;
+		*slot = hd;
+		*slot = keep;
+	}
+#endif
 }
 
 size_t next_indir_block(act_t* ccaller) {
@@ -340,6 +358,7 @@ __used ret_t* kernel_message_send_ret(register_t a0, register_t a1, register_t a
 	act_t* source_activation = (act_t*) CALLER;
 
 	KERNEL_TRACE(__func__, "message from %s to %s", source_activation->name, target_activation->name);
+	KERNEL_TRACE_EVENT(TRACE_MSG_SEND, TRACE_PTR(source_activation), TRACE_PTR(target_activation), v0);
 
 	if(target_activation->status != status_alive) {
 		KERNEL_ERROR("Trying to CCall revoked activation %s from %s",
@@ -404,6 +423,7 @@ __used act_kt set_message_reply(capability c3, register_t v0, register_t v1, cap
 
 
 	KERNEL_TRACE(__func__, "%s correctly makes a sync return to %s", returned_from->name, returned_to->name);
+	KERNEL_TRACE_EVENT(TRACE_MSG_REPLY, TRACE_PTR(returned_from), TRACE_PTR(returned_to), v0);
 
 	/* At any point we might pre-empted, so the order here is important */
 
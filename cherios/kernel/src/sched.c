@@ -120,6 +120,20 @@ act_t* sched_get_current_act(void) {
 	return ret;
 }
 
+static inline uint32_t stats_now(void) {
+	return (uint32_t)cpu_count_get();
+}
+
+static inline void set_sched_status(act_t* act, sched_status_e status) {
+	act->sched_status = status;
+	act->stats->sched_status = status;
+}
+
+// Call when an activation starts waiting in the run queue
+static inline void stats_runnable(act_t* act) {
+	act->stats->runnable_since = stats_now();
+}
+
 static void add_act_to_queue(sched_pool* pool, act_t * act, sched_status_e set_to) {
 	sched_q* q = &pool->queues[LEVEL_TO_NDX(act->priority)];
 	kernel_assert(q->act_queue_end != SCHED_QUEUE_LENGTH);
@@ -128,7 +142,8 @@ static void add_act_to_queue(sched_pool* pool, act_t * act, sched_status_e set_t
 	size_t index = q->act_queue_end++;
 	q->act_queue[index] = act;
 	act->queue_ndx = (uint8_t)index;
-	act->sched_status = set_to;
+	if(set_to == sched_runnable && act->sched_status != sched_runnable) stats_runnable(act);
+	set_sched_status(act, set_to);
 	pool->in_queues++;
  	spinlock_release(&pool->queue_lock);
 }
@@ -151,7 +166,7 @@ static void delete_act_from_queue(sched_pool* pool, act_t * act, sched_status_e
 	q->act_queue[index]->queue_ndx = index;
 	q->act_queue[q->act_queue_end] = NULL;
 
-	act->sched_status = set_to;
+	set_sched_status(act, set_to);
 	act->queue_ndx = (uint8_t)-1;
 	pool->in_queues--;
 	spinlock_release(&pool->queue_lock);
@@ -171,14 +186,14 @@ void sched_create(uint8_t pool_id, act_t * act, enum sched_prio priority) {
         // FIXME: A bit of a hack
         if(strcmp(act->name, "idle.elf") == 0) {
             static uint8_t idles_registered = 0;
-            act->sched_status = sched_runnable;
+            set_sched_status(act, sched_runnable);
             act->pool_id = idles_registered;
             sched_pools[idles_registered].idle_act = act;
 			act->is_idle = 1;
             act->priority = PRIO_IDLE;
 #ifdef SMP_ENABLED
             if(idles_registered != 0) {
-                act->sched_status = sched_running;
+                set_sched_status(act, sched_running);
 				// Schedule the idle process when created for cores other than 0.
                 kernel_assert(sched_pools[idles_registered].current_act == NULL);
                 sched_pools[idles_registered].current_act = act;
@@ -193,8 +208,9 @@ void sched_create(uint8_t pool_id, act_t * act, enum sched_prio priority) {
 			critical_section_exit();
         }
 	} else {
-		act->sched_status = sched_terminated;
+		set_sched_status(act, sched_terminated);
 	}
+	act->stats->cpu = act->pool_id;
 }
 
 void sched_change_prio(act_t* act, enum sched_prio new_prio) {
@@ -232,7 +248,7 @@ void sched_delete(act_t * act) {
 		delete_act_from_queue(&sched_pools[act->pool_id], act, sched_terminated);
 	}
 
-	act->sched_status = sched_terminated;
+	set_sched_status(act, sched_terminated);
 
 	spinlock_release(&act->sched_access_lock);
 
@@ -262,6 +278,7 @@ void sched_receive_event(act_t* act, sched_status_e events) {
 	}
 	sched_status_e cause_wake = act->sched_status & events;
 	if(cause_wake) {
+		KERNEL_TRACE_EVENT(TRACE_SCHED_WAKE, TRACE_PTR(act), cause_wake, 0);
 		// Fast path related. Waking something in the fastpath wait needs to set v1.
 		if(cause_wake & (sched_wait_notify | sched_wait_timeout)) act->ret.v1 = FAST_RES_TIME;
 		else if(cause_wake & sched_waiting) act->ret.v1 = FAST_RES_POP;
@@ -333,14 +350,15 @@ void sched_block(act_t *act, sched_status_e status) {
 	if(act->sched_status == sched_runnable || act->sched_status == sched_running) {
 		delete_act_from_queue(&sched_pools[act->pool_id], act, status);
 	} else {
-		act->sched_status = status;
+		set_sched_status(act, status);
 	}
 }
 
 static void sched_deschedule(act_t * act) {
 	/* The caller should have put this in a sensible state if wanted something different */
 	if(act->sched_status == sched_running) {
-		act->sched_status = sched_runnable;
+		set_sched_status(act, sched_runnable);
+		if(!act->is_idle) stats_runnable(act);
 	}
 	KERNEL_TRACE("sched", "Reschedule from activation '%s'", act->name);
 }
@@ -348,8 +366,23 @@ static void sched_deschedule(act_t * act) {
 void sched_schedule(uint8_t pool_id, act_t * act) {
     KERNEL_TRACE("sched", "Reschedule to activation '%s'", act->name);
 	kernel_assert(act->sched_status == sched_runnable);
-	act->sched_status = sched_running;
+	set_sched_status(act, sched_running);
 	sched_pools[pool_id].current_act = act;
+
+	act_kstats_t* stats = act->stats;
+	pool_kstats_t* pool_stats = kstats_pool(pool_id);
+
+	stats->switches++;
+	stats->cpu = pool_id;
+	pool_stats->switches++;
+
+	if(!act->is_idle) {
+		uint32_t waited = stats_now() - stats->runnable_since;
+		stats->runq_wait_time += waited;
+		pool_stats->runq_wait_time += waited;
+		if(waited > stats->runq_wait_max) stats->runq_wait_max = waited;
+		if(waited > pool_stats->runq_wait_max) pool_stats->runq_wait_max = waited;
+	}
 }
 
 static act_t * sched_picknext(sched_pool* pool) {
@@ -455,11 +488,20 @@ void sched_reschedule(act_t *hint, int in_exception_handler) {
 		sched_nothing_to_run();
 	} else {
 
+        pool_kstats_t* pool_stats = kstats_pool(pool_id);
+        uint32_t now = stats_now();
+        uint32_t had = now - pool_stats->last_time;
+        pool_stats->last_time = now;
+
+        if(kernel_curr_act) {
+            kernel_curr_act->stats->had_time += had;
+            kernel_curr_act->stats->had_time_epoch += had;
+            if(kernel_curr_act->is_idle) pool_stats->idle_time += had;
+        }
+
 #if (K_DEBUG)
-        uint32_t last_time = pool->last_time;
-        uint32_t now = (uint32_t)cpu_count_get();
 #define GET_STAT(item, ...) uint64_t item = get_ ## item ##_count();
-#define INC_STAT(item, ...) kernel_curr_act->item += (item - pool->item);
+#define INC_STAT(item, ...) kernel_curr_act->item += (item - pool->item); kernel_curr_act->stats->item = kernel_curr_act->item;
 #define SET_STAT(item, ...) pool->item = item;
 
         STAT_DEBUG_LIST(GET_STAT)
@@ -467,8 +509,7 @@ void sched_reschedule(act_t *hint, int in_exception_handler) {
         if(kernel_curr_act) {
             //resetStatCounters(); reset is a lie for some of the stats. Track ourselves.
 			STAT_DEBUG_LIST(INC_STAT)
-            kernel_curr_act->had_time += now - last_time;
-            kernel_curr_act->had_time_epoch += now - last_time;
+            kernel_curr_act->stats->user_stats = kernel_curr_act->user_stats;
         }
         pool->last_time = now;
         STAT_DEBUG_LIST(SET_STAT)
@@ -479,9 +520,8 @@ void sched_reschedule(act_t *hint, int in_exception_handler) {
 			act_t* from = kernel_curr_act;
 			act_t* to = hint;
 
-#if (K_DEBUG)
-			to->switches++;
-#endif
+			KERNEL_TRACE_EVENT(TRACE_SCHED_SWITCH, TRACE_PTR(from), TRACE_PTR(to), pool_id);
+
 			sched_deschedule(from);
 			sched_schedule(pool_id, to);
 
@@ -35,6 +35,8 @@
 #include "syscalls.h"
 #include "cpu.h"
 #include "dylink_platform.h"
+#include "spinlock.h"
+#include "atomic.h"
 
 /*
  * These functions are those that are available by dynamic linking with the kernel
@@ -66,12 +68,10 @@ __used uint64_t kernel_syscall_bench_end(void) {
 
 DECLARE_WITH_CD(void, kernel_syscall_info_epoch(void));
 __used void kernel_syscall_info_epoch(void) {
-    // a bit racey but its only for debug
-#if (K_DEBUG)
+    // a bit racey but its only for stats
     FOR_EACH_ACT(act) {
-            act->had_time_epoch = 0;
+            act->stats->had_time_epoch = 0;
     }}
-#endif
 }
 
 DECLARE_WITH_CD(act_control_kt, kernel_syscall_actlist_first(void));
@@ -109,17 +109,19 @@ __used void kernel_syscall_act_info(act_control_kt act, act_info_t* info) {
 	info->status = ctrl->status;
     info->cpu = ctrl->pool_id;
 
-#if (K_DEBUG)
-    info->commit_faults = ctrl->commit_faults;
-	info->sent_n = ctrl->sent_n;
-	info->received_n = ctrl->recv_n;
-	info->switches = ctrl->switches;
-	info->had_time = ctrl->had_time;
-    info->had_time_epoch = ctrl->had_time_epoch;
+	act_kstats_t* stats = ctrl->stats;
+	info->commit_faults = stats->commit_faults;
+	info->sent_n = stats->sent_n;
+	info->received_n = stats->recv_n;
+	info->switches = stats->switches;
+	info->had_time = stats->had_time;
+	info->had_time_epoch = stats->had_time_epoch;
 
 	queue_t* q = ctrl->msg_queue;
 
 	info->queue_fill = *q->header.end - q->header.start;
+
+#if (K_DEBUG)
 #define COPY_STAT(item, ...) info->item = ctrl->item;
     STAT_DEBUG_LIST(COPY_STAT)
 
@@ -320,9 +322,65 @@ __used void kernel_syscall_cond_cancel(void) {
 DECLARE_WITH_CD(void, kernel_syscall_cond_notify(act_t* act));
 __used void kernel_syscall_cond_notify(act_t* act) {
 	act = act_unseal_callable(act, notify_ref_sealer);
+    ATOMIC_ADD_RV(&act->stats->notified_n, 64, 16i, 1);
     sched_receive_event(act, sched_wait_notify);
 }
 
+DECLARE_WITH_CD(size_t, kernel_syscall_message_send_batch(const msg_batch_entry_t* msgs, size_t n));
+__used size_t kernel_syscall_message_send_batch(const msg_batch_entry_t* msgs, size_t n) {
+	act_t* source = sched_get_current_act();
+	size_t sent = 0;
+
+	for(size_t i = 0; i != n; i++) {
+		const msg_batch_entry_t* msg = &msgs[i];
+		act_t* dest = act_unseal_ref((act_t*)msg->dest);
+
+		if(dest->status != status_alive) continue;
+
+		// Unlike message_send, this does not wait for a full queue to drain. One slow receiver would hold up the rest.
+		if(msg_push(msg->a0, msg->a1, 0, 0, msg->c3, msg->c4, NULL, NULL, msg->v0, dest, source, NULL) != 0) {
+			kernel_printf(KRED"Could not send batched message to %s. Queue full\n"KRST, dest->name);
+			continue;
+		}
+
+		sent++;
+	}
+
+	return sent;
+}
+
+/* Kernel events carry kernel pointers, so only one activation may read the rings. As with the event registrar the
+ * first to ask gets it, which during boot is bench_collect. */
+static spinlock_t trace_reader_lock;
+static act_t* trace_reader;
+
+DECLARE_WITH_CD(struct trace_ring*, kernel_syscall_trace_ring(int cpu));
+__used struct trace_ring* kernel_syscall_trace_ring(int cpu) {
+	act_t* caller = sched_get_current_act();
+
+	spinlock_acquire(&trace_reader_lock);
+	if(trace_reader == NULL) trace_reader = caller;
+	int allowed = (trace_reader == caller);
+	spinlock_release(&trace_reader_lock);
+
+	return allowed ? kernel_get_trace_ring(cpu) : NULL;
+}
+
+DECLARE_WITH_CD(void, kernel_syscall_trace_event(uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2));
+__used void kernel_syscall_trace_event(uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2) {
+	kernel_trace_user_event(id, a0, a1, a2);
+}
+
+DECLARE_WITH_CD(const act_kstats_t*, kernel_syscall_act_kstats(void));
+__used const act_kstats_t* kernel_syscall_act_kstats(void) {
+	return kernel_get_act_kstats(sched_get_current_act());
+}
+
+DECLARE_WITH_CD(const kstats_t*, kernel_syscall_kstats(void));
+__used const kstats_t* kernel_syscall_kstats(void) {
+	return kernel_get_kstats();
+}
+
 DECLARE_WITH_CD (void, kernel_message_send(register_t a0, register_t a1, register_t a2, register_t a3,
         capability c3, capability c4, capability c5, capability c6,
         act_t* target_activation, ccall_selector_t selector, register_t v0, ret_t* ret));
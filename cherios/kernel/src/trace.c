@@ -0,0 +1,77 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "klib.h"
+#include "cpu.h"
+
+#if (TRACE_RINGS)
+
+static trace_ring_t trace_rings[SMP_CORES];
+
+void kernel_trace_init(void) {
+    for(size_t i = 0; i != SMP_CORES; i++) {
+        trace_rings[i].head = 0;
+        trace_rings[i].cpu = i;
+    }
+}
+
+static void trace_write_here(uint32_t id, uint16_t flags, uint64_t a0, uint64_t a1, uint64_t a2) {
+    uint8_t cpu_id = (uint8_t)cpu_get_cpuid();
+    trace_ring_write(&trace_rings[cpu_id], get_high_res_time(cpu_id), id, flags, a0, a1, a2);
+}
+
+void kernel_trace_event(uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2) {
+    trace_write_here(id, TRACE_F_KERNEL, a0, a1, a2);
+}
+
+void kernel_trace_user_event(uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2) {
+    trace_write_here(id, 0, a0, a1, a2);
+}
+
+trace_ring_t* kernel_get_trace_ring(int cpu_id) {
+    if(cpu_id < 0) cpu_id = (int)cpu_get_cpuid();
+    if(cpu_id >= SMP_CORES) return NULL;
+
+    // Read only. Users write through kernel_trace_user_event so they can neither move head nor pass as the kernel.
+    trace_ring_t* ring = (trace_ring_t*)cheri_setbounds_exact(&trace_rings[cpu_id], sizeof(trace_ring_t));
+    return (trace_ring_t*)cheri_andperm(ring, CHERI_PERM_LOAD);
+}
+
+#else
+
+void kernel_trace_init(void) {}
+
+void kernel_trace_user_event(__unused uint32_t id, __unused uint64_t a0, __unused uint64_t a1, __unused uint64_t a2) {}
+
+trace_ring_t* kernel_get_trace_ring(__unused int cpu_id) {
+    return NULL;
+}
+
+#endif
@@ -37,89 +37,229 @@
 
 /* Notes: Don't add a new event here, add to the header file and the code will be auto generated */
 
-//TODO: We should sniff the terminate events to automatically unsubscribe terminated activations
 //TODO: Not allow subsribe to terminated activation
 //TODO: Not allow subsrcibe by a terminated activation
 //TODO: Not allow users to trigger a notify themselves ;)
 
+/* Subscriptions for each event are hashed by target. Every subscription is also linked to the activation that will be
+ * notified, so when an activation terminates everything it subscribed to can be dropped without searching. */
+
+#define TARGET_BUCKETS      0x40
+#define SUBSCRIBER_BUCKETS  0x40
+#define POOL_CHUNK          0x40
+#define FANOUT_BATCH        0x20
+
+struct notification_list;
+struct subscriber;
+
 typedef struct notification_item {
     act_kt notify;
     act_kt carg;
     register_t port;
     register_t arg;
-    struct notification_item* next;
+    struct notification_list* list;
+    struct notification_item* next;         // Next subscription to the same target
+    struct notification_item** prev;
+    struct subscriber* subscriber;
+    struct notification_item* sub_next;     // Next subscription made for the same notify
+    struct notification_item** sub_prev;
 } notification_item;
 
 typedef struct notification_list {
     act_kt target;
     struct notification_item* head;
     struct notification_list* next;
+    struct notification_list** prev;
 } notification_list;
 
-__unused static void dump_subs(notification_list* list) {
-    while(list != NULL) {
-        notification_item* item = list->head;
-        CHERI_PRINT_CAP(list->target);
-        while(item != NULL) {
-            printf("    |--- port %lx. notify ", item->port);
-            CHERI_PRINT_CAP(item->notify);
-            item = item->next;
+typedef struct subscriber {
+    act_kt notify;
+    struct notification_item* head;
+    struct subscriber* next;
+    struct subscriber** prev;
+} subscriber;
+
+typedef struct event_index {
+    notification_list* buckets[TARGET_BUCKETS];
+} event_index;
+
+static subscriber* subscribers[SUBSCRIBER_BUCKETS];
+
+/* All nodes come from one pool that grows a chunk at a time and is never given back. Subscriptions come and go as
+ * pools of workers are recycled, so this saves a malloc and free for each. */
+
+typedef union pool_node {
+    notification_item item;
+    notification_list list;
+    subscriber sub;
+    union pool_node* free_next;
+} pool_node;
+
+static pool_node* pool_free_list;
+
+static void* pool_alloc(void) {
+    if(pool_free_list == NULL) {
+        pool_node* chunk = (pool_node*)malloc(sizeof(pool_node) * POOL_CHUNK);
+        if(chunk == NULL) return NULL;
+        for(size_t i = 0; i != POOL_CHUNK; i++) {
+            chunk[i].free_next = pool_free_list;
+            pool_free_list = &chunk[i];
         }
-
-        list = list->next;
     }
+
+    pool_node* node = pool_free_list;
+    pool_free_list = node->free_next;
+    return node;
 }
 
-static struct notification_list** find_target(capability target, notification_list** list, int create) {
+static void pool_put(void* node) {
+    ((pool_node*)node)->free_next = pool_free_list;
+    pool_free_list = (pool_node*)node;
+}
 
-    while(*list != NULL) {
-        if((*list)->target == target) {
-            return list;
+static size_t act_hash(act_kt act, size_t buckets) {
+    uint64_t addr = (uint64_t)(cheri_getbase(act) + cheri_getoffset(act));
+    // Activations are large and aligned, so the low bits are mostly the same
+    return (size_t)(((addr >> 6) * 0x9E3779B97F4A7C15ULL) >> 32) & (buckets - 1);
+}
+
+__unused static void dump_subs(event_index* index) {
+    for(size_t b = 0; b != TARGET_BUCKETS; b++) {
+        for(notification_list* list = index->buckets[b]; list != NULL; list = list->next) {
+            CHERI_PRINT_CAP(list->target);
+            for(notification_item* item = list->head; item != NULL; item = item->next) {
+                printf("    |--- port %lx. notify ", item->port);
+                CHERI_PRINT_CAP(item->notify);
+            }
         }
-        list = & (*list)->next;
     }
+}
+
+static notification_list* find_target(act_kt target, event_index* index, int create) {
+    notification_list** bucket = &index->buckets[act_hash(target, TARGET_BUCKETS)];
 
-    if(create) {
-        *list = (notification_list*)malloc(sizeof(notification_list));
-        (*list)->target = target;
-        (*list)->next = NULL;
-        (*list)->head = NULL;
+    for(notification_list* list = *bucket; list != NULL; list = list->next) {
+        if(list->target == target) return list;
     }
 
+    if(!create) return NULL;
+
+    notification_list* list = (notification_list*)pool_alloc();
+
+    if(list == NULL) return NULL;
+
+    list->target = target;
+    list->head = NULL;
+    list->next = *bucket;
+    list->prev = bucket;
+    if(*bucket != NULL) (*bucket)->prev = &list->next;
+    *bucket = list;
+
     return list;
 }
 
-static int subscribe(act_kt target, act_kt notify, capability carg, register_t arg, register_t port, notification_list** list) {
-    notification_list* target_list = *find_target(target, list, 1);
+static subscriber* find_subscriber(act_kt notify, int create) {
+    subscriber** bucket = &subscribers[act_hash(notify, SUBSCRIBER_BUCKETS)];
 
-    notification_item** item;
-    for(item = & target_list->head; *item != NULL; item = & (*item)->next) {
-        if((*item)->notify == notify && (*item)->port == port) return SUBSCRIBE_ALREADY_SUBSCRIBED;
+    for(subscriber* sub = *bucket; sub != NULL; sub = sub->next) {
+        if(sub->notify == notify) return sub;
     }
 
-    *item = (notification_item*)malloc(sizeof(notification_item));
+    if(!create) return NULL;
 
-    (*item)->notify = notify;
-    (*item)->carg = carg;
-    (*item)->arg = arg;
-    (*item)->port = port;
-    (*item)->next = NULL;
+    subscriber* sub = (subscriber*)pool_alloc();
 
-    return SUBSCRIBE_OK;
+    if(sub == NULL) return NULL;
+
+    sub->notify = notify;
+    sub->head = NULL;
+    sub->next = *bucket;
+    sub->prev = bucket;
+    if(*bucket != NULL) (*bucket)->prev = &sub->next;
+    *bucket = sub;
+
+    return sub;
+}
+
+static void free_list_if_empty(notification_list* list) {
+    if(list->head != NULL) return;
+    *list->prev = list->next;
+    if(list->next != NULL) list->next->prev = list->prev;
+    pool_put(list);
+}
+
+static void free_subscriber_if_empty(subscriber* sub) {
+    if(sub->head != NULL) return;
+    *sub->prev = sub->next;
+    if(sub->next != NULL) sub->next->prev = sub->prev;
+    pool_put(sub);
 }
 
-static int unsubscribe(act_kt target, act_kt notify, register_t port, notification_list** list) {
-    notification_list* target_list = *find_target(target, list, 0);
+static void remove_item(notification_item* item) {
+    *item->prev = item->next;
+    if(item->next != NULL) item->next->prev = item->prev;
+
+    *item->sub_prev = item->sub_next;
+    if(item->sub_next != NULL) item->sub_next->sub_prev = item->sub_prev;
+
+    free_list_if_empty(item->list);
+    free_subscriber_if_empty(item->subscriber);
+
+    pool_put(item);
+}
+
+static int subscribe(act_kt target, act_kt notify, capability carg, register_t arg, register_t port, event_index* index) {
+    notification_list* list = find_target(target, index, 0);
+
+    if(list != NULL) {
+        for(notification_item* item = list->head; item != NULL; item = item->next) {
+            if(item->notify == notify && item->port == port) return SUBSCRIBE_ALREADY_SUBSCRIBED;
+        }
+    }
+
+    notification_item* item = (notification_item*)pool_alloc();
+
+    if(item == NULL) return SUBSCRIBE_NO_MEMORY;
+
+    if(list == NULL) list = find_target(target, index, 1);
+
+    subscriber* sub = find_subscriber(notify, 1);
+
+    if(list == NULL || sub == NULL) {
+        pool_put(item);
+        if(list != NULL) free_list_if_empty(list);
+        if(sub != NULL) free_subscriber_if_empty(sub);
+        return SUBSCRIBE_NO_MEMORY;
+    }
 
-    if(target_list == NULL) return SUBSCRIBE_NOT_SUBSCRIBED;
+    item->notify = notify;
+    item->carg = carg;
+    item->arg = arg;
+    item->port = port;
 
+    item->list = list;
+    item->next = list->head;
+    item->prev = &list->head;
+    if(list->head != NULL) list->head->prev = &item->next;
+    list->head = item;
 
-    notification_item** item;
-    for(item = & target_list->head; *item != NULL; item = & (*item)->next) {
-        notification_item* to_free = *item;
-        if((to_free)->notify == notify && (to_free)->port == port) {
-            *item = to_free->next;
-            free(to_free);
+    item->subscriber = sub;
+    item->sub_next = sub->head;
+    item->sub_prev = &sub->head;
+    if(sub->head != NULL) sub->head->sub_prev = &item->sub_next;
+    sub->head = item;
+
+    return SUBSCRIBE_OK;
+}
+
+static int unsubscribe(act_kt target, act_kt notify, register_t port, event_index* index) {
+    notification_list* list = find_target(target, index, 0);
+
+    if(list == NULL) return SUBSCRIBE_NOT_SUBSCRIBED;
+
+    for(notification_item* item = list->head; item != NULL; item = item->next) {
+        if(item->notify == notify && item->port == port) {
+            remove_item(item);
             return SUBSCRIBE_OK;
         }
     }
@@ -127,47 +267,71 @@ static int unsubscribe(act_kt target, act_kt notify, register_t port, notificati
     return SUBSCRIBE_NOT_SUBSCRIBED;
 }
 
-static int unsubscribe_all(act_kt target, act_kt notify, notification_list** list) {
-    notification_list* target_list = *find_target(target, list, 0);
+static int unsubscribe_all(act_kt target, act_kt notify, event_index* index) {
+    notification_list* list = find_target(target, index, 0);
 
-    if(target_list == NULL) return SUBSCRIBE_OK;
+    if(list == NULL) return SUBSCRIBE_OK;
 
-    notification_item** item;
-    for(item = & target_list->head; *item != NULL; item = & (*item)->next) {
-        while((*item)->notify == notify) {
-            notification_item* to_free = *item;
-            *item = to_free->next;
-            free(to_free);
-            if(*item == NULL) break;
-        }
+    notification_item* item, *tmp;
+    // Removing the last item frees the list, which is fine as we never look at it again
+    for(item = list->head; item != NULL; item = tmp) {
+        tmp = item->next;
+        if(item->notify == notify) remove_item(item);
     }
 
     return SUBSCRIBE_OK;
 }
 
-static void notify_all(act_kt target, notification_list** list, int free_after) {
+// Once an activation has terminated nothing should be sent to it again
+static void forget_subscriber(act_kt notify) {
+    subscriber* sub = find_subscriber(notify, 0);
 
-    notification_list** target_list = find_target(target, list, 0);
-
-    if(*target_list == NULL) return;
+    if(sub == NULL) return;
 
     notification_item* item, *tmp;
-    for(item = (*target_list)->head; item != NULL; item = tmp) {
-        tmp = item->next;
-        message_send(item->arg,0,0,0,item->carg,target,NULL,NULL,item->notify, SEND, item->port);
-        if(free_after) free(item);
+    for(item = sub->head; item != NULL; item = tmp) {
+        tmp = item->sub_next;
+        remove_item(item);
     }
+}
+
+static void notify_all(act_kt target, event_index* index, int free_after, int target_dead) {
+
+    notification_list* list = find_target(target, index, 0);
 
-    if(free_after) {
-        notification_list* list_to_free = *target_list;
-        *target_list = list_to_free->next;
-        free(list_to_free);
+    if(list != NULL) {
+        msg_batch_entry_t batch[FANOUT_BATCH];
+        size_t n = 0;
+
+        notification_item* item, *tmp;
+        for(item = list->head; item != NULL; item = tmp) {
+            tmp = item->next;
+
+            msg_batch_entry_t* msg = &batch[n++];
+            msg->a0 = item->arg;
+            msg->a1 = 0;
+            msg->c3 = item->carg;
+            msg->c4 = target;
+            msg->dest = item->notify;
+            msg->v0 = item->port;
+
+            if(n == FANOUT_BATCH) {
+                syscall_message_send_batch(batch, n);
+                n = 0;
+            }
+
+            if(free_after) remove_item(item);
+        }
+
+        if(n != 0) syscall_message_send_batch(batch, n);
     }
+
+    if(target_dead) forget_subscriber(target);
 }
 
 
 #define EVENT_IF_list(name, ...) name ## _list
-#define EVENT_IF_def_list(name, ...) notification_list* EVENT_IF_list(name, __VA_ARGS__) = NULL;
+#define EVENT_IF_def_list(name, ...) event_index EVENT_IF_list(name, __VA_ARGS__);
 
 #define EVENT_IF_BOILERPLATE_subsrcibe(name, ...)\
 int __subscribe_ ## name (act_kt target, act_kt notify, capability carg, register_t arg, register_t port) {   \
@@ -186,18 +350,19 @@ return unsubscribe_all(target, notify, &EVENT_IF_list(name,...));
 
 #define EVENT_IF_NOTIFY(name, once, ...)                    \
 void __notify_ ## name (act_kt target) {               \
-notify_all(target,  &EVENT_IF_list(name, once...), once);   \
+notify_all(target,  &EVENT_IF_list(name, once...), once,    \
+           &EVENT_IF_list(name, once...) == &EVENT_IF_list(terminate,));   \
 }                                                           \
 
 
 #define EVENT_IF_BOILERPLATE(...)                   \
-    EVENT_IF_def_list(__VA_ARGS__)                  \
     EVENT_IF_NOTIFY(__VA_ARGS__)                    \
     EVENT_IF_BOILERPLATE_subsrcibe(__VA_ARGS__)     \
     EVENT_IF_BOILERPLATE_revoke(__VA_ARGS__)        \
     EVENT_IF_BOILERPLATE_revoke_all(__VA_ARGS__)
 
 
+EVENT_LIST(EVENT_IF_def_list,)
 EVENT_LIST(EVENT_IF_BOILERPLATE,)
 
 #define NAMES(name, ...) __notify_ ## name, __subscribe_ ## name, __unsubscribe_ ## name,  __unsubscribe_all_ ## name,
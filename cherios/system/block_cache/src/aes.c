@@ -560,3 +560,248 @@ void AES_CTR_xcrypt_buffer(struct AES_ctx* ctx, uint8_t* buf, uint32_t length)
 }
 
 #endif // #if defined(CTR) && (CTR == 1)
+
+
+
+/*****************************************************************************/
+/* Table driven cipher and XTS mode:                                         */
+/*****************************************************************************/
+
+// Te0[x] = S[x].[02, 01, 01, 03], Te1-3 are Te0 rotated right by 8, 16 and 24 bits.
+// Td0[x] = Si[x].[0e, 09, 0d, 0b], Td1-3 likewise.
+// These are generated once from sbox/rsbox rather than stored, to keep the binary small.
+static uint32_t Te[4][256];
+static uint32_t Td[4][256];
+static volatile int tables_ready = 0;
+
+#define ROTR8(x) (((x) >> 8) | ((x) << 24))
+
+#define GETU32(p) (((uint32_t)(p)[0] << 24) ^ ((uint32_t)(p)[1] << 16) ^ ((uint32_t)(p)[2] <<  8) ^ ((uint32_t)(p)[3]))
+#define PUTU32(p, v) { (p)[0] = (uint8_t)((v) >> 24); (p)[1] = (uint8_t)((v) >> 16); \
+                       (p)[2] = (uint8_t)((v) >>  8); (p)[3] = (uint8_t)(v); }
+
+static uint8_t gmul(uint8_t x, uint8_t y)
+{
+    uint8_t r = 0;
+    while (y)
+    {
+        if (y & 1) r ^= x;
+        x = xtime(x);
+        y >>= 1;
+    }
+    return r;
+}
+
+static void GenTables(void)
+{
+    unsigned i, j;
+    for (i = 0; i < 256; ++i)
+    {
+        uint8_t s = getSBoxValue(i);
+        uint8_t si = getSBoxInvert(i);
+        uint32_t te = ((uint32_t)xtime(s) << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) | (uint32_t)(xtime(s) ^ s);
+        uint32_t td = ((uint32_t)gmul(si, 0x0e) << 24) | ((uint32_t)gmul(si, 0x09) << 16) |
+                      ((uint32_t)gmul(si, 0x0d) << 8) | (uint32_t)gmul(si, 0x0b);
+        for (j = 0; j < 4; ++j)
+        {
+            Te[j][i] = te;
+            Td[j][i] = td;
+            te = ROTR8(te);
+            td = ROTR8(td);
+        }
+    }
+    tables_ready = 1;
+}
+
+void AES_fast_init_ctx(struct AES_fast_ctx* ctx, const uint8_t* key)
+{
+    uint8_t RoundKey[AES_keyExpSize];
+    unsigned i, j, r;
+
+    if (!tables_ready) GenTables();
+
+    KeyExpansion(RoundKey, key);
+
+    for (i = 0; i < AES_ROUND_KEY_WORDS; ++i)
+    {
+        ctx->EncKey[i] = GETU32(RoundKey + (i * 4));
+    }
+
+    // The equivalent inverse cipher uses the round keys in reverse order, with InvMixColumns applied to all but
+    // the first and last. Td[Sbox[x]] is exactly InvMixColumns on a single byte.
+    for (r = 0; r <= Nr; ++r)
+    {
+        for (j = 0; j < Nb; ++j)
+        {
+            uint32_t w = ctx->EncKey[((Nr - r) * Nb) + j];
+            if (r != 0 && r != Nr)
+            {
+                w = Td[0][getSBoxValue(w >> 24)] ^ Td[1][getSBoxValue((w >> 16) & 0xff)] ^
+                    Td[2][getSBoxValue((w >> 8) & 0xff)] ^ Td[3][getSBoxValue(w & 0xff)];
+            }
+            ctx->DecKey[(r * Nb) + j] = w;
+        }
+    }
+}
+
+void AES_fast_encrypt_block(const struct AES_fast_ctx* ctx, const uint8_t* in, uint8_t* out)
+{
+    const uint32_t* rk = ctx->EncKey;
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    unsigned round;
+
+    s0 = GETU32(in     ) ^ rk[0];
+    s1 = GETU32(in +  4) ^ rk[1];
+    s2 = GETU32(in +  8) ^ rk[2];
+    s3 = GETU32(in + 12) ^ rk[3];
+
+    for (round = 1; round < Nr; ++round)
+    {
+        rk += Nb;
+        t0 = Te[0][s0 >> 24] ^ Te[1][(s1 >> 16) & 0xff] ^ Te[2][(s2 >> 8) & 0xff] ^ Te[3][s3 & 0xff] ^ rk[0];
+        t1 = Te[0][s1 >> 24] ^ Te[1][(s2 >> 16) & 0xff] ^ Te[2][(s3 >> 8) & 0xff] ^ Te[3][s0 & 0xff] ^ rk[1];
+        t2 = Te[0][s2 >> 24] ^ Te[1][(s3 >> 16) & 0xff] ^ Te[2][(s0 >> 8) & 0xff] ^ Te[3][s1 & 0xff] ^ rk[2];
+        t3 = Te[0][s3 >> 24] ^ Te[1][(s0 >> 16) & 0xff] ^ Te[2][(s1 >> 8) & 0xff] ^ Te[3][s2 & 0xff] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    // The last round has no MixColumns
+    rk += Nb;
+#define LAST_E(a, b, c, d) (((uint32_t)getSBoxValue(a >> 24) << 24) ^ ((uint32_t)getSBoxValue((b >> 16) & 0xff) << 16) ^ \
+                            ((uint32_t)getSBoxValue((c >> 8) & 0xff) << 8) ^ (uint32_t)getSBoxValue(d & 0xff))
+    t0 = LAST_E(s0, s1, s2, s3) ^ rk[0];
+    t1 = LAST_E(s1, s2, s3, s0) ^ rk[1];
+    t2 = LAST_E(s2, s3, s0, s1) ^ rk[2];
+    t3 = LAST_E(s3, s0, s1, s2) ^ rk[3];
+#undef LAST_E
+
+    PUTU32(out     , t0);
+    PUTU32(out +  4, t1);
+    PUTU32(out +  8, t2);
+    PUTU32(out + 12, t3);
+}
+
+void AES_fast_decrypt_block(const struct AES_fast_ctx* ctx, const uint8_t* in, uint8_t* out)
+{
+    const uint32_t* rk = ctx->DecKey;
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    unsigned round;
+
+    s0 = GETU32(in     ) ^ rk[0];
+    s1 = GETU32(in +  4) ^ rk[1];
+    s2 = GETU32(in +  8) ^ rk[2];
+    s3 = GETU32(in + 12) ^ rk[3];
+
+    for (round = 1; round < Nr; ++round)
+    {
+        rk += Nb;
+        t0 = Td[0][s0 >> 24] ^ Td[1][(s3 >> 16) & 0xff] ^ Td[2][(s2 >> 8) & 0xff] ^ Td[3][s1 & 0xff] ^ rk[0];
+        t1 = Td[0][s1 >> 24] ^ Td[1][(s0 >> 16) & 0xff] ^ Td[2][(s3 >> 8) & 0xff] ^ Td[3][s2 & 0xff] ^ rk[1];
+        t2 = Td[0][s2 >> 24] ^ Td[1][(s1 >> 16) & 0xff] ^ Td[2][(s0 >> 8) & 0xff] ^ Td[3][s3 & 0xff] ^ rk[2];
+        t3 = Td[0][s3 >> 24] ^ Td[1][(s2 >> 16) & 0xff] ^ Td[2][(s1 >> 8) & 0xff] ^ Td[3][s0 & 0xff] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    rk += Nb;
+#define LAST_D(a, b, c, d) (((uint32_t)getSBoxInvert(a >> 24) << 24) ^ ((uint32_t)getSBoxInvert((b >> 16) & 0xff) << 16) ^ \
+                            ((uint32_t)getSBoxInvert((c >> 8) & 0xff) << 8) ^ (uint32_t)getSBoxInvert(d & 0xff))
+    t0 = LAST_D(s0, s3, s2, s1) ^ rk[0];
+    t1 = LAST_D(s1, s0, s3, s2) ^ rk[1];
+    t2 = LAST_D(s2, s1, s0, s3) ^ rk[2];
+    t3 = LAST_D(s3, s2, s1, s0) ^ rk[3];
+#undef LAST_D
+
+    PUTU32(out     , t0);
+    PUTU32(out +  4, t1);
+    PUTU32(out +  8, t2);
+    PUTU32(out + 12, t3);
+}
+
+void AES_XTS_init_ctx(struct AES_XTS_ctx* ctx, const uint8_t* key, const uint8_t* tweak_key, uint32_t sector_size)
+{
+    AES_fast_init_ctx(&ctx->data, key);
+    AES_fast_init_ctx(&ctx->tweak, tweak_key);
+    ctx->sector_size = sector_size;
+}
+
+void AES_XTS_init_ctx_iv(struct AES_XTS_ctx* ctx, const uint8_t* key, const uint8_t* iv, uint32_t sector_size)
+{
+    uint8_t tweak_key[AES_KEYLEN];
+    uint32_t i;
+
+    AES_fast_init_ctx(&ctx->data, key);
+
+    // Tweak key is E_K(iv), E_K(iv ^ 1), ... so that it is never equal to the data key
+    for (i = 0; i < AES_KEYLEN; i += AES_BLOCKLEN)
+    {
+        memcpy(tweak_key + i, iv, AES_BLOCKLEN);
+        tweak_key[i + AES_BLOCKLEN - 1] ^= (uint8_t)(i / AES_BLOCKLEN);
+        AES_fast_encrypt_block(&ctx->data, tweak_key + i, tweak_key + i);
+    }
+
+    AES_fast_init_ctx(&ctx->tweak, tweak_key);
+    ctx->sector_size = sector_size;
+}
+
+// Multiply the tweak by the primitive element alpha of GF(2^128). The tweak is little endian as per IEEE 1619.
+static void XtsMulAlpha(uint8_t* T)
+{
+    uint8_t carry = T[AES_BLOCKLEN - 1] >> 7;
+    unsigned i;
+    for (i = AES_BLOCKLEN - 1; i > 0; --i)
+    {
+        T[i] = (uint8_t)((T[i] << 1) | (T[i - 1] >> 7));
+    }
+    T[0] = (uint8_t)((T[0] << 1) ^ (carry * 0x87));
+}
+
+static void XTS_crypt_buffer(const struct AES_XTS_ctx* ctx, uint64_t offset, uint8_t* buf, uint32_t length, int decrypt)
+{
+    uint8_t T[AES_BLOCKLEN];
+    uint8_t block[AES_BLOCKLEN];
+    uint32_t sector_size = ctx->sector_size;
+
+    while (length != 0)
+    {
+        uint64_t sector = offset / sector_size;
+        uint32_t in_sector = (uint32_t)(offset % sector_size);
+        uint32_t n = sector_size - in_sector;
+        uint32_t i, j;
+
+        if (n > length) n = length;
+
+        // T = E_K2(sector number) * alpha^j for the j'th block of the sector
+        for (i = 0; i < AES_BLOCKLEN; ++i)
+        {
+            T[i] = (i < sizeof(sector)) ? (uint8_t)(sector >> (8 * i)) : 0;
+        }
+        AES_fast_encrypt_block(&ctx->tweak, T, T);
+        for (j = in_sector / AES_BLOCKLEN; j != 0; --j)
+        {
+            XtsMulAlpha(T);
+        }
+
+        for (i = 0; i < n; i += AES_BLOCKLEN)
+        {
+            for (j = 0; j < AES_BLOCKLEN; ++j) block[j] = buf[i + j] ^ T[j];
+            if (decrypt) AES_fast_decrypt_block(&ctx->data, block, block);
+            else AES_fast_encrypt_block(&ctx->data, block, block);
+            for (j = 0; j < AES_BLOCKLEN; ++j) buf[i + j] = block[j] ^ T[j];
+            XtsMulAlpha(T);
+        }
+
+        buf += n;
+        offset += n;
+        length -= n;
+    }
+}
+
+void AES_XTS_encrypt_buffer(const struct AES_XTS_ctx* ctx, uint64_t offset, uint8_t* buf, uint32_t length)
+{
+    XTS_crypt_buffer(ctx, offset, buf, length, 0);
+}
+
+void AES_XTS_decrypt_buffer(const struct AES_XTS_ctx* ctx, uint64_t offset, uint8_t* buf, uint32_t length)
+{
+    XTS_crypt_buffer(ctx, offset, buf, length, 1);
+}
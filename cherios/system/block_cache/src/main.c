@@ -331,7 +331,7 @@ static void unlock(session_sock* ss, locked_t locked_data) {
     }
 
     if(!aes_data->innited) {
-        AES_init_ctx_iv(&aes_data->ctx, aes_data->key, (const uint8_t *)&aes_data->iv);
+        AES_XTS_init_ctx_iv(&aes_data->ctx, aes_data->key, (const uint8_t *)&aes_data->iv, SECTOR_SIZE);
         aes_data->innited = 1;
     }
 
@@ -376,9 +376,9 @@ __used ssize_t ff(capability arg, char* buf, __unused uint64_t offset, uint64_t
 
             if(is_user_write) {
                 // FIXME: Technically insecure you have intermediate states in the block_buf, but I dont really care. Its a demo.
-                AES_CBC_encrypt_buffer(&aes_data->ctx, (uint8_t*)block_buf, (uint32_t)to_copy);
+                AES_XTS_encrypt_buffer(&aes_data->ctx, addr, (uint8_t*)block_buf, (uint32_t)to_copy);
             } else {
-                AES_CBC_decrypt_buffer(&aes_data->ctx, (uint8_t*)buf, (uint32_t)to_copy);
+                AES_XTS_decrypt_buffer(&aes_data->ctx, addr, (uint8_t*)buf, (uint32_t)to_copy);
             }
         }
 
@@ -421,7 +421,7 @@ __used ssize_t ff_sub(capability arg, __unused uint64_t offset, uint64_t length,
     // TODO currently this will leave the cache in an un-encrypted state which is bad for both security and correctness
     if(aes_data) {
         assert_int_ex(to_copy & (AES_BLOCKLEN-1), ==, 0);
-        AES_CBC_decrypt_buffer(&aes_data->ctx, (uint8_t *)block_buf, (uint32_t)to_copy);
+        AES_XTS_decrypt_buffer(&aes_data->ctx, addr, (uint8_t *)block_buf, (uint32_t)to_copy);
     }
 
     // TODO at this point we have to somehow track when the resulting request is fulfilled. Then we know we can release the buffer
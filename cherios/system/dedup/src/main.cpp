@@ -41,12 +41,18 @@ extern "C" {
     #include "deduplicate.h"
     #include "string.h"
     #include "thread.h"
+    #include "stdlib.h"
+    #include "pthread.h"
+    #include "atomic.h"
 }
 
 
-template <size_t size, size_t max_cuckoos, class mapT, mapT empty>
-class cuckoomap {
-    // STL was giving me pain - so here is a simple cuckoo hashmap from sha256 to an arbitrary type
+template <size_t shards, size_t initial_slots, class mapT, mapT empty>
+class shardmap {
+    // A map from sha256 to an arbitrary type. Split into shards that each have their own lock so that several workers
+    // can use it at once. Each shard is an open addressed table that doubles when 3/4 full, so nothing is ever lost.
+    // Creating a value and growing a table both allocate, which can block, so the shard locks are mutexes that sleep
+    // rather than spinlocks.
 
 public:
     struct map_entry {
@@ -54,89 +60,128 @@ public:
         mapT val;
     };
 
-    map_entry* find_or_insert(sha256_hash hash, mapT& out_lost) {
-        size_t h1 = hash1(hash);
-        size_t h2 = hash2(hash);
-
-        out_lost = nullptr;
+    void init(void) {
+        for(size_t i = 0; i != shards; i++) {
+            shard_t* s = &shard[i];
+            pthread_mutex_init(&s->lock, NULL);
+            s->table = alloc_table(initial_slots);
+            s->mask = initial_slots - 1;
+            s->used = 0;
+            s->hits = s->misses = s->grows = 0;
+        }
+    }
 
-        if(chash(table[h1].hash, hash)) return &table[h1];
-        if(chash(table[h2].hash, hash)) return &table[h2];
+    mapT find(sha256_hash hash) {
+        shard_t* s = pick(hash);
 
-        if(table[h1].val == empty) {
-            table[h1].hash = hash;
-            return &table[h1];
-        } else if(table[h2].val == empty) {
-            table[h2].hash = hash;
-            return &table[h2];
-        } else {
-            size_t cuckoos = 0;
-            size_t index = h2;
-            mapT value = empty;
+        pthread_mutex_lock(&s->lock);
 
-            mapT kickedV;
+        map_entry* entry = probe(s, hash);
+        mapT val = entry->val;
 
-            do {
-                kickedV = table[index].val;
-                sha256_hash kickedH = table[index].hash;
+        if(val != empty) s->hits++;
+        else s->misses++;
 
-                table[index].hash = hash;
-                table[index].val = value;
+        pthread_mutex_unlock(&s->lock);
 
-                if(kickedV != empty) {
-                    size_t kh1 = hash1(kickedH);
-                    size_t kh2 = hash2(kickedH);
-                    size_t otherh = (index == kh1) ? kh2 : kh1;
+        return val;
+    }
 
-                    hash = kickedH;
-                    value = kickedV;
-                    index = otherh;
+    // Returns what hash maps to, calling make to create it if it is missing. make is called with the shard locked so
+    // two workers will never both create the same value. Values cannot always be undone (a foundation cannot), so
+    // making one speculatively outside the lock and dropping the loser is not an option.
+    template<typename F>
+    mapT find_or_create(sha256_hash hash, F make) {
+        shard_t* s = pick(hash);
 
-                    cuckoos++;
-                }
+        pthread_mutex_lock(&s->lock);
 
-            }  while(kickedV != empty && cuckoos != max_cuckoos && index != h2);
+        map_entry* entry = probe(s, hash);
+        mapT val = entry->val;
 
-            if(kickedV != empty) {
-                out_lost = kickedV;
+        if(val != empty) {
+            s->hits++;
+        } else {
+            s->misses++;
+            val = make();
+            if(val != empty) {
+                entry->hash = hash;
+                entry->val = val;
+                if(++s->used > ((s->mask + 1) / 4) * 3) grow(s);
             }
+        }
+
+        pthread_mutex_unlock(&s->lock);
 
-            return &table[h2];
+        return val;
+    }
+
+    void get_stats(dedup_index_stats* out) {
+        *out = {};
+        for(size_t i = 0; i != shards; i++) {
+            shard_t* s = &shard[i];
+            pthread_mutex_lock(&s->lock);
+            out->entries += s->used;
+            out->capacity += s->mask + 1;
+            out->hits += s->hits;
+            out->misses += s->misses;
+            out->grows += s->grows;
+            pthread_mutex_unlock(&s->lock);
         }
     }
 
-    map_entry* find(sha256_hash hash) {
-        size_t h1 = (hash.doublewords[0] ^ hash.doublewords[1]) % size;
-        size_t h2 = (hash.doublewords[2] ^ hash.doublewords[3]) % size;
+private:
+    struct shard_t {
+        pthread_mutex_t lock;
+        map_entry* table;
+        size_t mask;
+        size_t used;
+        size_t hits;
+        size_t misses;
+        size_t grows;
+    };
 
-        if(chash(table[h1].hash,hash)) {
-            return &(table[h1]);
-        } else if (chash(table[h2].hash,hash)) {
-            return &(table[h2]);
-        } else return nullptr;
-    }
+    shard_t shard[shards];
 
-    void remove(map_entry* entry) {
-        entry->val = empty;
-        entry->hash.doublewords[0] = 0;
-        entry->hash.doublewords[1] = 0;
-        entry->hash.doublewords[2] = 0;
-        entry->hash.doublewords[3] = 0;
+    static_assert((initial_slots & (initial_slots - 1)) == 0, "Must be a power of 2");
 
+    static map_entry* alloc_table(size_t slots) {
+        map_entry* table = (map_entry*)malloc(slots * sizeof(map_entry));
+        assert(table != nullptr);
+        for(size_t i = 0; i != slots; i++) table[i].val = empty;
+        return table;
     }
 
-private:
-    map_entry table[size];
+    // The first doubleword picks the shard, the second the slot, so the two are independent
+    shard_t* pick(sha256_hash hash) {
+        return &shard[hash.doublewords[0] % shards];
+    }
 
-    size_t hash1(sha256_hash hash) {
-        return (hash.doublewords[0] ^ hash.doublewords[1]) % size;
+    // Either the entry for hash, or the empty slot it would go in
+    map_entry* probe(shard_t* s, sha256_hash hash) {
+        size_t i = hash.doublewords[1] & s->mask;
+        while(s->table[i].val != empty && !chash(s->table[i].hash, hash)) {
+            i = (i + 1) & s->mask;
+        }
+        return &s->table[i];
     }
 
-    size_t hash2(sha256_hash hash) {
-        return (hash.doublewords[2] ^ hash.doublewords[3]) % size;
+    void grow(shard_t* s) {
+        map_entry* old = s->table;
+        size_t old_slots = s->mask + 1;
+
+        s->table = alloc_table(old_slots * 2);
+        s->mask = (old_slots * 2) - 1;
+        s->grows++;
+
+        for(size_t i = 0; i != old_slots; i++) {
+            if(old[i].val != empty) *probe(s, old[i].hash) = old[i];
+        }
+
+        free(old);
     }
 
-    bool chash(sha256_hash h1, sha256_hash h2) {
+    static bool chash(sha256_hash h1, sha256_hash h2) {
         return (h1.doublewords[0] == h2.doublewords[0]) &&
                 (h1.doublewords[1] == h2.doublewords[1]) &&
                 (h1.doublewords[2] == h2.doublewords[2]) &&
@@ -145,7 +190,14 @@ private:
 
 };
 
-cuckoomap<0x2000,0x10,entry_t, nullptr> map;
+#define DEDUP_SHARDS        0x10
+#define DEDUP_SHARD_SLOTS   0x200
+#define DEDUP_WORKERS       4
+
+shardmap<DEDUP_SHARDS, DEDUP_SHARD_SLOTS, entry_t, nullptr> map;
+
+act_kt workers[DEDUP_WORKERS];
+size_t next_worker;
 
 void hash_test(void) {
     // Check hashing is working...
@@ -183,6 +235,24 @@ void hash_test(void) {
              0x460365f37df5b9a3
     );
 
+    // Check the multi-buffer hash agrees with the single one, with more jobs than lanes
+    {
+        uint64_t multi_in[8][40];
+        sha256_hash multi_out[8];
+        sha256_job jobs[8];
+        for(size_t i = 0; i != 8; i++) {
+            for(size_t j = 0; j != 40; j++) multi_in[i][j] = (i << 32) ^ (j * 0x9e3779b97f4a7c15);
+            jobs[i].in = multi_in[i];
+            jobs[i].length = i * 40; // 0 to 280 bytes, covers both one and two padding blocks
+            jobs[i].hash = &multi_out[i];
+        }
+        sha256_multi(jobs, 8);
+        for(size_t i = 0; i != 8; i++) {
+            sha256(multi_in[i], &hash, i * 40);
+            for(size_t j = 0; j != 4; j++) assert_int_ex(multi_out[i].doublewords[j], ==, hash.doublewords[j]);
+        }
+    }
+
     // Check foundations get the right ID
     res_t test_res = cap_malloc(FOUNDATION_META_SIZE(4, 0x10));
 
@@ -201,39 +271,29 @@ void hash_test(void) {
     cap_free((test_res));
 }
 
-entry_t create(uint64_t* data, size_t length) {
-
-    sha256_hash hash;
-    sha256(data, &hash, length);
+entry_t create_hashed(sha256_hash hash, uint64_t* data, size_t length) {
 
-    entry_t lost = nullptr;
+    return map.find_or_create(hash, [=]() {
+        res_t res = cap_malloc(FOUNDATION_META_SIZE(1, length) + length);
 
-    auto result = map.find_or_insert(hash, lost);
-
-    if(lost != nullptr) {
-        // TODO: Got pushed out of the cache, fix this.
-        assert(lost == nullptr && "Table overflow");
-    }
+        entry_t new_entry = foundation_create(res, length, data, 0, 1, 1);
 
-    if(result->val != nullptr) return result->val;
+        assert(new_entry != nullptr);
 
-    res_t res = cap_malloc(FOUNDATION_META_SIZE(1, length) + length);
-
-    entry_t new_entry = foundation_create(res, length, data, 0, 1, 1);
+        return new_entry;
+    });
+}
 
-    assert(new_entry != nullptr);
+entry_t create(uint64_t* data, size_t length) {
 
-    result->val = new_entry;
+    sha256_hash hash;
+    sha256(data, &hash, length);
 
-    return new_entry;
+    return create_hashed(hash, data, length);
 }
 
 entry_t find(sha256_hash hash) {
-    auto result = map.find(hash);
-    if(result == nullptr) return nullptr;
-    else return result->val;
-
-    return NULL;
+    return map.find(hash);
 }
 
 entry_t dont_create(uint64_t* data, size_t length) {
@@ -253,16 +313,41 @@ extern "C" {
         return 0;
     }
 
+    static void worker_start(register_t arg, __unused capability carg) {
+        workers[arg] = act_self_ref;
+        msg_enable = 1;
+    }
+
     int main(void) {
         printf("Deduplicate Hello World!\n");
 
         hash_test();
 
+        map.init();
+
+        workers[0] = act_self_ref;
+
+        for(size_t i = 1; i != DEDUP_WORKERS; i++) {
+            thread_new("dedup_worker", i, NULL, &worker_start);
+        }
+
         msg_enable = 1;
 
         return 0;
     }
 
+    // Clients ask once for a worker to use, which spreads them out over the workers
+    act_kt __deduplicate_worker(void) {
+        size_t n = ATOMIC_ADD_RV(&next_worker, 64, 16i, 1) % DEDUP_WORKERS;
+        act_kt worker = workers[n];
+        return worker ? worker : act_self_ref;
+    }
+
+    int __deduplicate_index_stats(dedup_index_stats* out) {
+        map.get_stats(out);
+        return 0;
+    }
+
     ERROR_T(entry_t) __deduplicate(uint64_t* data, size_t length) {
         if((length & 0x7) != 0) return MAKE_ER(entry_t, DEDUP_ERROR_LENGTH_NOT_EVEN);
 
@@ -283,7 +368,40 @@ extern "C" {
         return find(hash);
     }
 
-    void (*msg_methods[]) = {(void*)&__deduplicate, (void*)&__deduplicate_find, (void*)&__deduplicate_dont_create, (void*)be_public};
+    int __deduplicate_batch(dedup_batch_item* items, size_t n, int allow_create) {
+        if(n > DEDUP_BATCH_MAX) return DEDUP_ERROR_BATCH_TOO_LARGE;
+
+        sha256_job jobs[DEDUP_BATCH_MAX];
+        sha256_hash hashes[DEDUP_BATCH_MAX];
+        size_t ndxs[DEDUP_BATCH_MAX];
+        size_t n_jobs = 0;
+
+        for(size_t i = 0; i != n; i++) {
+            uint64_t* data = items[i].data;
+            size_t length = items[i].length;
+
+            items[i].result = nullptr;
+
+            if((length & 0x7) != 0 || (cheri_getcursor(data) & 0x7) != 0) continue;
+
+            jobs[n_jobs].in = data;
+            jobs[n_jobs].length = length;
+            jobs[n_jobs].hash = &hashes[n_jobs];
+            ndxs[n_jobs++] = i;
+        }
+
+        sha256_multi(jobs, n_jobs);
+
+        for(size_t j = 0; j != n_jobs; j++) {
+            dedup_batch_item* item = &items[ndxs[j]];
+            item->result = allow_create ? create_hashed(hashes[j], item->data, item->length) : find(hashes[j]);
+        }
+
+        return 0;
+    }
+
+    void (*msg_methods[]) = {(void*)&__deduplicate, (void*)&__deduplicate_find, (void*)&__deduplicate_dont_create, (void*)be_public,
+                             (void*)&__deduplicate_batch, (void*)&__deduplicate_index_stats, (void*)&__deduplicate_worker};
     size_t msg_methods_nb = countof(msg_methods);
     void (*ctrl_methods[]) = {NULL};
     size_t ctrl_methods_nb = countof(ctrl_methods);
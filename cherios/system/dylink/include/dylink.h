@@ -207,6 +207,15 @@ typedef struct new_thread_request {
     res_t ustack_res;
 } new_thread_request_t;
 
+// An entry in the read-only table of symbols a library publishes. cap is exactly what resolve_syms would return for
+// this name. TLS symbols differ per thread and so are never exported.
+typedef struct dylink_export {
+    unsigned long hash;             // elf hash of the name a client asks for
+    const unsigned char* name;
+    capability cap;
+    int function;                   // Resolved when the client asks for functions (i.e. from the PLT)
+} dylink_export_t;
+
 typedef struct new_process_request {
     nonce_t nonce;
     found_id_t* client_id;
@@ -228,6 +237,9 @@ struct lib_info {
     void (*resolve_syms)(const unsigned char** in, capability* out, size_t n_syms, int functions);
     // This last one is server only, and can be called BEFORE a new thread is created
     capability (*new_library_thread)(new_thread_request_t* thread_request);
+    // Sorted by hash. Lets clients bind most symbols without calling resolve_syms. May be NULL.
+    const dylink_export_t* exports;
+    size_t n_exports;
 };
 
 extern lib_info_t own_info;
@@ -244,6 +256,9 @@ void auto_dylink_post_new_thread(link_session_t* session, capability* data_args)
 // Link-interface functions
 void set_info_functions(lib_info_t* info);
 
+// Libraries call this once their dynamic section is parsed to publish their symbols
+void build_export_table(lib_info_t* info);
+
 #else
 #include "dylink_platform.h"
 #endif // ASSEMBLY
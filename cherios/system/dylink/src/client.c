@@ -64,6 +64,23 @@ DEFAULT_IMPL(int, printf, (__unused const char *fmt, ...)) {
 lib_info_t own_info;
 parsed_dynamic_t own_pd;
 
+// What a symbol in our own symbol table was bound to the first time a relocation asked for it. There are two per
+// symbol, indexed by whether the relocation wants a function, as that changes which export matches.
+typedef struct sym_binding {
+    uint16_t state;
+    uint16_t lib_ndx;       // Library it was found in, or the one the batched exchange should start from
+    uint32_t ndx;           // Index into that library's export table, or into our own symbol table
+} sym_binding_t;
+
+enum {
+    SYM_BIND_UNKNOWN = 0,
+    SYM_BIND_OWN,
+    SYM_BIND_EXPORT,
+    SYM_BIND_SLOW,
+};
+
+static sym_binding_t* sym_bindings;
+
 // Standard elf hash of name appended to suffix
 static unsigned long
 elf_Hash2(const unsigned char* name, const unsigned char *suffix) {
@@ -340,11 +357,15 @@ static capability send_new_process_request(link_partner_t* partner) {
     return resp;
 }
 
+static const unsigned char* cross_domain_prefix(void) {
+    return (const unsigned char*)( was_secure_loaded ? "__cross_domain_" : "__cross_domain_trusted_");
+}
+
 static void resolve_syms_internal(const unsigned char** in, capability* out, size_t n_syms, int functions, int internal) {
 
     if(internal) functions = 0;
 
-    const unsigned char* prefix = (const unsigned char*)( was_secure_loaded ? "__cross_domain_" : "__cross_domain_trusted_");
+    const unsigned char* prefix = cross_domain_prefix();
     parsed_dynamic_t* pd = &own_pd;
 
     for(size_t i = 0; i != n_syms; i++) {
@@ -368,6 +389,98 @@ static void resolve_syms_internal(const unsigned char** in, capability* out, siz
     }
 }
 
+// Fill an export entry for sym if resolve_syms could ever return it. Mirrors resolve_syms_internal.
+static int make_export(parsed_dynamic_t* pd, const Elf64_Sym* sym, dylink_export_t* ex) {
+    if(sym->st_shndx == 0 || ELF64_ST_TYPE(sym->st_info) == STT_TLS) return 0;
+
+    const unsigned char* name = &pd->strtab[sym->st_name];
+    const unsigned char* prefix = cross_domain_prefix();
+    size_t prefix_len = strlen((const char*)prefix);
+
+    if(strncmp((const char*)name, (const char*)prefix, prefix_len) == 0) {
+        ex->function = 1;
+        ex->name = name + prefix_len;
+    } else if(ELF64_ST_TYPE(sym->st_info) != STT_FUNC) {
+        ex->function = 0;
+        ex->name = name;
+    } else return 0;
+
+    if(ex->name[0] == '\0') return 0;
+
+    ex->cap = symbol_to_capability(pd, sym);
+
+    if(ex->function && was_secure_loaded) {
+        ex->cap = cheri_seal(ex->cap, get_cds());
+    }
+
+    ex->name = set_str_to_len(ex->name);
+    ex->hash = elf_Hash2(ex->name, NULL);
+
+    return 1;
+}
+
+// We may not have malloc yet, so go straight to the memory manager. Returns NULL if it would not give us any.
+static void* request_table(size_t size) {
+    ERROR_T(res_t) res = mem_request(0, size, COMMIT_NOW, own_mop);
+    if(!IS_VALID(res)) return NULL;
+    _safe cap_pair pair;
+    rescap_take(res.val, &pair);
+    return pair.data;
+}
+
+void build_export_table(lib_info_t* info) {
+    parsed_dynamic_t* pd = &own_pd;
+    dylink_export_t ex;
+    size_t n = 0;
+
+    for(size_t i = 1; i < pd->symtab_ents; i++) {
+        n += make_export(pd, &pd->symtab[i], &ex);
+    }
+
+    info->exports = NULL;
+    info->n_exports = 0;
+
+    if(n == 0) return;
+
+    dylink_export_t* table = (dylink_export_t*)request_table(n * sizeof(dylink_export_t));
+
+    if(table == NULL) return;
+
+    n = 0;
+    for(size_t i = 1; i < pd->symtab_ents; i++) {
+        if(make_export(pd, &pd->symtab[i], &ex)) {
+            // Insertion sort by hash. Only done once when the library starts.
+            size_t j = n++;
+            while(j != 0 && table[j-1].hash > ex.hash) {
+                table[j] = table[j-1];
+                j--;
+            }
+            table[j] = ex;
+        }
+    }
+
+    info->exports = cheri_andperm(table, CHERI_PERM_LOAD | CHERI_PERM_LOAD_CAP);
+    info->n_exports = n;
+}
+
+static const dylink_export_t* lookup_export(const lib_info_t* info, unsigned long h, const unsigned char* name, int functions) {
+    const dylink_export_t* exports = info->exports;
+    size_t lo = 0, hi = info->n_exports;
+
+    while(lo != hi) {
+        size_t mid = (lo + hi) / 2;
+        if(exports[mid].hash < h) lo = mid + 1;
+        else hi = mid;
+    }
+
+    for(; lo != info->n_exports && exports[lo].hash == h; lo++) {
+        const dylink_export_t* ex = &exports[lo];
+        if(ex->function == functions && strcmp((const char*)ex->name, (const char*)name) == 0) return ex;
+    }
+
+    return NULL;
+}
+
 extern void CROSS_DOMAIN(provide_session)(link_session_t* session, res_t plt_res, int first_thread, capability* data_args);
 extern void CROSS_DOMAIN(resolve_syms)(const unsigned char** in, capability* out, size_t n_syms, int functions);
 extern void CROSS_DOMAIN(provide_common)(act_control_kt self_ctrl, act_kt self_ref, mop_t mop);
@@ -578,6 +691,68 @@ static void batch_symbols(link_session_t* session, parsed_dynamic_t* parsed, cap
     block_fills[lib_ndx] = 0;
 }
 
+// Finds what a (non TLS) symbol binds to in the tables libraries publish, searching in the same order the batched
+// exchange would. Leaves the binding as SYM_BIND_SLOW, with the library the batched exchange should start from, if it
+// cannot tell.
+static void resolve_binding(link_session_t* session, const unsigned char* name, int functions, size_t own_ndx,
+                            sym_binding_t* b) {
+    unsigned long h = elf_Hash2(name, NULL);
+
+    for(size_t lib_ndx = 0; lib_ndx != session->n_libs; lib_ndx++) {
+        if(lib_ndx == own_ndx) {
+            const Elf64_Sym* sym = lookup_symbol_by_name(&own_pd, name, NULL);
+            if(sym == NULL || sym->st_shndx == 0) continue;
+            b->state = SYM_BIND_OWN;
+            b->lib_ndx = (uint16_t)lib_ndx;
+            b->ndx = (uint32_t)(sym - own_pd.symtab);
+            return;
+        } else {
+            const lib_info_t* info = session->partners[lib_ndx].info;
+            b->lib_ndx = (uint16_t)lib_ndx;
+            if(info->exports == NULL) {
+                b->state = SYM_BIND_SLOW;
+                return;
+            }
+            const dylink_export_t* ex = lookup_export(info, h, name, functions);
+            if(ex == NULL) continue;
+            b->state = SYM_BIND_EXPORT;
+            b->ndx = (uint32_t)(ex - info->exports);
+            return;
+        }
+    }
+
+    // Let the slow path report what is missing
+    b->state = SYM_BIND_SLOW;
+    b->lib_ndx = 0;
+}
+
+// Try to bind a (non TLS) symbol by the index it has in our own symbol table. Only the first relocation against a
+// symbol searches by name, the rest go straight to the export it was bound to.
+// Returns the library the batched exchange should start from, or n_libs if the symbol has been bound.
+static size_t bind_from_exports(link_session_t* session, size_t sym_ndx, const unsigned char* name,
+                                size_t offset, int functions, size_t own_ndx) {
+    sym_binding_t uncached = {.state = SYM_BIND_UNKNOWN, .lib_ndx = 0, .ndx = 0};
+    sym_binding_t* b = (sym_bindings != NULL) ? &sym_bindings[(sym_ndx * 2) + functions] : &uncached;
+
+    if(b->state == SYM_BIND_UNKNOWN) resolve_binding(session, name, functions, own_ndx, b);
+
+    capability cap;
+
+    switch(b->state) {
+        case SYM_BIND_OWN:
+            cap = symbol_to_capability(&own_pd, &own_pd.symtab[b->ndx]);
+            break;
+        case SYM_BIND_EXPORT:
+            cap = session->partners[b->lib_ndx].info->exports[b->ndx].cap;
+            break;
+        default:
+            return b->lib_ndx;
+    }
+
+    link_symbol(offset, cap, functions, b->lib_ndx, own_ndx);
+    return session->n_libs;
+}
+
 static void batch_symbols_threshold(link_session_t* session, parsed_dynamic_t* parsed, capability* data_args,
         const unsigned char** in_blocks, capability* out_blocks,
         size_t* offsets, size_t* block_fills, int functions, size_t own_ndx, size_t threshold) {
@@ -611,16 +786,34 @@ static void handle_relocations(link_session_t* session, parsed_dynamic_t* parsed
         if(is_tls == global) continue;
 
         size_t block_ndx;
+        size_t lib_ndx;
+        const unsigned char* name;
+        size_t offset;
 
         switch(ELF64_R_TYPE(rel->r_info)) {
             case R_MIPS_CHERI_CAPABILITY:
             case R_MIPS_CHERI_CAPABILITY_CALL:
-                block_ndx = block_fills[0]++;
-                in_blocks[block_ndx] = set_str_to_len(&parsed->strtab[sym->st_name]);
-                offsets[block_ndx] = rel->r_offset | (is_tls ? 1ULL << 63 : 0);
-                if(block_fills[0] == SYMBOL_EXCHANGE_MAX)
-                    batch_symbols_threshold(session, parsed, data_args, in_blocks, out_blocks, offsets, block_fills,
-                                            functions, own_ndx, SYMBOL_EXCHANGE_MAX);
+                name = set_str_to_len(&parsed->strtab[sym->st_name]);
+                offset = rel->r_offset | (is_tls ? 1ULL << 63 : 0);
+
+                // TLS is different for every thread, so has to be asked for
+                lib_ndx = is_tls ? 0 : bind_from_exports(session, ELF64_R_SYM(rel->r_info), name, offset,
+                                                         functions, own_ndx);
+
+                if(lib_ndx == session->n_libs) break;
+
+                block_ndx = (lib_ndx * SYMBOL_EXCHANGE_MAX) + block_fills[lib_ndx]++;
+                in_blocks[block_ndx] = name;
+                offsets[block_ndx] = offset;
+                if(block_fills[lib_ndx] == SYMBOL_EXCHANGE_MAX) {
+                    if(lib_ndx == 0) {
+                        batch_symbols_threshold(session, parsed, data_args, in_blocks, out_blocks, offsets, block_fills,
+                                                functions, own_ndx, SYMBOL_EXCHANGE_MAX);
+                    } else {
+                        batch_symbols(session, parsed, data_args, in_blocks, out_blocks, offsets, block_fills,
+                                      functions, own_ndx, lib_ndx);
+                    }
+                }
                 break;
             default:
                 break;
@@ -660,6 +853,13 @@ static void process_own_relocations(link_session_t* session, parsed_dynamic_t* p
 
     set_up_plt_dummies(session, own_ndx, data_args);
 
+    // Only non TLS symbols are bound from exports, and they are only linked once per process
+    if(global && sym_bindings == NULL) {
+        size_t size = parsed->symtab_ents * 2 * sizeof(sym_binding_t);
+        sym_bindings = (sym_binding_t*)request_table(size);
+        if(sym_bindings != NULL) bzero(sym_bindings, size);
+    }
+
     if(parsed->rel) {
         handle_relocations(session, parsed, data_args, in_blocks, out_blocks, offsets, block_fills,
                            0, own_ndx, global, parsed->rel, parsed->rel+parsed->rel_ents);
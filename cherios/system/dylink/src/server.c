@@ -205,6 +205,9 @@ _Static_assert(MULTI_PROCESS_LINK == 0, "TODO");
 
     set_info_functions(&own_info);
 
+    // Only one process ever links with us, so the capabilities for everything but TLS can be worked out now
+    build_export_table(&own_info);
+
     if(was_secure_loaded) {
         own_info.new_library_thread = SEALED_CROSS_DOMAIN(new_library_thread);
     } else {
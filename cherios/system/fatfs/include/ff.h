@@ -28,8 +28,11 @@ typedef struct fs_proxy {
 	size_t length;
 	requester_t requester;
 	locked_t encrypt_lock;
+	char* into;			/* If set, data is read into here rather than proxied to a fulfiller */
 } fs_proxy;
 
+void set_encrypt_lock(fs_proxy* proxy, locked_t locked);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
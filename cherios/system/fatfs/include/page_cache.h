@@ -0,0 +1,69 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHERIOS_PAGE_CACHE_H
+#define CHERIOS_PAGE_CACHE_H
+
+#include "cheric.h"
+
+// Whole file pages kept by the fs so that clients can be handed read-only capabilities to file contents and send them
+// on without the fs (or FAT) being involved again. Entries are keyed by path, and any write, truncate, rename or unlink
+// of that path throws its pages away. Each mapping handed out comes with a lease that pins its page until the client
+// gives the lease back. A pinned page is not refilled, even if it has been thrown away.
+
+#define PC_PAGE_SIZE    0x1000
+#define PC_PAGES        0x40
+#define PC_FILES        0x20
+#define PC_PATH_MAX     100
+#define PC_LEASES       0x100
+
+// Pages are filled without a decryption key, so files that have ever been opened with one are never cached. FAT has
+// no attribute for this, so we borrow the system attribute, which nothing else here uses. It is kept on disk (so
+// survives the fs restarting) and moves with the file on rename. Creating the file again clears it.
+#define PC_ENCRYPTED_ATTR   AM_SYS
+
+void page_cache_init(void);
+
+uint64_t page_cache_key(const char* path);
+void page_cache_invalidate_key(uint64_t key);
+void page_cache_invalidate(const char* path);
+void page_cache_invalidate_all(void);
+
+void page_cache_mark_encrypted(const char* path);
+
+// Returns a read-only capability to the bytes of the page of path that contains offset, and the file's size via
+// file_size. If lease is NULL only the size is looked up and the result is NULL. Otherwise *lease is set to a sealed
+// token that keeps the page pinned until it is passed to page_cache_unmap.
+// NULL if the page is past the end of the file, or the file cannot be read (then file_size is untouched), or there is
+// no page or lease free because too many are pinned.
+capability page_cache_map(const char* path, uint64_t offset, uint64_t* file_size, capability* lease);
+void page_cache_unmap(capability lease);
+
+#endif //CHERIOS_PAGE_CACHE_H
@@ -3384,8 +3384,13 @@ static ssize_t flush_proxy(fs_proxy* proxy, fulfiller_t fulfill) {
 		res = socket_requester_space_wait(requester, 1, 0, 0);
 		assert_int_ex(-res, ==, 0);
 
-		// 3: Send proxy request
-		res = socket_request_proxy(requester, fulfill, length, 0);
+		// 3: Send proxy request, or fill the buffer we were given
+		if(proxy->into) {
+			res = socket_request_ind(requester, proxy->into, length, 0);
+			proxy->into += length;
+		} else {
+			res = socket_request_proxy(requester, fulfill, length, 0);
+		}
 		assert_int_ex(-res, ==, 0);
 
 		(*ss) += length;
@@ -39,6 +39,7 @@
 #include "stdlib.h"
 #include "atomic.h"
 #include "cheristd.h"
+#include "page_cache.h"
 
 FATFS fs;
 
@@ -48,6 +49,7 @@ struct sessions_t {
     unix_like_socket sock;
     FIL fil;
     locked_t encrypt_lock;
+    uint64_t cache_key;
     size_t next_ndx; // either next free, or next in list of open files
     uint64_t read_fptr;
     uint64_t write_fptr;
@@ -65,7 +67,7 @@ size_t n_files = 0;
 fs_proxy sr_read;
 fs_proxy sr_write;
 
-static void set_encrypt_lock(fs_proxy* proxy, locked_t locked) {
+void set_encrypt_lock(fs_proxy* proxy, locked_t locked) {
     if(proxy->encrypt_lock != locked) {
         int res = socket_requester_space_wait(proxy->requester, 1, 0, 0);
         assert_int_ex(res, ==, 0);
@@ -155,6 +157,7 @@ __used ssize_t full_oob(capability arg, request_t* request,  uint64_t offset, __
             return length;
         case REQUEST_TRUNCATE:
             f_truncate(&fil->fil);
+            page_cache_invalidate_key(fil->cache_key);
             return length;
         case REQUEST_CLOSE:
             close_file_internal(NULL, fil, 1);
@@ -233,6 +236,7 @@ int proxy_file_to_cache(struct sessions_t* session, uint8_t service_write) {
             // FIXME: we are ignoring fresult here!
             (void)fresult;
             assert(bytes_handled == res);
+            if(service_write) page_cache_invalidate_key(session->cache_key);
             *fptr +=res;
             any_proxy = 1;
         }
@@ -288,6 +292,8 @@ static void init_block_cache_requesters(void) {
 
     sr_read.offset = sr_write.offset = sr_read.length = sr_write.length = 0;
 
+    sr_read.into = sr_write.into = NULL;
+
     sr_read.requester = read;
     sr_write.requester = write;
 }
@@ -344,6 +350,9 @@ int open_file_internal(requester_t read_requester, requester_t write_requester,
         if((fres = f_open(fp, file_name, (BYTE)mode)) == 0) {
             session->read_fptr = session->write_fptr = 0;
             session->encrypt_lock = encrpyt;
+            session->cache_key = page_cache_key(file_name);
+            if(encrpyt) page_cache_mark_encrypted(file_name);
+            else if(write) page_cache_invalidate_key(session->cache_key);
             session->in_use = 1;
             session->nice_close = 0;
             size_t next = session->next_ndx;
@@ -390,7 +399,46 @@ static FRESULT close_dir(capability sealed_dir) {
     return res;
 }
 
-void (*msg_methods[]) = {open_file_internal, make_dir, f_rename, f_unlink, f_stat, open_dir, read_dir, close_dir};
+static FRESULT rename_file(const char* old, const char* new) {
+    FILINFO info;
+    // Renaming a directory renames everything under it. That is rare, so rather than match every spelling of
+    // paths below it just start again.
+    if(f_stat(old, &info) == FR_OK && (info.fattrib & AM_DIR)) {
+        page_cache_invalidate_all();
+    } else {
+        page_cache_invalidate(old);
+        page_cache_invalidate(new);
+    }
+    return f_rename(old, new);
+}
+
+static FRESULT unlink_file(const char* name) {
+    page_cache_invalidate(name);
+    return f_unlink(name);
+}
+
+static int open_for_write(uint64_t key) {
+    for(size_t i = first_file; i != MAX_HANDLES; i = sessions[i].next_ndx) {
+        struct sessions_t* session = &sessions[i];
+        if(session->cache_key == key && session->nice_close == 0 && (session->fil.flag & FA_WRITE)) return 1;
+    }
+    return 0;
+}
+
+static capability map_page(const char* name, uint64_t offset, uint64_t* file_size, capability* lease) {
+    // Size and contents are not settled until a writer closes, so go through the file socket until then
+    if(open_for_write(page_cache_key(name))) return NULL;
+    // The lease token is a global capability, so we need to be able to store one where we are asked to
+    if(lease != NULL && (!cheri_gettag(lease) || !(cheri_getperm(lease) & CHERI_PERM_STORE_CAP))) return NULL;
+    return page_cache_map(name, offset, file_size, lease);
+}
+
+static void unmap_page(capability lease) {
+    page_cache_unmap(lease);
+}
+
+void (*msg_methods[]) = {open_file_internal, make_dir, rename_file, unlink_file, f_stat, open_dir, read_dir, close_dir,
+                         map_page, unmap_page};
 size_t msg_methods_nb = countof(msg_methods);
 void (*ctrl_methods[]) = {NULL};
 size_t ctrl_methods_nb = countof(ctrl_methods);
@@ -491,6 +539,8 @@ int main(capability fs_cap) {
 
     assert(dir_sealer != NULL);
 
+    page_cache_init();
+
     printf("Fatfs: Going into daemon mode\n");
 
     request_loop();
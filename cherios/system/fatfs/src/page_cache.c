@@ -0,0 +1,291 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "page_cache.h"
+#include "ff.h"
+#include "string.h"
+#include "stdlib.h"
+#include "assert.h"
+#include "thread.h"
+
+/* Lookups are linear scans. The tables are small and a scan is still far cheaper than the FAT walk and block cache
+ * round trip a miss costs. Pages are replaced by clock, files round robin, and pinned pages are skipped.
+ * Clients queue mapped pages on sockets that are read after map returns, so a page must not be refilled until the
+ * client says its consumers are done with it. Once unpinned, page memory is recycled without revoking capabilities
+ * that were handed out to it, so an old capability may see another file's contents. That is no more than the holder
+ * could get by opening the file, this fs has no per file access control.
+ * Pins are counted per page but taken and released through per mapping leases, so a client can only give back pins
+ * it was given. A lease token is a sealed capability to a malloc'd object. Tokens are only honoured while their object
+ * is in the leases table. Freed memory is not reused until capabilities to it have been revoked, so the token of a
+ * released lease can never match a later one. */
+
+struct pc_file {
+    uint64_t key;
+    uint64_t size;
+    char path[PC_PATH_MAX];
+    uint8_t in_use;
+};
+
+struct pc_page {
+    uint64_t page_n;
+    size_t length;
+    uint8_t file;
+    uint32_t pins;
+    uint8_t valid;
+    uint8_t referenced;
+};
+
+_Static_assert(PC_FILES <= UINT8_MAX, "File index must fit in a page");
+
+extern fs_proxy sr_read;
+extern fs_proxy sr_write;
+
+static struct pc_file files[PC_FILES];
+static struct pc_page pages[PC_PAGES];
+static char page_data[PC_PAGES][PC_PAGE_SIZE] __attribute__((aligned(PC_PAGE_SIZE)));
+
+static size_t page_hand;
+static size_t file_hand;
+
+struct pc_lease {
+    size_t page;
+};
+
+static struct pc_lease* leases[PC_LEASES];
+static capability lease_sealer;
+
+void page_cache_init(void) {
+    lease_sealer = get_type_owned_by_process();
+    assert(lease_sealer != NULL);
+}
+
+// FAT names are case insensitive, so keys are too
+static char fold(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static int same_path(const char* a, const char* b) {
+    while(*a && fold(*a) == fold(*b)) {
+        a++;
+        b++;
+    }
+    return *a == '\0' && *b == '\0';
+}
+
+uint64_t page_cache_key(const char* path) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(; *path; path++) {
+        hash = (hash ^ (uint8_t)fold(*path)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void drop_file(size_t ndx) {
+    for(size_t i = 0; i != PC_PAGES; i++) {
+        if(pages[i].valid && pages[i].file == ndx) pages[i].valid = 0;
+    }
+    files[ndx].in_use = 0;
+}
+
+void page_cache_invalidate_key(uint64_t key) {
+    for(size_t i = 0; i != PC_FILES; i++) {
+        if(files[i].in_use && files[i].key == key) drop_file(i);
+    }
+}
+
+void page_cache_invalidate(const char* path) {
+    page_cache_invalidate_key(page_cache_key(path));
+}
+
+// Dropped files are only forgotten, pinned pages keep their contents until their leases are given back
+void page_cache_invalidate_all(void) {
+    for(size_t i = 0; i != PC_FILES; i++) {
+        if(files[i].in_use) drop_file(i);
+    }
+}
+
+void page_cache_mark_encrypted(const char* path) {
+    page_cache_invalidate(path);
+    __unused FRESULT res = f_chmod(path, PC_ENCRYPTED_ATTR, PC_ENCRYPTED_ATTR);
+}
+
+static size_t find_file(const char* path, uint64_t key) {
+    for(size_t i = 0; i != PC_FILES; i++) {
+        if(files[i].in_use && files[i].key == key && same_path(files[i].path, path)) return i;
+    }
+    return PC_FILES;
+}
+
+static size_t add_file(const char* path, size_t path_len, uint64_t key, uint64_t size) {
+    size_t ndx;
+
+    for(ndx = 0; ndx != PC_FILES && files[ndx].in_use; ndx++);
+
+    if(ndx == PC_FILES) {
+        ndx = file_hand;
+        file_hand = (file_hand + 1) % PC_FILES;
+        drop_file(ndx);
+    }
+
+    struct pc_file* file = &files[ndx];
+    file->key = key;
+    file->size = size;
+    memcpy(file->path, path, path_len + 1);
+    file->in_use = 1;
+
+    return ndx;
+}
+
+static size_t find_page(size_t file, uint64_t page_n) {
+    for(size_t i = 0; i != PC_PAGES; i++) {
+        if(pages[i].valid && pages[i].file == file && pages[i].page_n == page_n) return i;
+    }
+    return PC_PAGES;
+}
+
+// PC_PAGES if every page is pinned. Two turns of the clock will find any page that is not.
+static size_t victim_page(void) {
+    for(size_t tries = 0; tries != 2 * PC_PAGES; tries++) {
+        size_t ndx = page_hand;
+        struct pc_page* page = &pages[ndx];
+        page_hand = (page_hand + 1) % PC_PAGES;
+        if(page->pins != 0) continue;
+        if(!page->valid || !page->referenced) return ndx;
+        page->referenced = 0;
+    }
+    return PC_PAGES;
+}
+
+static int fill_page(const char* path, uint64_t offset, char* buf, size_t length) {
+    FIL fil;
+    UINT br = 0;
+    FRESULT res;
+
+    if(f_open(&fil, path, FA_READ) != FR_OK) return -1;
+
+    // Writes to the block cache go on a different socket to reads, make sure none are still on their way
+    if(socket_requester_wait_all_finish(sr_write.requester, 0) < 0) res = FR_DISK_ERR;
+    else res = f_lseek(&fil, offset);
+
+    if(res == FR_OK) {
+        // Files that have been encrypted are never cached, see PC_ENCRYPTED_ATTR
+        set_encrypt_lock(&sr_read, NULL);
+        sr_read.into = buf;
+        res = f_read(&fil, NULL, (UINT)length, &br);
+        sr_read.into = NULL;
+        if(socket_requester_wait_all_finish(sr_read.requester, 0) < 0) res = FR_DISK_ERR;
+    }
+
+    f_close(&fil);
+
+    return (res == FR_OK && br == length) ? 0 : -1;
+}
+
+static capability take_lease(size_t ndx) {
+    for(size_t i = 0; i != PC_LEASES; i++) {
+        if(leases[i] == NULL) {
+            struct pc_lease* lease = (struct pc_lease*)malloc(sizeof(struct pc_lease));
+            if(lease == NULL) return NULL;
+            lease->page = ndx;
+            leases[i] = lease;
+            pages[ndx].pins++;
+            return cheri_seal(lease, lease_sealer);
+        }
+    }
+    return NULL;
+}
+
+capability page_cache_map(const char* path, uint64_t offset, uint64_t* file_size, capability* lease) {
+    uint64_t key = page_cache_key(path);
+    size_t file = find_file(path, key);
+
+    if(file == PC_FILES) {
+        size_t path_len = strlen(path);
+        if(path_len >= PC_PATH_MAX) return NULL;
+
+        FILINFO info;
+        if(f_stat(path, &info) != FR_OK || (info.fattrib & (AM_DIR | PC_ENCRYPTED_ATTR))) return NULL;
+
+        file = add_file(path, path_len, key, info.fsize);
+    }
+
+    struct pc_file* f = &files[file];
+    *file_size = f->size;
+
+    if(lease == NULL || offset >= f->size) return NULL;
+
+    uint64_t page_n = offset / PC_PAGE_SIZE;
+    size_t ndx = find_page(file, page_n);
+    struct pc_page* page;
+
+    if(ndx == PC_PAGES) {
+        ndx = victim_page();
+        if(ndx == PC_PAGES) return NULL;
+        page = &pages[ndx];
+        page->valid = 0;
+
+        uint64_t start = page_n * PC_PAGE_SIZE;
+        size_t length = (f->size - start) < PC_PAGE_SIZE ? (size_t)(f->size - start) : PC_PAGE_SIZE;
+
+        if(fill_page(path, start, page_data[ndx], length) < 0) return NULL;
+
+        page->page_n = page_n;
+        page->length = length;
+        page->file = (uint8_t)file;
+        page->valid = 1;
+    } else {
+        page = &pages[ndx];
+    }
+
+    capability token = take_lease(ndx);
+    if(token == NULL) return NULL;
+
+    *lease = token;
+    page->referenced = 1;
+
+    size_t in_page = offset % PC_PAGE_SIZE;
+
+    return READ_ONLY(cheri_setbounds(page_data[ndx] + in_page, page->length - in_page));
+}
+
+void page_cache_unmap(capability token) {
+    struct pc_lease* lease = (struct pc_lease*)cheri_unseal_2(token, lease_sealer);
+    if(lease == NULL) return;
+
+    // Compare before touching it, a lease that has already been given back has been freed
+    for(size_t i = 0; i != PC_LEASES; i++) {
+        if(leases[i] == lease) {
+            pages[lease->page].pins--;
+            leases[i] = NULL;
+            free(lease);
+            return;
+        }
+    }
+}
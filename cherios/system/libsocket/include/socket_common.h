@@ -79,6 +79,12 @@ typedef int vprintf_t(const char *fmt, va_list ap);
     ITEM(socket_drb_space_alloc, ssize_t, (data_ring_buffer* data_buffer, uint64_t align, uint64_t size, int dont_wait, char** c1, char**c2, size_t* part1_out, requester_t r),__VA_ARGS__)\
 /*Requests length bytes as an ind request, but uses a data buffer instead of the provided buf. For a write this does what you expect, copying the source buffer. For a read this will only use your buffer as an alignment hint*/\
     ITEM(socket_request_ind_db, ssize_t, (requester_t r, const char* buf, uint32_t size, data_ring_buffer* data_buffer, int dont_wait, register_t perms),__VA_ARGS__)\
+/* Requests each buffer in iov as an ind request, but only moves the request pointer (and wakes the fulfiller) once. Call space_wait for iovcnt first*/\
+    ITEM(socket_request_ind_vec, ssize_t, (requester_t r, const socket_iovec* iov, uint16_t iovcnt, uint32_t drb_off),__VA_ARGS__)\
+/* As ind_vec, but each buffer is preceded by an oob_type oob carrying oob_vals[i], for message based protocols. Needs up to 2*count space. If drb_count each oob bumps the drb by 1 and each buffer by its length when fulfilled*/\
+    ITEM(socket_request_oob_ind_vec, ssize_t, (requester_t r, request_type_e oob_type, const intptr_t* oob_vals, const socket_iovec* iov, uint16_t count, int drb_count),__VA_ARGS__)\
+/* As ind_db, but gathers all the buffers in iov into a single data buffer allocation*/\
+    ITEM(socket_request_ind_db_vec, ssize_t, (requester_t r, const socket_iovec* iov, uint16_t iovcnt, data_ring_buffer* data_buffer, int dont_wait, register_t perms),__VA_ARGS__)\
 /**/\
     ITEM(socket_request_oob, ssize_t, (requester_t r, request_type_e r_type, intptr_t oob_val, uint64_t length, uint32_t drb_off),__VA_ARGS__)\
 /**/\
@@ -115,6 +121,10 @@ typedef int vprintf_t(const char *fmt, va_list ap);
     ITEM(copy_in, ssize_t, (capability user_buf, char* req_buf, uint64_t offset, uint64_t length), __VA_ARGS__)\
     ITEM(copy_out, ssize_t, (capability user_buf, char* req_buf, uint64_t offset, uint64_t length) , __VA_ARGS__)\
     ITEM(copy_out_no_caps, ssize_t, (capability user_buf, char* req_buf, uint64_t offset, uint64_t length), __VA_ARGS__)\
+/* As above, but user_buf is a (bounded) array of socket_iovec and offset is into their concatenation */\
+    ITEM(copy_in_vec, ssize_t, (capability user_buf, char* req_buf, uint64_t offset, uint64_t length), __VA_ARGS__)\
+    ITEM(copy_out_vec, ssize_t, (capability user_buf, char* req_buf, uint64_t offset, uint64_t length) , __VA_ARGS__)\
+    ITEM(copy_out_vec_no_caps, ssize_t, (capability user_buf, char* req_buf, uint64_t offset, uint64_t length), __VA_ARGS__)\
     ITEM(socket_fulfill_with_fulfill, ssize_t, (capability arg, char* buf, uint64_t offset, uint64_t length), __VA_ARGS__)\
     ITEM(socket_fulfill_progress_bytes_soft_join, ssize_t, (fulfiller_t push_read, fulfiller_t pull_write, size_t bytes, enum FULFILL_FLAGS flags), __VA_ARGS__)\
     ITEM(socket_requester_restrict_auth, int, (requester_t r, found_id_t* data_auth, found_id_t* oob_auth), __VA_ARGS__)\
@@ -181,9 +191,12 @@ enum SOCKET_FLAGS {
     SOCKF_SOCK_INLINE       = 0x400,
 // Changes how poll behaves
     SOCKF_POLL_READ_MEANS_EMPTY = 0x800,
+// Character writes (fputc) that find the copy buffer full drop the character rather than wait. Counted in 'dropped'.
+    SOCKF_DROP_IF_FULL      = 0x1000,
 };
 
 // Global enable/disable for socket tracing. Always uses syscall_printf for safety.
+// Fulfills are also recorded as binary events in the trace rings (see trace.h), which stay on under GO_FAST.
 
 #if (GO_FAST)
     #define SOCK_TRACING        0
@@ -265,6 +278,15 @@ typedef struct request {
 
 _Static_assert(sizeof(request_t) ==  2*sizeof(capability), "Make sure each request type is small enough");
 
+// One part of a vectored (readv / writev style) request
+typedef struct socket_iovec {
+    char* base;
+    uint64_t length;
+} socket_iovec;
+
+// Most buffers a single vectored call will accept
+#define SOCKET_IOV_MAX              16
+
 enum poll_events {
     POLL_NONE = 0,
     POLL_IN = 1,
@@ -38,6 +38,7 @@
 #include "atomic.h"
 #include "misc.h"
 #include "condition.h"
+#include "trace.h"
 
 __thread vprintf_t* vprintf_ptr;
 __thread capability vprintf_data;
@@ -262,6 +263,99 @@ ssize_t socket_request_ind(requester_t r, char* buf, uint64_t length, uint32_t d
     return socket_internal_request_ind(requester, buf, length, drb_off);
 }
 
+// Requests every buffer in iov. The request pointer is only moved once so the fulfiller gets a single wakeup.
+// drb_off is attached to the last request, which will be the last fulfilled.
+static ssize_t socket_internal_request_ind_vec(uni_dir_socket_requester* requester, const socket_iovec* iov, uint16_t iovcnt, uint32_t drb_off) {
+
+    if(iovcnt == 0) return 0;
+
+    if(iovcnt > requester->buffer_size) return E_MSG_SIZE;
+
+    if(iovcnt > space(requester)) return E_AGAIN;
+
+    uint16_t request_ptr = requester->requeste_ptr;
+    uint16_t mask = requester->buffer_size-1;
+    uint64_t total = 0;
+
+    for(uint16_t i = 0; i != iovcnt; i++) {
+        request_t* req = &requester->request_ring_buffer[(uint16_t)(request_ptr + i) & mask];
+
+        req->type = REQUEST_IND;
+        req->length = iov[i].length;
+        req->request.ind = iov[i].base;
+        req->drb_fullfill_inc = (i == iovcnt-1) ? drb_off : 0;
+        total += iov[i].length;
+    }
+
+    requester->requested_bytes += total;
+    return condition_set_and_notify(&requester->requeste_ptr,
+                                          request_ptr+iovcnt,
+                                          &requester->fulfiller_component.fulfiller_waiting);
+}
+
+__attribute__((used))
+ssize_t socket_request_ind_vec(requester_t r, const socket_iovec* iov, uint16_t iovcnt, uint32_t drb_off) {
+    uni_dir_socket_requester* requester = UNSEAL_CHECK_REQUESTER(r);
+    if(!requester) return E_BAD_SEAL;
+
+    return socket_internal_request_ind_vec(requester, iov, iovcnt, drb_off);
+}
+
+// Requests every buffer in iov, each preceded by an oob carrying the matching oob_val, for protocols that need to mark
+// where a message starts. Empty buffers only get their oob. The request pointer is only moved once.
+static ssize_t socket_internal_request_oob_ind_vec(uni_dir_socket_requester* requester, request_type_e oob_type,
+                                                   const intptr_t* oob_vals, const socket_iovec* iov, uint16_t count,
+                                                   int drb_count) {
+    if(count == 0) return 0;
+
+    uint16_t n_requests = count;
+    for(uint16_t i = 0; i != count; i++) {
+        if(iov[i].length != 0) n_requests++;
+    }
+
+    if(n_requests > requester->buffer_size) return E_MSG_SIZE;
+
+    if(n_requests > space(requester)) return E_AGAIN;
+
+    uint16_t request_ptr = requester->requeste_ptr;
+    uint16_t mask = requester->buffer_size-1;
+    uint16_t n = 0;
+    uint64_t total = 0;
+
+    for(uint16_t i = 0; i != count; i++) {
+        request_t* req = &requester->request_ring_buffer[(uint16_t)(request_ptr + n++) & mask];
+
+        req->type = oob_type;
+        req->length = 0;
+        req->request.oob = oob_vals[i];
+        req->drb_fullfill_inc = drb_count ? 1 : 0;
+
+        if(iov[i].length != 0) {
+            req = &requester->request_ring_buffer[(uint16_t)(request_ptr + n++) & mask];
+
+            req->type = REQUEST_IND;
+            req->length = iov[i].length;
+            req->request.ind = iov[i].base;
+            req->drb_fullfill_inc = drb_count ? (uint32_t)iov[i].length : 0;
+            total += iov[i].length;
+        }
+    }
+
+    requester->requested_bytes += total;
+    return condition_set_and_notify(&requester->requeste_ptr,
+                                          request_ptr+n_requests,
+                                          &requester->fulfiller_component.fulfiller_waiting);
+}
+
+__attribute__((used))
+ssize_t socket_request_oob_ind_vec(requester_t r, request_type_e oob_type, const intptr_t* oob_vals,
+                                   const socket_iovec* iov, uint16_t count, int drb_count) {
+    uni_dir_socket_requester* requester = UNSEAL_CHECK_REQUESTER(r);
+    if(!requester) return E_BAD_SEAL;
+
+    return socket_internal_request_oob_ind_vec(requester, oob_type, oob_vals, iov, count, drb_count);
+}
+
 static int socket_internal_fulfill_proxy_outstanding_wait(uni_dir_socket_fulfiller* fulfiller, uint16_t amount, act_notify_kt proxy_token) {
 
     uni_dir_socket_requester_fulfiller_component* access = fulfiller->requester->access;
@@ -546,6 +640,81 @@ ssize_t socket_request_ind_db(requester_t r, const char* buf, uint32_t size,
     return size;
 }
 
+// Copies the concatenation of iov into the (possibly wrapped) space c1/c2 as returned by drb_space_alloc
+static void socket_internal_gather(char* c1, size_t part_1, char* c2, const socket_iovec* iov, uint16_t iovcnt) {
+    char* dst = c1;
+    size_t dst_space = part_1;
+
+    for(uint16_t i = 0; i != iovcnt; i++) {
+        const char* src = iov[i].base;
+        size_t len = iov[i].length;
+
+        while(len != 0) {
+            if(dst_space == 0) {
+                dst = c2;
+                dst_space = cheri_getlen(c2);
+            }
+            size_t now = (len < dst_space) ? len : dst_space;
+            memcpy(dst, src, now);
+            dst += now;
+            src += now;
+            len -= now;
+            dst_space -= now;
+        }
+    }
+}
+
+__attribute__((used))
+ssize_t socket_request_ind_db_vec(requester_t r, const socket_iovec* iov, uint16_t iovcnt,
+                                           data_ring_buffer* data_buffer,
+                                           int dont_wait, register_t perms) {
+    ssize_t res;
+
+    uni_dir_socket_requester* requester = UNSEAL_CHECK_REQUESTER(r);
+
+    if(!requester) return E_BAD_SEAL;
+
+    if(!data_buffer->buffer) return E_NO_DATA_BUFFER;
+
+    uint64_t size = 0;
+    for(uint16_t i = 0; i != iovcnt; i++) size += iov[i].length;
+
+    if(size > data_buffer->buffer_size) return E_MSG_SIZE;
+
+    if(size == 0) return 0;
+
+    char* cap1;
+    char* cap2;
+    size_t part_1;
+    assert(data_buffer->partial_length == 0);
+
+    // Everything is packed after the first buffer, so only it gets to decide alignment
+    res = socket_internal_drb_space_alloc(data_buffer, (uint64_t)iov[0].base, size, dont_wait, &cap1, &cap2, &part_1, requester);
+
+    if(res < 0) return res;
+
+    uint64_t align_off = res;
+
+    if(requester->socket_type == SOCK_TYPE_PUSH) {
+        socket_internal_gather(cap1, part_1, cap2, iov, iovcnt);
+    }
+
+    // At most two requests however many buffers we were given
+    _safe socket_iovec parts[2];
+    parts[0].base = cheri_andperm(cap1, perms);
+    parts[0].length = part_1;
+
+    if(cap2) {
+        parts[1].base = cheri_andperm(cap2, perms);
+        parts[1].length = size - part_1;
+    }
+
+    res = socket_internal_request_ind_vec(requester, parts, cap2 ? 2 : 1, size + align_off);
+    if(res < 0) return res;
+
+    return size;
+}
+
 __attribute__((used))
 ssize_t socket_request_oob(requester_t r, request_type_e r_type, intptr_t oob_val, uint64_t length, uint32_t drb_off) {
     uni_dir_socket_requester* requester = UNSEAL_CHECK_REQUESTER(r);
@@ -637,6 +806,7 @@ static ssize_t socket_internal_fulfill_progress_bytes_impl(uni_dir_socket_fulfil
     uni_dir_socket_requester* requester = fulfiller->requester;
 
     if(SOCK_TRACING && (flags & F_TRACE)) printf("Sock fulfill %lx bytes. flags %x\n", bytes, flags);
+    TRACE_EVENT(TRACE_SOCK_FULFILL, TRACE_PTR(fulfiller), bytes, flags);
 
     if((flags & F_PROGRESS) && (flags & (F_START_FROM_LAST_MARK))) {
         if(SOCK_TRACING && (flags & F_TRACE)) printf("Sock fulfill bad flags\n");
@@ -949,6 +1119,7 @@ static ssize_t socket_internal_fulfill_progress_bytes_impl(uni_dir_socket_fulfil
     ssize_t actually_fulfill = bytes - bytes_remain;
 
     if(SOCK_TRACING && (flags & F_TRACE)) printf("Sock fulfill finish. %lx bytes fulfilled\n", actually_fulfill);
+    TRACE_EVENT(TRACE_SOCK_FULFILLED, TRACE_PTR(fulfiller), actually_fulfill, flags);
     return (actually_fulfill == 0) ? ret : actually_fulfill;
 }
 
@@ -1355,6 +1526,44 @@ ssize_t copy_out_no_caps(capability user_buf, char* req_buf, uint64_t offset, ui
     return (ssize_t)length;
 }
 
+static ssize_t socket_internal_copy_vec(const socket_iovec* iov, char* req_buf, uint64_t offset, uint64_t length, int out) {
+    // Skip to the buffer offset starts in
+    while(offset >= iov->length) {
+        offset -= iov->length;
+        iov++;
+    }
+
+    uint64_t done = 0;
+
+    while(done != length) {
+        uint64_t now = iov->length - offset;
+        if(now > length - done) now = length - done;
+        if(out) memcpy(iov->base + offset, req_buf + done, now);
+        else memcpy(req_buf + done, iov->base + offset, now);
+        done += now;
+        offset = 0;
+        iov++;
+    }
+
+    return (ssize_t)length;
+}
+
+__attribute__((used))
+ssize_t copy_in_vec(capability user_buf, char* req_buf, uint64_t offset, uint64_t length) {
+    return socket_internal_copy_vec((const socket_iovec*)user_buf, req_buf, offset, length, 0);
+}
+
+__attribute__((used))
+ssize_t copy_out_vec(capability user_buf, char* req_buf, uint64_t offset, uint64_t length) {
+    return socket_internal_copy_vec((const socket_iovec*)user_buf, req_buf, offset, length, 1);
+}
+
+__attribute__((used))
+ssize_t copy_out_vec_no_caps(capability user_buf, char* req_buf, uint64_t offset, uint64_t length) {
+    req_buf = (char*)cheri_andperm(req_buf, CHERI_PERM_LOAD);
+    return socket_internal_copy_vec((const socket_iovec*)user_buf, req_buf, offset, length, 1);
+}
+
 struct fwf_args {
     uni_dir_socket_fulfiller* writer;
     int dont_wait;
@@ -80,6 +80,11 @@ typedef struct net_session {
     uint8_t mac[6];
     uint8_t irq;
 
+    // Set before calling lwip_driver_handle_interrupt. The driver hands up at most rx_budget packets (0 for no limit)
+    // and leaves how many it did hand up in rx_done.
+    uint32_t rx_budget;
+    uint32_t rx_done;
+
 #ifdef HARDWARE_qemu
 
     // Net headers for send and recieve (SEND_HDR_START for recv, second lot for send)
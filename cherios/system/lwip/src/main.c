@@ -40,10 +40,12 @@
 #include "namespace.h"
 #include "net.h"
 #include "lwip/dns.h"
+#include "lwip/udp.h"
 #include "lwip_driver.h"
 #include "thread.h"
 #include "deduplicate.h"
 #include "lwip/inet_chksum.h"
+#include "nonce.h"
 
 enum session_close_state {
     SCS_NONE = 0,
@@ -79,18 +81,39 @@ typedef struct tcp_session {
 
     enum session_close_state close_state;
 
+    struct tcp_session* active_next;
+    int active; // On the active list, or the part of it the main loop is currently working through
+
+    struct tcp_acceptor* unaccepted_by; // Handed to this acceptor without a buffered requester, not yet connected
+
     int session_id;
 } tcp_session;
 
-typedef struct tcp_listen_session {
-    struct tcp_pcb* tcp_pcb;
+// One per call to listen or join. Several may share a port if the first asked for NETSOCK_LISTEN_REUSEPORT.
+typedef struct tcp_acceptor {
     act_kt callback;
     capability callback_arg;
     register_t callback_port;
     buffered_requesters_t* req_buffer;
+    uint8_t backlog;
+    size_t unaccepted;                  // Sessions handed out without a buffered requester that are not yet connected
+    struct tcp_listen_session* group;
+    struct tcp_acceptor* next;
+} tcp_acceptor;
+
+// One per listening pcb. New connections are handed out to its acceptors.
+typedef struct tcp_listen_session {
+    struct tcp_pcb* tcp_pcb;
+    struct tcp_bind bind;
+    nonce_t group_nonce;        // Sealed, this is the token needed to join. NULL if the group cannot be joined.
+    size_t backlog;
+    tcp_acceptor* acceptors;
+    tcp_acceptor* rr_next;
+    struct tcp_listen_session* next;
 }tcp_listen_session;
 
 sealing_cap sealer;
+sealing_cap group_sealer;
 sealing_cap ether_sealer; // FIXME: Eventually owned by the ethernet driver. This is for proof of concept
 
 static void user_tcp_close_send(tcp_session* tcp);
@@ -99,8 +122,48 @@ static void user_tcp_close(tcp_session* tcp);
 
 tcp_session* tcp_head = NULL;
 size_t n_listens = 0;
+tcp_listen_session* listen_head = NULL;
 #define FOR_EACH_TCP(T) for(tcp_session* T = tcp_head; T != NULL; T = T->next)
 
+/* Sessions that might have something to do are kept on an active list, and a main loop pass only works through that.
+ * lwip callbacks put sessions on it. A session comes off once it has nothing outstanding and its fulfiller wakeup is
+ * armed. Wakeups do not say which socket they were for, so when one has fired every idle session is polled again
+ * (which also re-arms it). Whether one has fired comes from our notified_n in kstats, so device interrupts, messages
+ * and timeouts do not cause a sweep. A user that stops reading without closing its requester does not notify us, and
+ * is only noticed at the next sweep. */
+
+tcp_session* tcp_active = NULL;
+tcp_session* tcp_work = NULL;
+
+static const act_kstats_t* own_kstats;
+static uint64_t notified_seen;
+
+static int sockets_notified(void) {
+    uint64_t notified = own_kstats->notified_n;
+    if(notified == notified_seen) return 0;
+    notified_seen = notified;
+    return 1;
+}
+
+static void tcp_mark_active(tcp_session* tcp) {
+    if(tcp->active) return;
+    tcp->active = 1;
+    tcp->active_next = tcp_active;
+    tcp_active = tcp;
+}
+
+static void tcp_unlink_active(tcp_session* tcp) {
+    if(!tcp->active) return;
+    tcp_session** link = &tcp_active;
+    while(*link != NULL && *link != tcp) link = &(*link)->active_next;
+    if(*link == NULL) {
+        link = &tcp_work;
+        while(*link != tcp) link = &(*link)->active_next;
+    }
+    *link = tcp->active_next;
+    tcp->active = 0;
+}
+
 static tcp_session* alloc_tcp_session(void) {
 
     // Allocate and add to chain
@@ -116,15 +179,32 @@ static tcp_session* alloc_tcp_session(void) {
 
     static int id = 0;
     new->session_id = id++;
+
+    new->active = 0;
+    tcp_mark_active(new);
+
+    new->unaccepted_by = NULL;
+
     return new;
 }
 
+static void tcp_session_accepted(tcp_session* tcp) {
+    if(tcp->unaccepted_by) {
+        tcp->unaccepted_by->unaccepted--;
+        tcp->unaccepted_by = NULL;
+    }
+}
+
 void free_tcp_session(tcp_session* tcp_session) {
 
+    tcp_session_accepted(tcp_session);
+
     if(tcp_session->prev) tcp_session->prev->next = tcp_session->next;
     else tcp_head = tcp_session->next; // If we have no previous we are the head
     if(tcp_session->next) tcp_session->next->prev = tcp_session->prev;
 
+    tcp_unlink_active(tcp_session);
+
     free(tcp_session->tcp_input_pushee);
     free(tcp_session->tcp_output_pusher);
 
@@ -227,6 +307,9 @@ err_t tcp_sent_callback (void *arg, __unused struct tcp_pcb *tpcb,
 
     tcp_session* tcp = (tcp_session*)arg;
 
+    // Space in the send buffer may mean we can take more from the application
+    tcp_mark_active(tcp);
+
     // This is how many bytes have been been sent this. NOT total.
 
     // Progress len bytes
@@ -253,6 +336,8 @@ err_t tcp_recv_callback(void * arg, __unused struct tcp_pcb * tpcb,
 
     tcp_session* tcp = (tcp_session*)arg;
 
+    tcp_mark_active(tcp);
+
     if(p == NULL) { // The other end has closed. So they are no longer receiving. Thus we close our fulfiller.
         user_tcp_close_send(tcp);
         tcp->close_state |= SCS_REMOTE_CLOSE;
@@ -446,6 +531,7 @@ static void tcp_er(void *arg, __unused err_t err) {
     // This session may have already been freed
     if(tcp != NULL) {
         // We don't free here. Instead we mark the pcb as already closed, and handle on the next main loop
+        tcp_mark_active(tcp);
         user_tcp_close_recv(tcp);
         user_tcp_close_send(tcp);
     }
@@ -484,6 +570,7 @@ static void user_tcp_connect_er(void *arg, err_t err) {
 
 static int tcp_connect_sockets(tcp_session* tcp, requester_t tcp_input_pusher) {
     tcp->events = POLL_IN;
+    tcp_mark_active(tcp);
     int res = socket_fulfiller_connect(tcp->tcp_input_pushee, tcp_input_pusher);
     if(res < 0) return res;
     if(tcp->close_state & SCS_FULFILL_CLOSED) {
@@ -494,6 +581,40 @@ static int tcp_connect_sockets(tcp_session* tcp, requester_t tcp_input_pusher) {
     return 0;
 }
 
+// Connections handed to an acceptor that it has not accepted yet. Those that took a buffered requester have been
+// popped by us but not yet marked consumed by the listener. The rest are counted until their sockets are connected.
+static size_t acceptor_waiting(tcp_acceptor* acceptor) {
+    size_t waiting = acceptor->unaccepted;
+    buffered_requesters_t* bf = acceptor->req_buffer;
+    if(bf) {
+        // The listener writes consumed, so do not trust it to be within the ring
+        size_t popped = (RINGBUF_INDEX_T(BRB))(RINGBUF_HD(BRB, bf) - bf->consumed);
+        waiting += (popped > acceptor->backlog) ? acceptor->backlog : popped;
+    }
+    return waiting;
+}
+
+// Round robin over the acceptors, but skip ahead to the one with the fewest connections waiting to be accepted
+static tcp_acceptor* pick_acceptor(tcp_listen_session* listen_session) {
+    tcp_acceptor* start = listen_session->rr_next ? listen_session->rr_next : listen_session->acceptors;
+    tcp_acceptor* best = start;
+    size_t best_waiting = acceptor_waiting(start);
+
+    for(tcp_acceptor* a = start->next ? start->next : listen_session->acceptors;
+        a != start && best_waiting != 0;
+        a = a->next ? a->next : listen_session->acceptors) {
+        size_t a_waiting = acceptor_waiting(a);
+        if(a_waiting < best_waiting) {
+            best = a;
+            best_waiting = a_waiting;
+        }
+    }
+
+    listen_session->rr_next = best->next;
+
+    return best;
+}
+
 static err_t tcp_accept_callback(void *arg, struct tcp_pcb *tpcb, err_t err) {
 
     if(arg == NULL) return err;
@@ -506,21 +627,26 @@ static err_t tcp_accept_callback(void *arg, struct tcp_pcb *tpcb, err_t err) {
 
     assert(tpcb != NULL);
 
+    tcp_acceptor* acceptor = pick_acceptor(listen_session);
+
     tcp_session* tcp = user_tcp_new(tpcb);
 
-    tcp->callback = listen_session->callback;
-    tcp->callback_arg = listen_session->callback_arg;
-    tcp->callback_port = listen_session->callback_port;
+    tcp->callback = acceptor->callback;
+    tcp->callback_arg = acceptor->callback_arg;
+    tcp->callback_port = acceptor->callback_port;
 
     tcp_err(tcp->tcp_pcb, tcp_er);
 
     int used_buffer = 0;
 
-    if(listen_session->req_buffer && RINGBUF_FILL(BRB, listen_session->req_buffer)) {
-        requester_t req = *RINGBUF_POP(BRB, listen_session->req_buffer);
+    if(acceptor->req_buffer && RINGBUF_FILL(BRB, acceptor->req_buffer)) {
+        requester_t req = *RINGBUF_POP(BRB, acceptor->req_buffer);
         used_buffer = 1;
         __unused int res = tcp_connect_sockets(tcp, socket_make_ref_for_fulfill(req));
         assert(res == 0);
+    } else {
+        tcp->unaccepted_by = acceptor;
+        acceptor->unaccepted++;
     }
 
     send_connect_callback(tcp, err, used_buffer);
@@ -533,6 +659,8 @@ static int user_tcp_connect_sockets(capability sealed_session,
 
     tcp_session* tcp = (tcp_session*)sealed_session; // TODO seal/unseal
 
+    tcp_session_accepted(tcp);
+
     return tcp_connect_sockets(tcp, tcp_input_pusher);
 }
 
@@ -550,41 +678,127 @@ static err_t user_tcp_connect(struct tcp_bind* bind, struct tcp_bind* server,
     return er;
 }
 
+static void set_group_backlog(tcp_listen_session* listen_session) {
+    // The pcb only has 8 bits of backlog, so a big group saturates
+    size_t backlog = listen_session->backlog > 0xFF ? 0xFF : listen_session->backlog;
+    tcp_backlog_set(listen_session->tcp_pcb, (uint8_t)backlog);
+}
+
+// Only a token handed out by a member of the group can be used to join it
+static tcp_listen_session* find_reuseport_group(capability group_token) {
+    nonce_t nonce = (nonce_t)cheri_unseal_2(group_token, group_sealer);
+    if(nonce == NULL) return NULL;
+    for(tcp_listen_session* ls = listen_head; ls != NULL; ls = ls->next) {
+        if(ls->group_nonce != NULL && nonces_equal(nonce, ls->group_nonce)) return ls;
+    }
+    return NULL;
+}
+
+static uintptr_t add_acceptor(tcp_listen_session* listen_session, buffered_requesters_t* bf,
+                              act_kt callback, capability callback_arg,
+                              uint8_t backlog, register_t callback_port) {
+    tcp_acceptor* acceptor = (tcp_acceptor*)malloc(sizeof(tcp_acceptor));
+
+    acceptor->callback = callback;
+    acceptor->callback_arg = callback_arg;
+    acceptor->callback_port = callback_port;
+    acceptor->req_buffer = bf;
+    acceptor->backlog = backlog;
+    acceptor->unaccepted = 0;
+    acceptor->group = listen_session;
+    acceptor->next = listen_session->acceptors;
+    listen_session->acceptors = acceptor;
+
+    listen_session->backlog += backlog;
+    set_group_backlog(listen_session);
+
+    n_listens++;
+
+    return (uintptr_t)cheri_seal(acceptor, sealer);
+}
+
 static uintptr_t user_tcp_listen(struct tcp_bind* bind, buffered_requesters_t* bf,
                             act_kt callback, capability callback_arg,
-                            uint8_t backlog, register_t callback_port) {
+                            uint8_t backlog, register_t callback_port, enum netsock_listen_flags flags) {
+
     tcp_listen_session* listen_session = (tcp_listen_session*)(malloc(sizeof(tcp_listen_session)));
 
-    listen_session->callback = callback;
-    listen_session->callback_arg = callback_arg;
-    listen_session->callback_port = callback_port;
-    listen_session->req_buffer = bf;
+    listen_session->bind = *bind;
+    listen_session->group_nonce = (flags & NETSOCK_LISTEN_REUSEPORT) ? alloc_nonce() : NULL;
+    listen_session->backlog = 0;
+    listen_session->acceptors = NULL;
+    listen_session->rr_next = NULL;
 
     listen_session->tcp_pcb = tcp_new();
     err_t er = tcp_bind(listen_session->tcp_pcb, &bind->addr, bind->port);
 
-    assert_int_ex(-er, ==, -ERR_OK);
+    if(er != ERR_OK) {
+        tcp_close(listen_session->tcp_pcb);
+        if(listen_session->group_nonce) free_nonce(listen_session->group_nonce);
+        free(listen_session);
+        return (uintptr_t)er;
+    }
 
     listen_session->tcp_pcb = tcp_listen_with_backlog(listen_session->tcp_pcb, backlog);
     tcp_arg(listen_session->tcp_pcb, listen_session);
     tcp_accept(listen_session->tcp_pcb, tcp_accept_callback);
 
-    if(er != ERR_OK) return (uintptr_t)er;
+    listen_session->next = listen_head;
+    listen_head = listen_session;
 
-    n_listens++;
+    return add_acceptor(listen_session, bf, callback, callback_arg, backlog, callback_port);
+}
+
+static uintptr_t user_tcp_join(capability group_token, buffered_requesters_t* bf,
+                               act_kt callback, capability callback_arg,
+                               uint8_t backlog, register_t callback_port) {
+    tcp_listen_session* listen_session = find_reuseport_group(group_token);
+
+    if(listen_session == NULL) return (uintptr_t)ERR_ARG;
+
+    return add_acceptor(listen_session, bf, callback, callback_arg, backlog, callback_port);
+}
 
-    return (uintptr_t)cheri_seal(listen_session, sealer);
+// Any member of a reuseport group can ask for the token, and hand it on to whoever it wants to share the port with
+static capability user_tcp_group_token(capability sealed) {
+    tcp_acceptor* acceptor = (tcp_acceptor*)cheri_unseal_2(sealed, sealer);
+    if(acceptor == NULL || acceptor->group->group_nonce == NULL) return NULL;
+    return cheri_seal(acceptor->group->group_nonce, group_sealer);
 }
 
 static void stop_listening(capability sealed) {
-    tcp_listen_session* listen_session = cheri_unseal(sealed, sealer);
+    tcp_acceptor* acceptor = cheri_unseal(sealed, sealer);
+    tcp_listen_session* listen_session = acceptor->group;
+
+    tcp_acceptor** link = &listen_session->acceptors;
+    while(*link != acceptor) link = &(*link)->next;
+    *link = acceptor->next;
+
+    if(listen_session->rr_next == acceptor) listen_session->rr_next = acceptor->next;
+
+    listen_session->backlog -= acceptor->backlog;
+
+    n_listens--;
+
+    FOR_EACH_TCP(tcp) if(tcp->unaccepted_by == acceptor) tcp->unaccepted_by = NULL;
+
+    free(acceptor);
+
+    if(listen_session->acceptors != NULL) {
+        // Others in the group keep the port open. Connections already handed to this acceptor are its own.
+        set_group_backlog(listen_session);
+        return;
+    }
 
     __unused err_t er = tcp_close(listen_session->tcp_pcb);
 
     assert(er == ERR_OK);
 
-    n_listens--;
+    tcp_listen_session** ls_link = &listen_head;
+    while(*ls_link != listen_session) ls_link = &(*ls_link)->next;
+    *ls_link = listen_session->next;
 
+    if(listen_session->group_nonce) free_nonce(listen_session->group_nonce);
     free(listen_session);
 
     return;
@@ -647,6 +861,249 @@ static void user_tcp_close(tcp_session* tcp) {
     return;
 }
 
+/* UDP sessions. Datagrams from the application are copied into pbufs as their data arrives and sent straight away.
+ * Received datagrams are held until the main loop hands everything that arrived in a pass up as one batch. Between
+ * them held and handed up datagrams are limited to what fits in the application's request ring, anything over is
+ * dropped. */
+
+typedef struct udp_session {
+    struct udp_pcb* udp_pcb;
+    struct udp_session* next, *prev;
+
+    fulfiller_t udp_input_pushee;
+    requester_t udp_output_pusher;
+
+    // Application -> UDP. The datagram being assembled.
+    struct pbuf* tx_pbuf;
+    ip_addr_t tx_addr;
+    uint16_t tx_port;
+    uint16_t tx_have;
+
+    // UDP -> Application
+    struct pbuf* rx_pending[UDP_BATCH_MAX];
+    intptr_t rx_tags[UDP_BATCH_MAX];
+    uint8_t n_pending;
+
+    struct pbuf* rx_inflight[UDP_BATCH_MAX];
+    uint8_t inflight_head;
+    uint8_t n_inflight;
+    uint64_t rx_consumed; // Bumped as the application fulfills, by 1 per datagram plus its length
+    uint64_t rx_freed;
+
+    uint64_t rx_dropped;
+    uint64_t tx_dropped;
+
+    int closing;
+} udp_session;
+
+udp_session* udp_head = NULL;
+size_t udp_rx_waiting = 0; // Datagrams held across all sessions
+#define FOR_EACH_UDP(U) for(udp_session* U = udp_head; U != NULL; U = U->next)
+
+// UDP ->(ack) Application
+static void udp_rx_ack(udp_session* udp) {
+    while(udp->n_inflight) {
+        struct pbuf* p = udp->rx_inflight[udp->inflight_head];
+        uint64_t cost = 1 + p->tot_len;
+        if(udp->rx_consumed - udp->rx_freed < cost) break;
+        udp->rx_freed += cost;
+        pbuf_free(p);
+        udp->inflight_head = (uint8_t)((udp->inflight_head + 1) % UDP_BATCH_MAX);
+        udp->n_inflight--;
+    }
+}
+
+// UDP -> Application
+static void udp_recv_callback(void *arg, __unused struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    udp_session* udp = (udp_session*)arg;
+
+    udp_rx_ack(udp);
+
+    if(p->next) p = pbuf_coalesce(p, PBUF_RAW);
+
+    if(udp->closing || p->next || (udp->n_pending + udp->n_inflight) == UDP_BATCH_MAX) {
+        udp->rx_dropped++;
+        pbuf_free(p);
+        return;
+    }
+
+    if((p->flags & PBUF_FLAG_IS_CUSTOM)) {
+        // These must not be re-used if they go to user space.
+        ((struct custom_for_tcp*)p)->reuse = 0;
+    }
+
+    udp->rx_pending[udp->n_pending] = p;
+    udp->rx_tags[udp->n_pending] = UDP_TAG(addr->addr, port, p->tot_len);
+    udp->n_pending++;
+    udp_rx_waiting++;
+}
+
+static void udp_rx_flush(udp_session* udp) {
+    uint8_t n = udp->n_pending;
+
+    if(n == 0) return;
+
+    if(socket_requester_space_wait(udp->udp_output_pusher, (uint16_t)(2 * n), 1, 0) < 0) return;
+
+    socket_iovec iov[UDP_BATCH_MAX];
+
+    for(uint8_t i = 0; i != n; i++) {
+        struct pbuf* p = udp->rx_pending[i];
+        iov[i].base = (char*)p->payload;
+        iov[i].length = p->len;
+        udp->rx_inflight[(udp->inflight_head + udp->n_inflight + i) % UDP_BATCH_MAX] = p;
+    }
+
+    __unused ssize_t res = socket_request_oob_ind_vec(udp->udp_output_pusher, REQUEST_UDP_DGRAM, udp->rx_tags, iov, n, 1);
+    assert_int_ex(res, >=, 0);
+
+    udp->n_inflight += n;
+    udp->n_pending = 0;
+    udp_rx_waiting -= n;
+}
+
+static void udp_tx_send(udp_session* udp) {
+    __unused err_t er = udp_sendto(udp->udp_pcb, udp->tx_pbuf, &udp->tx_addr, udp->tx_port);
+    if(er != ERR_OK) udp->tx_dropped++;
+    pbuf_free(udp->tx_pbuf);
+    udp->tx_pbuf = NULL;
+}
+
+// Application -> UDP
+ssize_t CROSS_DOMAIN_DEFAULT_INSECURE(udp_ful_func)(capability arg, char* buf, uint64_t offset, uint64_t length);
+__used ssize_t udp_ful_func(capability arg, char* buf, __unused uint64_t offset, uint64_t length) {
+    udp_session* udp = (udp_session*)arg;
+    struct pbuf* p = udp->tx_pbuf;
+
+    // Data past the length in the header (or for a datagram we could not allocate) is dropped
+    if(p != NULL) {
+        uint16_t want = p->tot_len - udp->tx_have;
+        uint16_t take = (length < want) ? (uint16_t)length : want;
+        pbuf_take_at(p, buf, take, udp->tx_have);
+        udp->tx_have += take;
+        if(udp->tx_have == p->tot_len) udp_tx_send(udp);
+    }
+
+    return length;
+}
+
+ssize_t CROSS_DOMAIN_DEFAULT_INSECURE(udp_ful_oob_func)(capability arg, request_t* request, uint64_t offset, uint64_t partial_bytes, uint64_t length);
+__used ssize_t udp_ful_oob_func(capability arg, request_t* request, __unused uint64_t offset, __unused uint64_t partial_bytes, uint64_t length) {
+    udp_session* udp = (udp_session*)arg;
+
+    switch(request->type) {
+        case REQUEST_UDP_DGRAM:
+        {
+            if(udp->tx_pbuf) {
+                // The last one was cut short
+                pbuf_free(udp->tx_pbuf);
+                udp->tx_pbuf = NULL;
+                udp->tx_dropped++;
+            }
+            intptr_t tag = request->request.oob;
+            udp->tx_addr.addr = UDP_TAG_ADDR(tag);
+            udp->tx_port = UDP_TAG_PORT(tag);
+            udp->tx_have = 0;
+            udp->tx_pbuf = pbuf_alloc(PBUF_TRANSPORT, UDP_TAG_LEN(tag), PBUF_RAM);
+            if(udp->tx_pbuf == NULL) udp->tx_dropped++;
+            else if(UDP_TAG_LEN(tag) == 0) udp_tx_send(udp);
+            break;
+        }
+        case REQUEST_CLOSE:
+            // Left outstanding. The application waits for it to be cancelled by our close, as it cannot free its end
+            // of the sockets before then.
+            udp->closing = 1;
+            return E_AGAIN;
+        default:
+            // Empty
+        {}
+    }
+
+    return length;
+}
+
+// Application -> UDP
+static void handle_udp_fulfill(udp_session* udp) {
+    __unused ssize_t res = socket_fulfill_progress_bytes_unauthorised(udp->udp_input_pushee, SOCK_INF,
+                                                                      F_CHECK | F_PROGRESS | F_DONT_WAIT,
+                                                                      CROSS_DOMAIN_DEFAULT_INSECURE_SEALED(udp_ful_func), udp, 0, CROSS_DOMAIN_DEFAULT_INSECURE_SEALED(udp_ful_oob_func),
+                                                                      NULL, DATA_DEFAULT_INSECURE, DATA_DEFAULT_INSECURE);
+}
+
+static requester_t user_udp_bind(struct tcp_bind* bind, requester_t udp_input_pusher) {
+    struct udp_pcb* pcb = udp_new();
+
+    if(pcb == NULL) return NULL;
+
+    if(udp_bind(pcb, &bind->addr, bind->port) != ERR_OK) {
+        udp_remove(pcb);
+        return NULL;
+    }
+
+    udp_session* udp = (udp_session*)malloc(sizeof(udp_session));
+
+    if(udp == NULL) {
+        udp_remove(pcb);
+        return NULL;
+    }
+
+    bzero(udp, sizeof(udp_session));
+
+    udp->udp_input_pushee = socket_malloc_fulfiller(SOCK_TYPE_PUSH);
+    udp->udp_output_pusher = socket_malloc_requester_32(SOCK_TYPE_PUSH, NULL);
+
+    if(udp->udp_input_pushee == NULL || udp->udp_output_pusher == NULL) {
+        if(udp->udp_input_pushee) free(udp->udp_input_pushee);
+        if(udp->udp_output_pusher) free(udp->udp_output_pusher);
+        free(udp);
+        udp_remove(pcb);
+        return NULL;
+    }
+
+    udp->next = udp_head;
+    if(udp_head) udp_head->prev = udp;
+    udp_head = udp;
+
+    udp->udp_pcb = pcb;
+    socket_requester_set_drb_ptr(udp->udp_output_pusher, &udp->rx_consumed);
+
+    __unused int res = socket_fulfiller_connect(udp->udp_input_pushee, udp_input_pusher);
+    assert_int_ex(res, ==, 0);
+
+    udp_recv(pcb, udp_recv_callback, udp);
+
+    requester_t ref = socket_make_ref_for_fulfill(udp->udp_output_pusher);
+    socket_requester_connect(udp->udp_output_pusher);
+
+    return ref;
+}
+
+static void user_udp_close(udp_session* udp) {
+    udp_remove(udp->udp_pcb);
+
+    socket_close_requester(udp->udp_output_pusher, 0, 1);
+    socket_close_fulfiller(udp->udp_input_pushee, 0, 1);
+
+    if(udp->tx_pbuf) pbuf_free(udp->tx_pbuf);
+
+    for(uint8_t i = 0; i != udp->n_pending; i++) {
+        pbuf_free(udp->rx_pending[i]);
+    }
+    udp_rx_waiting -= udp->n_pending;
+
+    for(uint8_t i = 0; i != udp->n_inflight; i++) {
+        pbuf_free(udp->rx_inflight[(udp->inflight_head + i) % UDP_BATCH_MAX]);
+    }
+
+    if(udp->prev) udp->prev->next = udp->next;
+    else udp_head = udp->next;
+    if(udp->next) udp->next->prev = udp->prev;
+
+    free(udp->udp_input_pushee);
+    free(udp->udp_output_pusher);
+    free(udp);
+}
+
 static void dns_lookup_callback(__unused const char *name, const ip_addr_t *ipaddr, void *callback_arg) {
     sync_state_t ss;
     ss.sync_caller = callback_arg;
@@ -705,22 +1162,113 @@ void setup_checksum_found(sealing_cap sc) {
 #endif
 }
 
-// If interrupts occur too quickly switch to poll mode. If polling fails some number of times, switch back.
-#define STORM_THRESHOLD 1000000
-#define POLL_FREQUENCY  1000000
+// Whether the main loop can take data from the application for this session
+static int tcp_pollable(tcp_session* tcp) {
+    return !(tcp->close_state & (SCS_FULFILL_CLOSED | SCS_USER_REQUEST_CLOSED | SCS_PCB_LAYER_CLOSED_TX)) &&
+            tcp->tcp_pcb->snd_buf; // dont even bother if the send window is already full
+}
+
+// Things the application does that will not wake us, so the session has to stay active to notice them
+static int tcp_has_outstanding(tcp_session* tcp) {
+    return (tcp->recv != tcp->ack_handled) ||
+           ((tcp->close_state & (SCS_REMOTE_CLOSE | SCS_USER_FULFILL_CLOSED | SCS_REQUEST_CLOSED)) == SCS_REMOTE_CLOSE) ||
+           (tcp->close_state & SCS_NEED_FINAL_CLOSE);
+}
+
+/* Receive runs in one of two modes. In interrupt mode the device interrupt wakes us when we sleep. If a pass hands up
+ * a whole budget of packets, or interrupts keep arriving within RX_STORM_GAP of each other, we switch to polling:
+ * device interrupts stay off, every pass of the main loop takes up to RX_BUDGET packets, and we never sleep for longer
+ * than RX_POLL_SLEEP. After POLL_FAIL_LIMIT passes in a row find nothing we go back to interrupts. A pass may poll more
+ * than once, so empty polls are counted per pass, not per poll. */
+
+#define RX_BUDGET       64
+#define RX_STORM_GAP    MS_TO_CLOCK(1)
+#define RX_STORM_IRQS   8
+#define RX_POLL_SLEEP   MS_TO_CLOCK(1)
+#define RX_IRQ_SLEEP    MS_TO_CLOCK(250) // Roughly enough for most TCP things
 #define POLL_FAIL_LIMIT 3
 
+net_rx_stats rx_stats;
+int rx_polling = 0;
+uint32_t rx_empty_polls = 0;
+uint32_t rx_pass_done = 0; // Packets handed up since the last end of a main loop pass
+uint32_t rx_storm_run = 0;
+register_t rx_last_irq = 0;
+
+static void rx_set_polling(int polling) {
+    if(polling == rx_polling) return;
+    rx_polling = polling;
+    rx_empty_polls = 0;
+    rx_storm_run = 0;
+    if(polling) rx_stats.to_poll++;
+    else rx_stats.to_interrupt++;
+}
+
+static uint32_t rx_pass(net_session* session, uint32_t budget, register_t irq) {
+    session->rx_budget = budget;
+    lwip_driver_handle_interrupt(session, 0, irq);
+    uint32_t done = session->rx_done;
+    rx_stats.packets += done;
+    if(done == budget) rx_stats.budget_exhausted++;
+    return done;
+}
+
+static void rx_interrupt(net_session* session, __unused register_t arg, register_t irq) {
+    rx_stats.interrupts++;
+
+    register_t now = syscall_now();
+    if(now - rx_last_irq < RX_STORM_GAP) {
+        if(++rx_storm_run == RX_STORM_IRQS) rx_set_polling(1);
+    } else rx_storm_run = 0;
+    rx_last_irq = now;
+
+    if(rx_pass(session, RX_BUDGET, irq) == RX_BUDGET) rx_set_polling(1);
+}
+
 int handle_rx(net_session* session) {
     tcp_session* tcp_head_before = tcp_head;
 
-    while(lwip_driver_poll(session)) {
-        if(!msg_queue_empty()) {
-            msg_entry(0, 0);
-        } else {
-            lwip_driver_handle_interrupt(session, 0, (register_t)-1); // We now allow poll mode when interrupts coming in too fast.
+    uint32_t done = 0;
+
+    if(rx_polling) {
+        // We may not sleep for a while, so do not leave requests waiting behind packets
+        if(!msg_queue_empty()) msg_entry(0, 0);
+        if(lwip_driver_poll(session)) done = rx_pass(session, RX_BUDGET, (register_t)-1);
+    } else {
+        // Catch up with anything that arrived since the last interrupt, but no more than one budget
+        while(done < RX_BUDGET && lwip_driver_poll(session)) {
+            if(!msg_queue_empty()) {
+                msg_entry(0, 0);
+            } else {
+                uint32_t got = rx_pass(session, RX_BUDGET - done, (register_t)-1);
+                if(got == 0) break;
+                done += got;
+            }
         }
+        if(done >= RX_BUDGET) rx_set_polling(1);
+    }
+
+    rx_pass_done += done;
+
+    // Datagrams that came in also need another pass to be handed up, as does a full budget
+    return (int)(tcp_head_before != tcp_head) || udp_rx_waiting || (rx_polling && done == RX_BUDGET);
+}
+
+// Called once per main loop pass, however many times it called handle_rx
+static void rx_end_pass(void) {
+    if(rx_polling) {
+        rx_stats.polls++;
+        if(rx_pass_done == 0) {
+            rx_stats.empty_polls++;
+            if(++rx_empty_polls == POLL_FAIL_LIMIT) rx_set_polling(0);
+        } else rx_empty_polls = 0;
     }
-    return (int)(tcp_head_before != tcp_head);
+    rx_pass_done = 0;
+}
+
+static void user_get_rx_stats(net_rx_stats* out) {
+    *out = rx_stats;
+    out->polling = (uint64_t)rx_polling;
 }
 
 int main(void) {
@@ -762,6 +1310,7 @@ int main(void) {
 
     // Get a type to seal with
     sealer = get_type_owned_by_process();
+    group_sealer = get_type_owned_by_process();
 
     printf("LWIP Should now be responsive\n");
 
@@ -770,6 +1319,8 @@ int main(void) {
 #if (SIGN_OF_LIFE)
     register_t time = syscall_now();
 #endif
+    own_kstats = syscall_act_kstats();
+
     // Main loop
     POLL_LOOP_START(sock_sleep, sock_event, 1)
 
@@ -786,6 +1337,9 @@ int main(void) {
             }
             printf("Sign of life now = %lx. Listeners = %ld. Open TCPS = %lx\n",
                    now, n_listens, n);
+            printf("RX: %s. Interrupts = %ld. Polls = %ld (%ld empty). Packets = %ld. Full budgets = %ld\n",
+                   rx_polling ? "polling" : "interrupts", rx_stats.interrupts, rx_stats.polls, rx_stats.empty_polls,
+                   rx_stats.packets, rx_stats.budget_exhausted);
             stats_display();
         }
 #endif
@@ -795,12 +1349,38 @@ int main(void) {
 
         handle_rx(&session);
 
-        restart_poll:
+        // Read before polling, so a wakeup that fires during the sweep is seen by the next one
+        if(sockets_notified()) {
+            FOR_EACH_TCP(tcp_session) {
+                if(tcp_session->active) continue;
+
+                int wake = !(tcp_session->close_state & SCS_USER_FULFILL_CLOSED) &&
+                           socket_requester_is_fulfill_closed(tcp_session->tcp_output_pusher);
+
+                if(!wake && tcp_pollable(tcp_session)) {
+                    // Always leave the wakeup armed, an idle session is not looked at again until the next sweep
+                    wake = socket_fulfill_poll(tcp_session->tcp_input_pushee, tcp_session->events, 1, 1, 0) != POLL_NONE;
+                }
+
+                if(wake) {
+                    tcp_mark_active(tcp_session);
+                    sock_event = 1;
+                    sock_sleep = 0;
+                }
+            }
+        }
+
+        // respond to sockets that have something to do
+        tcp_work = tcp_active;
+        tcp_active = NULL;
+
+        while(tcp_work != NULL) {
+            tcp_session* tcp_session = tcp_work;
+            tcp_work = tcp_session->active_next;
+            tcp_session->active = 0;
 
-        if(sock_sleep) syscall_cond_cancel();
+            int busy = 0;
 
-        // respond to sockets
-        FOR_EACH_TCP(tcp_session) {
             // The user stops reading
             if(!(tcp_session->close_state & SCS_USER_FULFILL_CLOSED) &&
                     socket_requester_is_fulfill_closed(tcp_session->tcp_output_pusher)) {
@@ -817,57 +1397,87 @@ int main(void) {
 
             if(tcp_session->close_state & SCS_NEED_FINAL_CLOSE) {
                 user_tcp_close(tcp_session);
-                // Don't trust the for each after modifying the set
-                goto restart_poll;
+                continue;
             }
 
             if(!(tcp_session->close_state & (SCS_REQUEST_CLOSED))) {
                 tcp_application_ack(tcp_session);
             }
 
-            if(!(tcp_session->close_state & (SCS_FULFILL_CLOSED | SCS_USER_REQUEST_CLOSED | SCS_PCB_LAYER_CLOSED_TX))) {
-                if(tcp_session->tcp_pcb->snd_buf) { // dont even bother if the send window is already full
-                    POLL_ITEM_F(revents, sock_sleep, sock_event, tcp_session->tcp_input_pushee, tcp_session->events, 1);
-                    if(revents & POLL_IN) {
-                        handle_fulfill(tcp_session);
-                    } else if(revents & (POLL_ER | POLL_HUP)) {
-                        // The user shouldn't close their requester unless there has been an error, so close everything
-                        printf("Poll err %d %d:%d\n", revents,
-                               tcp_session->tcp_pcb->remote_port, tcp_session->tcp_pcb->local_port);
-                        tcp_session->close_state |= SCS_USER_REQUEST_CLOSED;
-                        user_tcp_close(tcp_session);
-                        // Don't trust the for each after modifying the set
-                        goto restart_poll;
-                    } else if(revents){
-                        printf("Got an unexpected event: %d\n", revents);
-                        sleep(1000);
-                        assert(0);
-                    }
+            if(tcp_pollable(tcp_session)) {
+                POLL_ITEM_F(revents, sock_sleep, sock_event, tcp_session->tcp_input_pushee, tcp_session->events, 1);
+                if(revents & POLL_IN) {
+                    handle_fulfill(tcp_session);
+                    busy = 1;
+                } else if(revents & (POLL_ER | POLL_HUP)) {
+                    // The user shouldn't close their requester unless there has been an error, so close everything
+                    printf("Poll err %d %d:%d\n", revents,
+                           tcp_session->tcp_pcb->remote_port, tcp_session->tcp_pcb->local_port);
+                    tcp_session->close_state |= SCS_USER_REQUEST_CLOSED;
+                    user_tcp_close(tcp_session);
+                    continue;
+                } else if(revents){
+                    printf("Got an unexpected event: %d\n", revents);
+                    sleep(1000);
+                    assert(0);
                 }
             }
 
+            // Only a pass that set waiting has armed the wakeup, so only then can the session go idle
+            if(busy || !sock_sleep || tcp_has_outstanding(tcp_session)) {
+                tcp_mark_active(tcp_session);
+            }
         }
 
+        restart_udp:
+
+        FOR_EACH_UDP(udp_session) {
+            if(udp_session->closing || socket_requester_is_fulfill_closed(udp_session->udp_output_pusher)) {
+                user_udp_close(udp_session);
+                goto restart_udp;
+            }
+
+            udp_rx_ack(udp_session);
+            udp_rx_flush(udp_session);
+
+            POLL_ITEM_F(revents, sock_sleep, sock_event, udp_session->udp_input_pushee, POLL_IN, 0);
+            if(revents & POLL_IN) {
+                handle_udp_fulfill(udp_session);
+                // The application is waiting on the close, so do it now rather than next time around
+                if(udp_session->closing) {
+                    user_udp_close(udp_session);
+                    goto restart_udp;
+                }
+            } else if(revents & (POLL_ER | POLL_HUP)) {
+                user_udp_close(udp_session);
+                goto restart_udp;
+            }
+        }
+
+        // Before the last receive, so that if we go back to interrupts they are turned on before we sleep
+        rx_end_pass();
+
         if(sock_sleep) {
             // If we modify the set then we need to loop over them again to set up sleep vars
             int modified = handle_rx(&session);
             if(modified) {
                 sock_sleep = 0;
-            } else {
+            } else if(!rx_polling) {
                 // Only turn on interrupts if we are actually going to sleep.
                 lwip_driver_enable_interrupts(&session);
             }
 
         }
 
-    POLL_LOOP_END(sock_sleep, sock_event, 1, MS_TO_CLOCK(250)); // Roughly enough for most TCP things
+    POLL_LOOP_END(sock_sleep, sock_event, 1, (rx_polling ? RX_POLL_SLEEP : RX_IRQ_SLEEP));
 }
 
 static sealing_cap user_get_ether_sealer(void) {
     return cheri_andperm(ether_sealer, CHERI_PERM_SEAL);
 }
 
-void (*msg_methods[]) = {user_tcp_connect, user_tcp_listen, user_tcp_connect_sockets, user_gethostbyname, stop_listening, user_get_ether_sealer};
+void (*msg_methods[]) = {user_tcp_connect, user_tcp_listen, user_tcp_connect_sockets, user_gethostbyname, stop_listening, user_get_ether_sealer,
+                         user_udp_bind, user_get_rx_stats, user_tcp_group_token, user_tcp_join};
 size_t msg_methods_nb = countof(msg_methods);
-void (*ctrl_methods[]) = {NULL, lwip_driver_handle_interrupt};
+void (*ctrl_methods[]) = {NULL, rx_interrupt};
 size_t ctrl_methods_nb = countof(ctrl_methods);
@@ -94,6 +94,8 @@ void lwip_driver_handle_interrupt(net_session* session, __unused register_t arg,
 
     MAC_DWORD min_fill = NTOH32_SE(rx_fifo->ctrl_fill_level);
 
+    session->rx_done = 0;
+
     while(min_fill != 0) {
 
         uint32_t data = rx_fifo->symbols;
@@ -128,6 +130,7 @@ void lwip_driver_handle_interrupt(net_session* session, __unused register_t arg,
                     // Hand up to LWIP
                     custom->as_pbuf.custom.pbuf.len = len;
                     session->nif->input(&custom->as_pbuf.custom.pbuf, session->nif);
+                    session->rx_done++;
                 } else {
                     printf(KRED"FREE BROKEN PACKET (too long)\n"KRST);
                     pbuf_free(&custom->as_pbuf.custom.pbuf);
@@ -135,6 +138,9 @@ void lwip_driver_handle_interrupt(net_session* session, __unused register_t arg,
 
             }
             custom = NULL;
+
+            // Stop on a packet boundary, the rest stays in the fifo for the next poll
+            if(session->rx_budget != 0 && session->rx_done == session->rx_budget) break;
         }
 
         if(min_fill == 0) min_fill = NTOH32_SE(rx_fifo->ctrl_fill_level);
@@ -160,7 +160,10 @@ static void setup_descs(net_session* session) {
 static void handle_rx(net_session* session) {
     uint32_t control;
 
-    while((control = (&session->rx_descs[session->rx_index % SGDMA_DESCS_RX])->control), !(control & HTOLE32(CONTROL_OWN))) {
+    session->rx_done = 0;
+
+    while((session->rx_budget == 0 || session->rx_done != session->rx_budget) &&
+          ((control = (&session->rx_descs[session->rx_index % SGDMA_DESCS_RX])->control), !(control & HTOLE32(CONTROL_OWN)))) {
 
         // Create a new one straight away (we keep the previous exit un-used so one always is
         alloc_rx_buf(session, &session->rx_descs[(session->rx_index-1) % SGDMA_DESCS_RX], &session->pbuf_rx_map[(session->rx_index-1) % SGDMA_DESCS_RX], control);
@@ -180,6 +183,7 @@ static void handle_rx(net_session* session) {
 
         session->nif->input(pbuf_in, session->nif);
         session->rx_index++;
+        session->rx_done++;
     }
 
     // Ack interrupt
@@ -189,8 +189,11 @@ void lwip_driver_handle_interrupt(net_session* session, __unused register_t arg,
     // Then process incoming packets and pass them up to lwip
     struct virtq* recvq = &session->virtq_recv;
     int any_in = 0;
-    while(recvq->last_used_idx != VIRTIOQ_SWAP_U16(recvq->used->idx)) {
+    session->rx_done = 0;
+    while(recvq->last_used_idx != VIRTIOQ_SWAP_U16(recvq->used->idx) &&
+            (session->rx_budget == 0 || session->rx_done != session->rx_budget)) {
         any_in = 1;
+        session->rx_done++;
         virtio_device_ack_used(session->mmio);
         size_t used_idx = recvq->last_used_idx & (recvq->num-1);
 
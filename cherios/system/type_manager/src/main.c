@@ -42,13 +42,24 @@ type_res_bitfield_t* bitfield;
 
 // This is our own tracking of which types we have allocated to which tops
 ownership_tracker_t ownership_map[USER_TYPES_LEN];
-struct free_list {
-    DLL(ownership_tracker_t);
-} freeList;
 
-struct freed_list {
-    DLL(ownership_tracker_t);
-} freedList;
+// Free types are tracked with a two level bitmap, so finding one is two count trailing zeros
+#define TYPE_WORDS (USER_TYPES_LEN / 64)
+_Static_assert(TYPE_WORDS <= 64, "Summary is a single word");
+
+uint64_t free_words[TYPE_WORDS];
+uint64_t free_summary;
+
+// Types returned by their owner that must be revoked before they can be handed out again. Once enough have built up
+// (or we run out of free types) contiguous runs are revoked with one tres_revoke each.
+#define TYPE_RECYCLE_BATCH 0x40
+
+uint64_t freed_words[TYPE_WORDS];
+size_t freed_count;
+size_t recycle_at = TYPE_RECYCLE_BATCH;
+// Set when a pass made no types free, so running out does not rescan the bitmap on every request. Until another
+// batch has been freed a retry would find the same thing.
+int recycle_stalled;
 
 
 // The root top (LOL)
@@ -91,17 +102,27 @@ static stype tracker_to_type(ownership_tracker_t* tracker) {
 }
 
 static ownership_tracker_t* type_to_tracker(stype type) {
-    return ownership_map + (type-USER_TYPES_LEN);
+    return ownership_map + (type-USER_TYPES_START);
 }
 
-static tres_t new_tres(ownership_tracker_t* tracker, top_internal_t* top) {
+#define TYPE_BIT(ndx) (1ULL << ((ndx) & 63))
 
-    // Dumb scan to find a tres
+static void set_free(size_t ndx) {
+    free_words[ndx >> 6] |= TYPE_BIT(ndx);
+    free_summary |= TYPE_BIT(ndx >> 6);
+}
+
+static void clear_free(size_t ndx) {
+    free_words[ndx >> 6] &= ~TYPE_BIT(ndx);
+    if(free_words[ndx >> 6] == 0) free_summary &= ~TYPE_BIT(ndx >> 6);
+}
+
+static tres_t new_tres(ownership_tracker_t* tracker, top_internal_t* top) {
 
     stype type = tracker_to_type(tracker);
     tracker->owner = top;
 
-    DLL_REMOVE(&freeList, tracker);
+    clear_free(type - USER_TYPES_START);
     DLL_ADD_END(&top->owns, tracker);
 
     top->types_allocated++;
@@ -109,8 +130,47 @@ static tres_t new_tres(ownership_tracker_t* tracker, top_internal_t* top) {
     return tres_get(type);
 }
 
+static void recycle_freed(void) {
+    size_t ndx = 0;
+    size_t freed_before = freed_count;
+
+    while(ndx != USER_TYPES_LEN) {
+        uint64_t word = freed_words[ndx >> 6] & (~0ULL << (ndx & 63));
+
+        if(word == 0) {
+            ndx = ((ndx >> 6) + 1) << 6;
+            continue;
+        }
+
+        size_t start = (ndx & ~63) + __builtin_ctzll(word);
+        size_t end = start;
+
+        while(end != USER_TYPES_LEN && (freed_words[end >> 6] & TYPE_BIT(end))) end++;
+
+        // The nano kernel returns NULL if it could not revoke the range, in which case the types stay where they are
+        if(tres_revoke(start + USER_TYPES_START, end + USER_TYPES_START) != NULL) {
+            for(size_t i = start; i != end; i++) {
+                freed_words[i >> 6] &= ~TYPE_BIT(i);
+                ownership_map[i].owner = OWNER_FREE;
+                set_free(i);
+            }
+            freed_count -= (end - start);
+        }
+
+        ndx = end;
+    }
+
+    recycle_at = freed_count + TYPE_RECYCLE_BATCH;
+    recycle_stalled = (freed_count == freed_before);
+}
+
 static ownership_tracker_t* find_free_tracker(void) {
-    return freeList.first;
+    if(free_summary == 0 && !recycle_stalled) recycle_freed();
+    if(free_summary == 0) return NULL;
+
+    size_t word = __builtin_ctzll(free_summary);
+
+    return &ownership_map[(word << 6) + __builtin_ctzll(free_words[word])];
 }
 
 static top_t new_top(top_internal_t* from_top) {
@@ -128,9 +188,13 @@ static void release_type(top_internal_t* top, ownership_tracker_t* tracker, int
         DLL_REMOVE(&(top->owns), tracker);
     }
 
-    DLL_ADD_END(&freedList, tracker);
+    size_t ndx = tracker_to_type(tracker) - USER_TYPES_START;
+
+    freed_words[ndx >> 6] |= TYPE_BIT(ndx);
 
     top->types_freed++;
+
+    if(++freed_count >= recycle_at) recycle_freed();
 }
 
 static void destroy_top(top_internal_t* top) {
@@ -159,18 +223,10 @@ static void destroy_top(top_internal_t* top) {
 
 
 static void init_tracking(void) {
-    freeList.first = ownership_map;
-    freeList.last = &ownership_map[USER_TYPES_LEN-1];
-
-    ownership_tracker_t* prev = NULL;
-
-    for(ownership_tracker_t* cur = ownership_map; cur != ownership_map + USER_TYPES_LEN; cur++) {
-        cur->prev = prev;
-        cur->owner = OWNER_FREE;
-        cur->next = cur+1;
+    for(size_t i = 0; i != USER_TYPES_LEN; i++) {
+        ownership_map[i].owner = OWNER_FREE;
+        set_free(i);
     }
-
-    freeList.last->next = NULL;
 }
 
 static top_internal_t* init_top(void) {
@@ -213,7 +269,7 @@ ERROR_T(tres_t) __type_get_new(top_t top) {
 
     ownership_tracker_t* tracker = find_free_tracker();
 
-    if(tracker == NULL) MAKE_ER(tres_t, TYPE_ER_OUT_OF_TYPES);
+    if(tracker == NULL) return MAKE_ER(tres_t, TYPE_ER_OUT_OF_TYPES);
 
     return MAKE_VALID(tres_t,new_tres(tracker, itop));
 }
@@ -0,0 +1,125 @@
+# Decodes the trace records in a capture of the bench_collect stream into a timeline
+
+# Usage: decode_trace.py capture_file [--little] [--trace-header include/trace.h]
+
+# The stream is the one described at the top of benchmarks/bench_collect/src/main.c. Only trace ('T') records are
+# printed, the others are skipped. Event names are read from TRACE_EVENT_LIST in include/trace.h.
+# CHERI-MIPS is big endian, pass --little for RISC-V.
+
+import os
+import re
+import struct
+import sys
+
+TRACE_ARGS = 3
+TRACE_F_KERNEL = 0x1
+
+
+def read_event_names(header_path):
+    names = {}
+    with open(header_path, 'r') as header:
+        for match in re.finditer(r'ITEM\((TRACE_\w+),\s*(\d+)\)', header.read()):
+            names[int(match.group(2))] = match.group(1)
+    return names
+
+
+class Stream:
+    def __init__(self, data, endian):
+        self.data = data
+        self.pos = 0
+        self.endian = endian
+
+    def more(self):
+        return self.pos < len(self.data)
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise EOFError("capture ends part way through a record")
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+    def u64(self):
+        return struct.unpack(self.endian + 'Q', self.take(8))[0]
+
+    def cstr(self):
+        end = self.data.index(b'\0', self.pos)
+        s = self.data[self.pos:end]
+        self.pos = end + 1
+        return s
+
+
+def parse(stream):
+    event_fmt = stream.endian + 'QQIHH' + 'Q' * TRACE_ARGS
+    event_size = struct.calcsize(event_fmt)
+
+    events = []
+    lost = {}
+
+    while stream.more():
+        kind = stream.take(1)
+        if kind == b'S':
+            columns = stream.u64()
+            stream.cstr()
+            for _ in range(columns):
+                stream.cstr()
+        elif kind == b'D':
+            stream.take(8 * stream.u64())
+        elif kind in (b'E', b'F'):
+            pass
+        elif kind == b'T':
+            cpu = stream.u64()
+            lost[cpu] = lost.get(cpu, 0) + stream.u64()
+            for _ in range(stream.u64()):
+                fields = struct.unpack(event_fmt, stream.take(event_size))
+                events.append({'seq': fields[0], 'time': fields[1], 'id': fields[2], 'flags': fields[3],
+                               'cpu': fields[4], 'args': fields[5:], 'ring': cpu})
+        else:
+            raise ValueError("unknown record type %r at offset %d" % (kind, stream.pos - 1))
+
+    return events, lost
+
+
+def main():
+    args = sys.argv[1:]
+    if not args:
+        print("Usage: decode_trace.py capture_file [--little] [--trace-header include/trace.h]")
+        sys.exit(1)
+
+    endian = '>'
+    header_path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'include', 'trace.h')
+    capture = None
+
+    i = 0
+    while i != len(args):
+        if args[i] == '--little':
+            endian = '<'
+        elif args[i] == '--trace-header':
+            i += 1
+            header_path = args[i]
+        else:
+            capture = args[i]
+        i += 1
+
+    names = read_event_names(header_path)
+
+    with open(capture, 'rb') as capture_file:
+        events, lost = parse(Stream(capture_file.read(), endian))
+
+    events.sort(key=lambda e: (e['time'], e['ring'], e['seq']))
+
+    start = events[0]['time'] if events else 0
+
+    for ev in events:
+        name = names.get(ev['id'], 'UNKNOWN_%d' % ev['id'])
+        who = 'k' if ev['flags'] & TRACE_F_KERNEL else 'u'
+        print("%14d cpu%-2d %s %-22s %s" % (ev['time'] - start, ev['cpu'], who, name,
+                                           ' '.join('%#x' % a for a in ev['args'])))
+
+    for cpu in sorted(lost):
+        if lost[cpu]:
+            print("cpu%d: %d events lost" % (cpu, lost[cpu]))
+
+
+if __name__ == "__main__":
+    main()
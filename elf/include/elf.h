@@ -290,6 +290,7 @@ enum e_storage_type {
 	storage_new,
 	storage_process,
 	storage_thread,
+	storage_shared, // Only what processes can share: the read-only segments, or what foundations are made from
 };
 
 static inline capability make_global_pcc(image* im) {
@@ -317,6 +318,8 @@ cap_pair create_image_old(Elf_Env *env, image_old* elf, image_old* out_elf, enum
 
 int create_image(Elf_Env* env, image* in_im, image* out_im, enum e_storage_type store_type);
 int elf_loader_mem(Elf_Env *env, const Elf64_Ehdr* hdr, image* out_elf, int secure_load);
+/* As elf_loader_mem, but with storage_shared. Processes are then made with create_image(storage_process) */
+int elf_loader_mem_shared(Elf_Env *env, const Elf64_Ehdr* hdr, image* out_elf, int secure_load);
 
 
 #endif // Assembly
@@ -252,6 +252,7 @@ int create_image(Elf_Env* env, image* in_im, image* out_im, enum e_storage_type
 
 	if(!IS_SECURE(out_im)) {
 		switch(store_type) {
+			case storage_shared:
 			case storage_new:
 				// Needs all new segments
 				for(size_t i=0; i<out_im->hdr->e_phnum; i++) {
@@ -262,6 +263,7 @@ int create_image(Elf_Env* env, image* in_im, image* out_im, enum e_storage_type
 						}
 					}
 				}
+				if(store_type == storage_shared) break;
 			case storage_process:
 				// Needs new writable parts
 				for(size_t i=0; i<out_im->hdr->e_phnum; i++) {
@@ -307,6 +309,7 @@ int create_image(Elf_Env* env, image* in_im, image* out_im, enum e_storage_type
         res_t res_for_found;
         entry_t e0;
 		switch (store_type) {
+			case storage_shared:
 			case storage_new:
 				pair = env->alloc(contig_size, env);
 
@@ -320,6 +323,7 @@ int create_image(Elf_Env* env, image* in_im, image* out_im, enum e_storage_type
 					}
 					// TODO: Also have to load the dynamic segment
 				}
+				if(store_type == storage_shared) break;
 			case storage_process:
                 res_size_needed = FOUNDATION_META_SIZE(MAX_FOUND_ENTRIES, contig_size) + contig_size;
 
@@ -340,7 +344,7 @@ int create_image(Elf_Env* env, image* in_im, image* out_im, enum e_storage_type
 	return 0;
 }
 
-int elf_loader_mem(Elf_Env *env, const Elf64_Ehdr* hdr, image* out_elf, int secure_load) {
+static int elf_parse(Elf_Env *env, const Elf64_Ehdr* hdr, image* out_elf, int secure_load) {
 	if(!elf_check_supported(env, hdr)) {
 		ERROR("ELF File cannot be loaded");
 		return -1;
@@ -438,9 +442,19 @@ int elf_loader_mem(Elf_Env *env, const Elf64_Ehdr* hdr, image* out_elf, int secu
 	out_elf->image_size = image_size;
     out_elf->secure_loaded = secure_load;
 
+	return 0;
+}
+
+int elf_loader_mem(Elf_Env *env, const Elf64_Ehdr* hdr, image* out_elf, int secure_load) {
+	if(elf_parse(env, hdr, out_elf, secure_load) != 0) return -1;
 	return create_image(env, out_elf, out_elf, storage_new);
 }
 
+int elf_loader_mem_shared(Elf_Env *env, const Elf64_Ehdr* hdr, image* out_elf, int secure_load) {
+	if(elf_parse(env, hdr, out_elf, secure_load) != 0) return -1;
+	return create_image(env, out_elf, out_elf, storage_shared);
+}
+
 /* Parse an elf file already resident in memory. */
 cap_pair elf_loader_mem_old(Elf_Env *env, void *p, image_old* out_elf, int secure_load) {
 	char *addr = (char *)p;
@@ -90,4 +90,37 @@ void AES_CTR_xcrypt_buffer(struct AES_ctx* ctx, uint8_t* buf, uint32_t length);
 
 #endif // #if defined(CTR) && (CTR == 1)
 
+// Table driven (T-table) implementation. Rounds are done on 32-bit columns using four 1KB lookup tables per
+// direction, rather than byte at a time. The round keys are stored pre-expanded for both directions.
+
+#define AES_ROUND_KEY_WORDS (AES_keyExpSize / 4)
+
+struct AES_fast_ctx
+{
+    uint32_t EncKey[AES_ROUND_KEY_WORDS];
+    uint32_t DecKey[AES_ROUND_KEY_WORDS];
+};
+
+void AES_fast_init_ctx(struct AES_fast_ctx* ctx, const uint8_t* key);
+// in and out may alias
+void AES_fast_encrypt_block(const struct AES_fast_ctx* ctx, const uint8_t* in, uint8_t* out);
+void AES_fast_decrypt_block(const struct AES_fast_ctx* ctx, const uint8_t* in, uint8_t* out);
+
+// XTS mode (IEEE 1619) over the table driven cipher. Every sector is tweaked by its own sector number and so can
+// be en/decrypted independently of every other sector, in any order. Offsets are in bytes from the start of the
+// device and must, as must lengths, be a multiple of AES_BLOCKLEN. A range may start and end part way through a sector.
+// NOTES: The tweak key is derived from key and iv, the iv acts as a per-volume salt rather than a chaining value.
+
+struct AES_XTS_ctx
+{
+    struct AES_fast_ctx data;
+    struct AES_fast_ctx tweak;
+    uint32_t sector_size;
+};
+
+void AES_XTS_init_ctx(struct AES_XTS_ctx* ctx, const uint8_t* key, const uint8_t* tweak_key, uint32_t sector_size);
+void AES_XTS_init_ctx_iv(struct AES_XTS_ctx* ctx, const uint8_t* key, const uint8_t* iv, uint32_t sector_size);
+void AES_XTS_encrypt_buffer(const struct AES_XTS_ctx* ctx, uint64_t offset, uint8_t* buf, uint32_t length);
+void AES_XTS_decrypt_buffer(const struct AES_XTS_ctx* ctx, uint64_t offset, uint8_t* buf, uint32_t length);
+
 #endif //_AES_H_
@@ -75,6 +75,30 @@ void cap_free_handle(res_t res);
 
 void        init_cap_malloc(void);
 
+/* Frees any queued remote frees for this thread's arenas. Later frees from other threads are done in place. */
+void        cap_malloc_thread_exit(void);
+
+/* Pages whose claims have all been freed are held back (per thread, per size class) and returned to the memory manager
+ * in batches. Flush returns everything this thread is holding. */
+void        cap_malloc_flush(void);
+
+/* Set how many pages the class that `size' falls into may hold back. 0 returns pages as soon as they are free. */
+void        capmalloc_set_cache_limit(size_t size, size_t pages);
+
+#define CAPMALLOC_CLASSES 48
+
+typedef struct capmalloc_class_stats {
+    size_t size;        // Object size of this class. 0 for objects too big for a slab.
+    uint64_t live;      // Allocations (and extra claims) not yet freed
+    uint64_t cached;    // Pages held back from the memory manager
+    uint64_t slabs;     // Slabs requested from the memory manager
+    uint64_t claims;    // Claims made to the memory manager
+    uint64_t frees;     // Releases made to the memory manager
+} capmalloc_class_stats;
+
+/* Copies out stats for up to n classes, returning how many were written */
+size_t      capmalloc_get_stats(capmalloc_class_stats* out, size_t n);
+
 __END_DECLS
 
 #endif //CHERIOS_CAPMALLOC_H
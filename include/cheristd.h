@@ -89,6 +89,16 @@ ssize_t truncate_file(FILE_t file);
 ssize_t flush_file(FILE_t file);
 ssize_t filesize(FILE_t file);
 
+// Read-only capability to the fs's cached copy of the page containing offset. NULL if the fs will not cache it.
+// *lease is set to a token that stops the fs reusing the page until it is given back with unmap_file_page.
+capability map_file_page(const char* name, uint64_t offset, uint64_t* file_size, capability* lease);
+void unmap_file_page(capability lease);
+ssize_t cached_file_size(const char* name);
+// Sends count bytes of a file from the fs page cache, without the fs seeing the send. Returns the number of bytes sent,
+// which is short if the fs stops caching the file part way. Waits for the socket to finish with each batch of pages
+// so they can be given back, even if the socket is MSG_DONT_WAIT.
+ssize_t sendfile_cached(unix_like_socket* sockout, const char* name, uint64_t offset, size_t count);
+
 act_kt try_get_fs(void);
 dir_token_t opendir(const char* name);
 
@@ -52,6 +52,26 @@ int namespace_register_found_id(cert_t cert);
 int namespace_register_name(const char* name, act_kt ref);
 act_kt namespace_get_ref_by_name(const char* name);
 
+// A number or name can be served by a group of instances. Lookups pick one per the policy the group was created with.
+// The first instance of a group chooses key, which can be any capability. Later instances must present the same one,
+// so only those the first instance hands the key to can join. Services registered with namespace_register or
+// namespace_register_name cannot be joined.
+#define NS_POLICY_ROUND_ROBIN   0
+#define NS_POLICY_LEAST_LOADED  1
+
+int namespace_register_instance(int nb, act_kt ref, int policy, capability key);
+int namespace_register_name_instance(const char* name, act_kt ref, int policy, capability key);
+// Instances of a least-loaded group report their own load (by nb, or by name if name is not NULL). Needs the group key.
+int namespace_report_load(int nb, const char* name, act_kt ref, size_t load, capability key);
+
+// Have waiter notified (syscall_cond_notify) whenever anything registers, or stop if watch is 0. Cheaper than polling
+// for a service to come up.
+int namespace_watch_registrations(act_notify_kt waiter, int watch);
+
+// Lookups of services with a single instance are cached per process. Drop the cache after such a service has been
+// restarted.
+void namespace_flush_cache(void);
+
 extern act_kt namespace_ref;
 
 // TODO this is not a good way to handle names, we probably want string ids, or a string to integer id
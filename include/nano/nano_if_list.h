@@ -71,7 +71,13 @@
 /* Tells the revokeer to start revoking this reservation. revoking fails if already revoking. Must be MAPPED */\
     ITEM(rescap_revoke_start, int, (res_t, res), __VA_ARGS__)\
 /* Tells the revokeer to finish revoking this reservation from before. Must be UNMAPPED. */\
-    ITEM(rescap_revoke_finish, res_t, (uint64_t*, bytes_scanned), __VA_ARGS__)\
+/* If scan is non-null, how many bytes were swept, and how many mapped bytes were skipped as cap clean, are written */\
+    ITEM(rescap_revoke_finish, res_t, (revoke_scan_t*, scan), __VA_ARGS__)\
+/* Optionally split finish up. Prepare does everything finish does before sweeping physical memory. */\
+    ITEM(rescap_revoke_prepare, int, (void), __VA_ARGS__)\
+/* After prepare, sweep the page aligned physical byte range [from, to). Can be called in parallel. Adds to scan. */\
+/* Once every sweep has returned and all of physical memory is covered, finish must be called. */\
+    ITEM(rescap_revoke_sweep, int, (size_t, from, size_t, to, revoke_scan_t*, scan), __VA_ARGS__)\
 /* Splits an open reservation. The reservation will have size `size'. The remaining space will be returned as a new reservation. */\
     ITEM(rescap_split, res_t, (capability, res, size_t, size), __VA_ARGS__)\
 /* Merges two taken reservations. Cannot merge with revoking. If an open and taken are merged the result is taken*/\
@@ -143,7 +149,7 @@
     ITEM(tres_get, tres_t, (register_t, type), __VA_ARGS__)\
 /* Turns in a type reservation for a sealing capability */\
     ITEM(tres_take, sealing_cap, (tres_t, tres), __VA_ARGS__)\
-/* Revokes a range of types */\
+/* Revokes the range of types [start, end). Returns NULL if the range could not be revoked. */\
     ITEM(tres_revoke, capability, (register_t, start, register_t, end), __VA_ARGS__)\
 /* Gets a capability to a bit vector representing the state of the type space */\
     ITEM(tres_get_ro_bitfield, type_res_bitfield_t*, (void), __VA_ARGS__)\
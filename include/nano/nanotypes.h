@@ -180,6 +180,13 @@ typedef capability context_t;               // Type of a nanokernel context hand
 #define PHY_PAGE_OFFSET_len             REG_SIZE
 #define PHY_PAGE_OFFSET_prev            (2*REG_SIZE)
 #define PHY_PAGE_OFFSET_spare           (3*REG_SIZE)
+/* With REVOKE_CAP_DIRTY, spare in the record of the first page of each mapped TLB pair is non-zero once a
+ * capability has been stored to the pair. The revoke sweep skips pairs where it is still zero. */
+#define PHY_PAGE_OFFSET_cap_dirty       PHY_PAGE_OFFSET_spare
+
+/* Counts returned by rescap_revoke_finish */
+#define REVOKE_SCAN_OFFSET_scanned      0
+#define REVOKE_SCAN_OFFSET_skipped      REG_SIZE
 
 /* Virtual page table records */
 
@@ -218,6 +225,7 @@ typedef capability context_t;               // Type of a nanokernel context hand
 #define REVOKE_STATE_STARTING   1 // in the middle of start
 #define REVOKE_STATE_STARTED    2 // can call finish
 #define REVOKE_STATE_REVOKING   3 // in the middle of finish
+#define REVOKE_STATE_SWEEPING   4 // prepared, can call sweep on any core and then finish
 
 #define PFN_SHIFT                       6
 /* These bits will eventually be untranslated high bits, but we will check they are equal to a field in the leaf
@@ -392,7 +400,7 @@ typedef struct {
     e_page_status	status;
     size_t	len; /* number of pages in this chunk */
     size_t	prev; /* start of previous chunk */
-    size_t  spare; /* Will probably use this to store a VPN or user data */
+    size_t  spare; /* Will probably use this to store a VPN or user data. Used as the cap dirty flag if REVOKE_CAP_DIRTY */
 } page_t;
 
 typedef register_t table_entry_t;
@@ -413,6 +421,11 @@ typedef struct {
 typedef register_t ex_lvl_t;
 typedef register_t cause_t;
 
+typedef struct revoke_scan_t {
+    register_t bytes_scanned; /* Physical bytes swept for capabilities */
+    register_t bytes_skipped; /* Physical bytes of mapped memory no capability was ever stored to */
+} revoke_scan_t;
+
 typedef struct res_nfo_t {
     size_t length;
     size_t base;
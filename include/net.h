@@ -76,6 +76,7 @@ typedef struct unix_net_sock {
     capability callback_arg;
     listening_token token;
     buffered_requesters_t* backlog_requesters;
+    uint8_t listen_flags;
 } unix_net_sock;
 
 // TODO: Reduce again when I teach NGINX about AIO
@@ -87,10 +88,39 @@ act_kt net_try_get_ref(void);
 
 sealing_cap get_ethernet_sealing_cap(void);
 
+// Counters for the receive path of the net service
+typedef struct net_rx_stats {
+    uint64_t interrupts;        // Device interrupts taken
+    uint64_t polls;             // Main loop passes that polled the device in poll mode
+    uint64_t empty_polls;       // ... and found nothing
+    uint64_t packets;           // Packets handed up to lwip
+    uint64_t budget_exhausted;  // Times a poll handed up as many packets as it was allowed
+    uint64_t to_poll;           // Switches from interrupt mode to poll mode
+    uint64_t to_interrupt;      // And back again
+    uint64_t polling;           // Non-zero if currently in poll mode
+} net_rx_stats;
+
+int netsock_get_rx_stats(net_rx_stats* out);
+
+enum netsock_listen_flags {
+    NETSOCK_LISTEN_NONE         = 0,
+    // Let other listeners share the port by joining with netsock_join_tcp (like SO_REUSEPORT). Each keeps its own
+    // backlog and lwip hands each new connection to whichever of them has the fewest connections waiting to be accepted.
+    NETSOCK_LISTEN_REUSEPORT    = 1,
+};
+
 listening_token_or_er_t netsock_listen_tcp(struct tcp_bind* bind, uint8_t backlog,
-                       capability callback_arg,  buffered_requesters_t* bufferedRequesters);
+                       capability callback_arg,  buffered_requesters_t* bufferedRequesters,
+                       enum netsock_listen_flags flags);
 void netsock_stop_listen(listening_token token);
 
+// The token needed to join the group a NETSOCK_LISTEN_REUSEPORT listener is in. Only those it is handed to can join.
+// NULL if the listener did not ask to share its port.
+capability netsock_listen_group_token(listening_token token);
+// Listen on the same port as the group the token is for. The bind is that of the group.
+listening_token_or_er_t netsock_join_tcp(capability group_token, uint8_t backlog,
+                                         capability callback_arg, buffered_requesters_t* bufferedRequesters);
+
 int netsock_connect_tcp(struct tcp_bind* bind, struct tcp_bind* server,
                         capability callback_arg);
 
@@ -98,6 +128,8 @@ int netsock_connect_tcp(struct tcp_bind* bind, struct tcp_bind* server,
 NET_SOCK netsock_accept(enum SOCKET_FLAGS flags);
 // Same again but does not alloc and uses in (if in is null this is the same as netsock_accept)
 NET_SOCK netsock_accept_in(enum SOCKET_FLAGS flags, NET_SOCK in);
+// Accepts up to max connections into out. Only waits for the first, and not at all if MSG_DONT_WAIT.
+size_t netsock_accept_batch(enum SOCKET_FLAGS flags, NET_SOCK* out, size_t max);
 
 // Accepts but filters for correct unix socket and puts others on wait lists
 NET_SOCK accept_until_correct(unix_net_sock* expect, int dont_wait);
@@ -105,6 +137,52 @@ NET_SOCK accept_until_correct(unix_net_sock* expect, int dont_wait);
 // Puts one incoming connecting on wait list
 void accept_one(int dont_wait);
 
+/*******/
+/* UDP */
+/*******/
+
+/* Datagrams travel over a pair of push sockets with lwip. Each is an oob carrying its address, port and length,
+ * followed by its data. Batches are enqueued with a single move of the request pointer, so a whole batch costs one
+ * wakeup of the other side. */
+
+#define REQUEST_UDP_DGRAM ((request_type_e)REQUEST_OUT_USER_START)
+
+#define UDP_TAG(addr, port, len) ((intptr_t)(((uint64_t)(len) << 48) | ((uint64_t)(port) << 32) | (uint32_t)(addr)))
+#define UDP_TAG_ADDR(tag)        ((uint32_t)(uint64_t)(tag))
+#define UDP_TAG_PORT(tag)        ((uint16_t)((uint64_t)(tag) >> 32))
+#define UDP_TAG_LEN(tag)         ((uint16_t)((uint64_t)(tag) >> 48))
+
+#define UDP_MAX_DGRAM            0xFFFF
+// Most datagrams a single batch call will put in flight. Two requests each must fit in a requester_32.
+#define UDP_BATCH_MAX            16
+
+typedef struct udp_sock {
+    unix_like_socket sock;
+    struct tcp_bind bind;
+} udp_sock;
+
+typedef udp_sock* UDP_SOCK;
+
+// One element of a batch, like struct mmsghdr
+struct udp_msg {
+    struct tcp_bind addr;   // Destination when sending, source when receiving
+    char* buf;
+    size_t buf_len;
+    size_t dgram_len;       // Set when receiving. Larger than buf_len if the datagram did not fit
+};
+
+UDP_SOCK udp_socket(struct tcp_bind* bind);
+// Waits for lwip to close its end. Anything still queued in either direction is dropped.
+ssize_t udp_close(UDP_SOCK us);
+
+// Both return how many messages were sent / received. Sending waits once per batch for lwip to take the data.
+// Receiving waits for at least one datagram unless MSG_DONT_WAIT.
+ssize_t udp_sendmmsg(UDP_SOCK us, struct udp_msg* msgs, size_t n);
+ssize_t udp_recvmmsg(UDP_SOCK us, struct udp_msg* msgs, size_t n, enum SOCKET_FLAGS flags);
+
+ssize_t udp_sendto(UDP_SOCK us, const char* buf, size_t length, struct tcp_bind* to);
+ssize_t udp_recvfrom(UDP_SOCK us, char* buf, size_t length, struct tcp_bind* from, enum SOCKET_FLAGS flags);
+
 struct hostent {
     const char  *h_name;       /* official name of host */
     char **h_aliases;         /* alias list */
@@ -129,6 +207,11 @@ unix_net_sock* socket(int domain, int type, int protocol);
 int bind(unix_net_sock* sockfd, const struct sockaddr *addr,
          socklen_t addrlen);
 
+// Only SOL_SOCKET SO_REUSEPORT does anything, and only before listen. SO_REUSEADDR is accepted and ignored.
+// SO_REUSEPORT sockets only share a port with others in the same process. To share with another process, hand it the
+// token from netsock_listen_group_token.
+int setsockopt(unix_net_sock* sockfd, int level, int optname, const void *optval, socklen_t optlen);
+
 int listen(unix_net_sock* sockfd, int backlog);
 
 int connect(unix_net_sock* socket, const struct sockaddr *address,
@@ -138,6 +221,10 @@ NET_SOCK accept(unix_net_sock* sockfd, struct sockaddr *addr, socklen_t *addrlen
 
 NET_SOCK accept4(unix_net_sock* sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
 
+// Like accept4 but takes up to max connections that are already waiting. Returns how many, or -1 if there were none
+// and MSG_DONT_WAIT was set.
+ssize_t accept_batch(unix_net_sock* sockfd, NET_SOCK* out, size_t max, int flags);
+
 ssize_t shutdown(NET_SOCK sockfd, int how);
 
 #endif //CHERIOS_NET_H
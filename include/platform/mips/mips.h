@@ -703,6 +703,9 @@ typedef struct reg_frame {
 #define TLB_ENTRY_VALID                                 2
 #define TLB_ENTRY_DIRTY                                 4
 #define TLB_ENTRY_GLOBAL                                1
+#define TLB_ENTRY_CAP_STORE_INHIBIT_SHIFT               63 /* CHERI S bit. Tagged stores raise a C2E exception */
+
+#define CAP_CAUSE_TLB_PROHIBITS_STORE                   0x09
 
 #define TLB_FLAGS_DEFAULT                               (TLB_ENTRY_CACHE_ALGORITHM_CACHED_NONCOHERENT |\
                                                         TLB_ENTRY_VALID | TLB_ENTRY_DIRTY)
@@ -43,32 +43,84 @@
 
 #define PTHREAD_CANCELLED ((void*)-1)
 
-// Only start/join are currently implemented. Sync is still a WIP
+// Start/join, mutexes, rwlocks and barriers are implemented. Conditions are still a WIP
 
 typedef condition_t pthread_cond_t;
 typedef int pthread_condattr_t;
 typedef int pthread_key_t;
 typedef int pthread_mutexattr_t;
 typedef int pthread_once_t;
-typedef int pthread_rwlock_t;
 typedef int pthread_rwlockattr_t;
+typedef int pthread_barrierattr_t;
 
 struct sched_param;
 struct notify_queue;
 
+// Each thread has one of these (own_link) as it can only ever be blocked on one thing at a time
 typedef struct notify_queue {
-    // Probably need a better queue structure here
     act_notify_kt notify_me;
     struct notify_queue* next;
+    volatile uint8_t granted;   // Set by whoever hands us the lock before they notify us
+    uint8_t is_writer;          // Only used by rwlocks
 } notify_queue_t;
 
-// currently a lifo queue, which is not fair, but is easy to implement
+extern __thread notify_queue_t own_link;
+
+// A fifo of waiters. Only touched with the lock of the owning primitive held.
+static inline void notify_queue_push(notify_queue_t** head, notify_queue_t** tail, notify_queue_t* link) {
+    link->next = NULL;
+    link->granted = 0;
+    if(*tail) (*tail)->next = link;
+    else *head = link;
+    *tail = link;
+}
+
+static inline notify_queue_t* notify_queue_pop(notify_queue_t** head, notify_queue_t** tail) {
+    notify_queue_t* link = *head;
+    if(link) {
+        *head = link->next;
+        if(*head == NULL) *tail = NULL;
+    }
+    return link;
+}
+
+// Spin this many times at most before sleeping. The actual amount adapts to how long the lock is usually held for.
+#define PTHREAD_MUTEX_SPIN_MAX      200
+#define PTHREAD_MUTEX_SPIN_MIN      10
+
+// A fifo queue. An unlock with waiters hands ownership straight to the head of the queue, so a thread that is spinning
+// can never steal the lock from a thread that has been put to sleep.
 typedef struct thread_mutex {
-    notify_queue_t * volatile head;
+    spinlock_t queue_lock;      // Protects head and tail
+    notify_queue_t* head;
+    notify_queue_t* tail;
     volatile uint64_t owner_id; // act reference cast to an int
     uint64_t lock_count;
+    uint16_t spin_estimate;     // Running average of spins needed to acquire
 } pthread_mutex_t;
 
+// Readers and writers are served in fifo order. Readers only get in on the fast path if nobody is waiting, which stops
+// a stream of readers starving writers.
+typedef struct pthread_rwlock {
+    spinlock_t lock;
+    uint8_t writer;             // A writer has the lock
+    uint32_t readers;           // How many readers have the lock
+    notify_queue_t* head;
+    notify_queue_t* tail;
+} pthread_rwlock_t;
+
+typedef struct pthread_barrier {
+    spinlock_t lock;
+    uint32_t count;
+    uint32_t waiting;
+    notify_queue_t* head;
+    notify_queue_t* tail;
+} pthread_barrier_t;
+
+#define PTHREAD_MUTEX_INITIALIZER           {{0}}
+#define PTHREAD_RWLOCK_INITIALIZER          {{0}}
+#define PTHREAD_BARRIER_SERIAL_THREAD       (-1)
+
 typedef struct {
     thread t;
     void* retval;
@@ -98,6 +150,24 @@ void pthread_exit(void * retval);
 int pthread_create(pthread_t *pthread, const pthread_attr_t * attr, void *(*start)(void *) , void *arg);
 int pthread_join(pthread_t pthread, void **retval);
 
+int pthread_mutex_destroy(pthread_mutex_t *);
+int pthread_mutex_init(pthread_mutex_t *, const pthread_mutexattr_t *);
+int pthread_mutex_lock(pthread_mutex_t *);
+int pthread_mutex_trylock(pthread_mutex_t *);
+int pthread_mutex_unlock(pthread_mutex_t *);
+
+int pthread_rwlock_destroy(pthread_rwlock_t *);
+int pthread_rwlock_init(pthread_rwlock_t *, const pthread_rwlockattr_t *);
+int pthread_rwlock_rdlock(pthread_rwlock_t *);
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *);
+int pthread_rwlock_trywrlock(pthread_rwlock_t *);
+int pthread_rwlock_unlock(pthread_rwlock_t *);
+int pthread_rwlock_wrlock(pthread_rwlock_t *);
+
+int pthread_barrier_destroy(pthread_barrier_t *);
+int pthread_barrier_init(pthread_barrier_t *, const pthread_barrierattr_t *, unsigned);
+int pthread_barrier_wait(pthread_barrier_t *);
+
 // Not implemented
 
 int   pthread_attr_getdetachstate(const pthread_attr_t *, int *);
@@ -136,13 +206,8 @@ int   pthread_getschedparam(pthread_t, int *, struct sched_param *);
 void *pthread_getspecific(pthread_key_t);
 int   pthread_key_create(pthread_key_t *, void (*)(void *));
 int   pthread_key_delete(pthread_key_t);
-int   pthread_mutex_destroy(pthread_mutex_t *);
 int   pthread_mutex_getprioceiling(const pthread_mutex_t *, int *);
-int   pthread_mutex_init(pthread_mutex_t *, const pthread_mutexattr_t *);
-int   pthread_mutex_lock(pthread_mutex_t *);
 int   pthread_mutex_setprioceiling(pthread_mutex_t *, int, int *);
-int   pthread_mutex_trylock(pthread_mutex_t *);
-int   pthread_mutex_unlock(pthread_mutex_t *);
 int   pthread_mutexattr_destroy(pthread_mutexattr_t *);
 int   pthread_mutexattr_getprioceiling(const pthread_mutexattr_t *, int *);
 int   pthread_mutexattr_getprotocol(const pthread_mutexattr_t *, int *);
@@ -154,13 +219,6 @@ int   pthread_mutexattr_setprotocol(pthread_mutexattr_t *, int);
 int   pthread_mutexattr_setpshared(pthread_mutexattr_t *, int);
 int   pthread_mutexattr_settype(pthread_mutexattr_t *, int);
 int   pthread_once(pthread_once_t *, void (*)(void));
-int   pthread_rwlock_destroy(pthread_rwlock_t *);
-int   pthread_rwlock_init(pthread_rwlock_t *, const pthread_rwlockattr_t *);
-int   pthread_rwlock_rdlock(pthread_rwlock_t *);
-int   pthread_rwlock_tryrdlock(pthread_rwlock_t *);
-int   pthread_rwlock_trywrlock(pthread_rwlock_t *);
-int   pthread_rwlock_unlock(pthread_rwlock_t *);
-int   pthread_rwlock_wrlock(pthread_rwlock_t *);
 int   pthread_rwlockattr_destroy(pthread_rwlockattr_t *);
 int   pthread_rwlockattr_getpshared(const pthread_rwlockattr_t *, int *);
 int   pthread_rwlockattr_init(pthread_rwlockattr_t *);
@@ -126,6 +126,7 @@ typedef struct unix_like_socket {
     // If we emulate a single pointer these are used to track how far behind we are with read/write
     uint64_t read_behind;
     uint64_t write_behind;
+    uint64_t dropped;
     socket_reader_t read;
     socket_writer_t write;
     locked_t encrypt_lock;
@@ -155,6 +156,9 @@ int socket_init(unix_like_socket* sock, enum SOCKET_FLAGS flags,
 ssize_t socket_close(unix_like_socket* sock);
 ssize_t socket_recv(unix_like_socket* sock, char* buf, size_t length, enum SOCKET_FLAGS flags);
 ssize_t socket_send(unix_like_socket* sock, const char* buf, size_t length, enum SOCKET_FLAGS flags);
+// Vectored versions of the above. All iovcnt (<= SOCKET_IOV_MAX) buffers are moved with one socket operation.
+ssize_t socket_recvv(unix_like_socket* sock, const socket_iovec* iov, uint16_t iovcnt, enum SOCKET_FLAGS flags);
+ssize_t socket_sendv(unix_like_socket* sock, const socket_iovec* iov, uint16_t iovcnt, enum SOCKET_FLAGS flags);
 
 ssize_t socket_sendfile(unix_like_socket* sockout, unix_like_socket* sockin, size_t count);
 
@@ -47,6 +47,7 @@
 #define SUBSCRIBE_INVALID_TARGET        (-3)
 #define SUBSCRIBE_INVALID_NOTIFY        (-4)
 #define SUBSCRIBE_NO_SERVICE            (-5)
+#define SUBSCRIBE_NO_MEMORY             (-6)
 
 #define EVENT_PORT_NAMES(name, ...) notify_ ## name ## _port, subscribe_ ## name ## _port,  \
 unsubscribe_ ## name ## _port, unsubscribe_all ## name ## _port,
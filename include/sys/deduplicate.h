@@ -37,12 +37,33 @@
 
 #define DEDUP_ERROR_LENGTH_NOT_EVEN (-1)
 #define DEDUP_ERROR_BAD_ALIGNMENT   (-2)
+#define DEDUP_ERROR_BATCH_TOO_LARGE (-3)
+
+// Max items in one deduplicate_batch call. The service hashes them all together with sha256_multi.
+#define DEDUP_BATCH_MAX             32
+
+typedef struct dedup_batch_item {
+    uint64_t* data;     // In. Same restrictions as for deduplicate
+    size_t length;      // In
+    entry_t result;     // Out. NULL if the item was not found (or could not be created)
+} dedup_batch_item;
+
+// Counters for the service's index. A hit is a lookup or create that found an existing entry.
+typedef struct dedup_index_stats {
+    size_t entries;
+    size_t capacity;
+    size_t hits;
+    size_t misses;
+    size_t grows;
+} dedup_index_stats;
 
 DEC_ERROR_T(entry_t);
 
 ERROR_T(entry_t)    deduplicate(uint64_t* data, size_t length);
 ERROR_T(entry_t)    deduplicate_dont_create(uint64_t* data, size_t length);
 entry_t             deduplicate_find(sha256_hash hash);
+int                 deduplicate_batch(dedup_batch_item* items, size_t n, int allow_create);
+int                 deduplicate_index_stats(dedup_index_stats* out);
 
 // Tries to deduplicate every function. Bit extreme.
 
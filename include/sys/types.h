@@ -137,7 +137,11 @@ typedef struct cap_pair {
 #define USER_STATS_LIST(ITEM, ...) \
     USER_STATS_CALLS(ITEM,__VA_ARGS__)\
     ITEM(temporal_depth, "tdepth", __VA_ARGS__)\
-    ITEM(temporal_reqs, "treqst", __VA_ARGS__)
+    ITEM(temporal_reqs, "treqst", __VA_ARGS__)\
+    ITEM(malloc_slabs, "mslabs", __VA_ARGS__)\
+    ITEM(malloc_cached, "mcache", __VA_ARGS__)\
+    ITEM(malloc_claims, "mclaim", __VA_ARGS__)\
+    ITEM(malloc_frees, "mfrees", __VA_ARGS__)
 
 #define STAT_MEMBER(name, ...) uint64_t name;
 
@@ -168,11 +172,67 @@ typedef struct act_info_s {
 #define ACT_NAME_MAX_LEN (0x10)
 #define ACT_REQUIRED_SPACE ((8 * 1024) - (RES_META_SIZE * 2))
 
+/* Always-on scheduling and IPC counters. The kernel keeps these in one region that anyone can get a read-only
+ * capability to with syscall_kstats, so monitors can read them without making any more syscalls. Times are in
+ * clock ticks (see CLOCK_TO_MS) and the counters are not read atomically, so may be a little out of step.
+ * Counters marked SLOW PATH ONLY are only counted by the C send and scheduler paths. The MIPS kernel fastpath
+ * (KERNEL_FASTPATH in message_send.S) sends sync calls and switches straight to the callee without touching them, so
+ * on MIPS they undercount sync call traffic. RISC-V has no fastpath and counts everything. */
+
+#define KSTATS_MAX_ACTS 0x100
+
+typedef struct act_kstats_s {
+    volatile uint64_t generation;   // Odd while the slot belongs to an activation. Bumped on every (re)use.
+    char name[ACT_NAME_MAX_LEN];
+    status_e status;
+    sched_status_e sched_status;
+    uint8_t cpu;
+    uint32_t runnable_since;        // When the activation last became runnable
+    uint64_t had_time;              // SLOW PATH ONLY: fastpath time is charged to whoever is switched from next
+    uint64_t had_time_epoch;        // Reset by syscall_info_epoch
+    uint64_t switches;              // SLOW PATH ONLY: Times scheduled in
+    uint64_t sent_n;                // SLOW PATH ONLY
+    uint64_t recv_n;                // SLOW PATH ONLY
+    uint64_t commit_faults;
+    uint64_t runq_wait_time;        // SLOW PATH ONLY: Total time spent runnable but not running
+    uint64_t runq_wait_max;         // SLOW PATH ONLY
+    uint64_t queue_hwm;             // Most messages ever waiting in the message queue at once
+    uint64_t notified_n;            // Times another activation has called syscall_cond_notify on this one
+
+    // Only filled in by kernels built with K_DEBUG
+    STAT_DEBUG_LIST(STAT_MEMBER)
+    user_stats_t user_stats;
+} act_kstats_t;
+
+typedef struct pool_kstats_s {
+    uint32_t last_time;
+    uint64_t switches;              // SLOW PATH ONLY
+    uint64_t idle_time;
+    uint64_t runq_wait_time;
+    uint64_t runq_wait_max;
+} pool_kstats_t;
+
+typedef struct kstats_s {
+    uint64_t acts_end;              // No slot at or above this has ever been used
+    pool_kstats_t pools[SMP_CORES];
+    act_kstats_t acts[KSTATS_MAX_ACTS];
+} kstats_t;
+
 typedef capability act_kt;
 typedef capability act_control_kt;
 typedef capability act_reply_kt;
 typedef capability act_notify_kt;
 
+/* One asynchronous message for syscall_message_send_batch. Argument registers not listed here are sent as zero. */
+typedef struct msg_batch_entry {
+    register_t a0;
+    register_t a1;
+    capability c3;
+    capability c4;
+    act_kt dest;
+    register_t v0;
+} msg_batch_entry_t;
+
 #endif
 
 #endif
@@ -97,7 +97,20 @@ __BEGIN_DECLS
         ITEM(syscall_bench_start, uint64_t, (void), __VA_ARGS__)\
         ITEM(syscall_bench_end, uint64_t, (void), __VA_ARGS__)\
         ITEM(syscall_hang_debug, void, (void), __VA_ARGS__)\
-        ITEM(syscall_backtrace, void, (void), __VA_ARGS__)
+        ITEM(syscall_backtrace, void, (void), __VA_ARGS__)\
+/* SENDs each message in turn with a single kernel entry. Messages to activations that are no longer alive, or whose
+ * queue is full, are dropped. Returns how many were sent. */\
+        ITEM(syscall_message_send_batch, size_t, (const msg_batch_entry_t* msgs, size_t n), __VA_ARGS__)\
+/* A read only capability to the binary trace ring for a core (see trace.h), or for the current core if cpu is negative.
+ * The first activation to call this is the only one that ever gets a ring. NULL for everyone else, if there is no such
+ * ring, or if the kernel was built without TRACE_RINGS. */\
+        ITEM(syscall_trace_ring, struct trace_ring*, (int cpu), __VA_ARGS__)\
+/* Appends a user event to the trace ring of the current core, timestamped by the kernel */\
+        ITEM(syscall_trace_event, void, (uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2), __VA_ARGS__)\
+/* A read-only view of the kernel's always-on scheduling and IPC counters */\
+        ITEM(syscall_kstats, const kstats_t*, (void), __VA_ARGS__)\
+/* A read-only view of the calling activation's own counters, which may be shared with others if it did not get a slot */\
+        ITEM(syscall_act_kstats, const act_kstats_t*, (void), __VA_ARGS__)
 
 #define syscall_panic_last_caller() syscall_panic_caller(sync_state.sync_caller)
 
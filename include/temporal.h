@@ -38,10 +38,27 @@
 //#define NewTemporalStackSize 0x3FC00
 #define NewTemporalStackSize 0xff000
 
+// Each thread keeps a few pre-committed unsafe stacks so that replacing one on the exception path is normally just a pop.
+// Empty pools are refilled from a process wide reserve, which a worker thread tops up once it falls to the low mark.
+// Old stacks are retired to memmgt in batches by the same worker.
+// Every pooled, reserved or retired stack is NewTemporalStackSize of committed memory, so these are kept small.
+#define UNSAFE_STACK_POOL_SIZE      2
+#define UNSAFE_STACK_RETIRE_BATCH   2
+#define UNSAFE_STACK_RESERVE_SIZE   2
+#define UNSAFE_STACK_RESERVE_LOW    1
+
 int temporal_exception_handle(register_t cause, register_t ccause, exception_restore_frame* restore_frame);
 
 extern void try_replace_usp(void);
 void consume_usp(void);
 void replace_usp(void);
+// Tops up this thread's pool of unsafe stacks. Call at a convenient point to keep memmgt off the exception path.
+void temporal_pool_refill(void);
+// Starts the worker that refills the reserve and retires stacks. Called once at process init.
+void temporal_start_worker(void);
+// Counts this thread as live, the worker exits once none are. Called on thread start.
+void temporal_thread_start(void);
+// Gives this thread's pooled and retired stacks back. Called on thread exit.
+void temporal_thread_exit(void);
 
 #endif //CHERIOS_TEMPORAL_H
@@ -0,0 +1,123 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CHERIOS_TRACE_H
+#define CHERIOS_TRACE_H
+
+/* Binary event tracing, built in with the TRACE_RINGS option. The kernel keeps one ring of fixed size events per core.
+ * Appending is a single atomic add and a few stores. Only the kernel writes to the rings, user events are appended by
+ * syscall_trace_event and the capabilities handed out by syscall_trace_ring are read only.
+ * Rings are drained by bench_collect and decoded on the host by decode_trace.py, which reads the event names from
+ * TRACE_EVENT_LIST below. Add new events to the end of the list. */
+
+#ifndef TRACE_RINGS
+#define TRACE_RINGS 0
+#endif
+
+#define TRACE_RING_ENTRIES_BITS 9
+#define TRACE_RING_ENTRIES      (1 << TRACE_RING_ENTRIES_BITS)
+#define TRACE_ARGS              3
+
+#define TRACE_EVENT_LIST(ITEM)      \
+    ITEM(TRACE_MARK, 0)             \
+    ITEM(TRACE_MSG_SEND, 1)         \
+    ITEM(TRACE_MSG_REPLY, 2)        \
+    ITEM(TRACE_SCHED_SWITCH, 3)     \
+    ITEM(TRACE_SCHED_WAKE, 4)       \
+    ITEM(TRACE_SOCK_FULFILL, 5)     \
+    ITEM(TRACE_SOCK_FULFILLED, 6)   \
+    ITEM(TRACE_SOCK_REQUEST, 7)
+
+#define TRACE_F_KERNEL          0x1
+
+#ifndef __ASSEMBLY__
+
+#include "cdefs.h"
+#include "cheric.h"
+#include "string_enums.h"
+#include "atomic.h"
+#include "platform.h"
+
+DECLARE_ENUM(trace_event_id_e, TRACE_EVENT_LIST)
+
+#define TRACE_PTR(p) ((uint64_t)cheri_getcursor(p))
+
+typedef struct trace_event {
+    volatile uint64_t seq;          // The position in the ring plus one, written last
+    uint64_t time;
+    uint32_t id;
+    uint16_t flags;
+    uint16_t cpu;
+    uint64_t args[TRACE_ARGS];
+} trace_event_t;
+
+typedef struct trace_ring {
+    volatile uint64_t head;         // Next position to claim. Older events are overwritten when the ring wraps.
+    uint64_t cpu;
+    trace_event_t events[TRACE_RING_ENTRIES];
+} trace_ring_t;
+
+static inline void trace_ring_write(trace_ring_t* ring, uint64_t time, uint32_t id, uint16_t flags,
+                                    uint64_t a0, uint64_t a1, uint64_t a2) {
+    uint64_t pos = ATOMIC_ADD_RV(&ring->head, 64, 16i, 1);
+
+    trace_event_t* ev = &ring->events[pos & (TRACE_RING_ENTRIES-1)];
+
+    // Readers see a torn entry as lost rather than as garbage
+    ev->seq = 0;
+    HW_SYNC;
+    ev->time = time;
+    ev->id = id;
+    ev->flags = flags;
+    ev->cpu = (uint16_t)ring->cpu;
+    ev->args[0] = a0;
+    ev->args[1] = a1;
+    ev->args[2] = a2;
+    HW_SYNC;
+    ev->seq = pos + 1;
+}
+
+/* User interface. Events go to the ring of the core the calling thread is on */
+
+#if (TRACE_RINGS)
+    #define TRACE_EVENT(id, a0, a1, a2) trace_event(id, (uint64_t)(a0), (uint64_t)(a1), (uint64_t)(a2))
+#else
+    #define TRACE_EVENT(...)
+#endif
+
+void trace_event(uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2);
+
+/* Copies out up to max complete events after *tail and advances *tail. Events that were overwritten before they could
+ * be copied are added to *lost. */
+size_t trace_ring_drain(trace_ring_t* ring, uint64_t* tail, trace_event_t* out, size_t max, uint64_t* lost);
+
+#endif // __ASSEMBLY__
+
+#endif //CHERIOS_TRACE_H
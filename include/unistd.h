@@ -102,4 +102,19 @@ static inline ssize_t read(int handle, void *buf, size_t length) {
     return read_file(posix_handle_to_socket(handle), buf, length);
 }
 
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+
+_Static_assert(sizeof(struct iovec) == sizeof(socket_iovec), "iovec is passed straight through to the socket layer");
+
+static inline ssize_t writev(int handle, const struct iovec* iov, int iovcnt) {
+    return socket_sendv(posix_handle_to_socket(handle), (const socket_iovec*)iov, (uint16_t)iovcnt, MSG_NONE);
+}
+
+static inline ssize_t readv(int handle, const struct iovec* iov, int iovcnt) {
+    return socket_recvv(posix_handle_to_socket(handle), (const socket_iovec*)iov, (uint16_t)iovcnt, MSG_NONE);
+}
+
 #endif //CHERIOS_UNISTD_H
@@ -39,7 +39,7 @@
 #include "aes.h"
 
 typedef struct block_aes_data_s {
-	struct AES_ctx ctx;
+	struct AES_XTS_ctx ctx; // Keyed per sector, so any sector can be accessed independently
 	const uint8_t* key;
 	uint8_t iv[AES_BLOCKLEN];
 	capability check_arg;
@@ -34,6 +34,8 @@
 #include "lists.h"
 #include "stdlib.h"
 #include "atomic.h"
+#include "string.h"
+#include "object.h"
 
 /* This version of capmalloc only uses slabs for allocation.
  * Each tread has its own set of slabs.
@@ -41,6 +43,9 @@
  * Claim tracking is concurrent and for the entire process.
  * If there is too much pressure on the cache (or NO_CACHE is 1) then
  * are forwarded directly to the memory manager
+ *
+ * Freeing a slab object allocated by another thread does not touch claim tracking directly. Instead it is pushed to the
+ * owning thread's remote free queue, which the owner drains the next time it allocates or frees, or when it exits.
  */
 
 
@@ -52,9 +57,19 @@
 
 #define NO_CACHE 0
 
-// TODO: Currently freeing is very aggressive, we might wish to coalesce frees.
-// TODO: If the cache gets big do some eviction. Otherwise it can grow in an unbounded way.
-#define ALLOW_EVICTION 0
+#define BIG_OBJECT_THRESHOLD 0xe000
+#define N_SLABS 47
+
+// One class per slab size, and a last one for objects too big for a slab
+#define N_CLASSES   (N_SLABS + 1)
+#define BIG_CLASS   N_SLABS
+
+static_assert(N_CLASSES == CAPMALLOC_CLASSES, "Stats are exported per class");
+
+// Pages that lose their last claim are not released straight away. They sit in a per-thread batch and are returned to
+// the memory manager in coalesced runs, either when their size class holds more than its limit or the batch is full.
+#define RELEASE_BATCH_RANGES    0x10
+#define CLASS_CACHE_PAGES       0x40
 
 // We allocate blocks of this size for tracking metadata. Quite large so as not to waste too much due to fragmentation.
 #define TRACKING_BLOCK_SIZE ((256 * UNTRANSLATED_PAGE_SIZE) - MEM_REQUEST_FAST_OFFSET)
@@ -68,13 +83,17 @@ struct l2_table_t {
     volatile uint32_t claim_counts[PAGE_TABLE_ENT_PER_TABLE];
 };
 
-// ~12304 bytes
+struct remote_queue_t;
+
+// ~20496 bytes
 // TODO might want faster super-page claim (rather than looping over every sub table)
 struct l1_table_t {
     l1_table_t* free_chain;
     l2_table_t *volatile tables[PAGE_TABLE_ENT_PER_TABLE];
     // A count of the total number of claims in a subtable (useful for tracking eviction)
     volatile uint64_t total_claims[PAGE_TABLE_ENT_PER_TABLE];
+    // The queue of the thread whose slab last covered each subtable. Only a hint for where to send frees.
+    remote_queue_t *volatile owners[PAGE_TABLE_ENT_PER_TABLE];
 };
 
 struct l0_table_t {
@@ -92,7 +111,138 @@ res_nfo_t round_nfo_to_page(res_nfo_t nfo) {
     return MAKE_NFO(rounded_length, rounded_base);
 }
 
-#if (!NO_CACHE)
+// Statistics and the release cache
+
+volatile capmalloc_class_stats class_stats[N_CLASSES];
+
+#define CLASS_STAT_ADD(cls, field, n) (void)ATOMIC_ADD_RV(&class_stats[cls].field, 64, 64, n)
+
+struct cache_limits_t {
+    size_t pages[N_CLASSES];
+    constexpr cache_limits_t() : pages() {
+        for(size_t i = 0; i != N_CLASSES; i++) pages[i] = (i == BIG_CLASS) ? 0 : CLASS_CACHE_PAGES;
+    }
+};
+
+cache_limits_t cache_limits;
+
+struct release_range_t {
+    size_t base;
+    size_t length;
+    size_t cls;
+};
+
+__thread struct release_batch_t {
+    size_t n;
+    release_range_t ranges[RELEASE_BATCH_RANGES];
+    size_t cached_pages[N_CLASSES];
+} release_batch;
+
+static void release_now(size_t base, size_t length, size_t cls) {
+    int res = mem_release(base, length, 1, own_mop);
+    if(res != 0) {
+        printf("Bad free, error code: %d\n", res);
+    }
+    assert(res == 0);
+
+    CLASS_STAT_ADD(cls, frees, 1);
+    if(own_stats) own_stats->malloc_frees++;
+}
+
+static void evict_class(size_t cls) {
+    release_batch_t* batch = &release_batch;
+    size_t kept = 0;
+
+    for(size_t i = 0; i != batch->n; i++) {
+        release_range_t* range = &batch->ranges[i];
+        if(range->cls == cls) {
+            release_now(range->base, range->length, cls);
+        } else {
+            batch->ranges[kept++] = *range;
+        }
+    }
+
+    batch->n = kept;
+
+    size_t pages = batch->cached_pages[cls];
+    batch->cached_pages[cls] = 0;
+    CLASS_STAT_ADD(cls, cached, -pages);
+    if(own_stats) own_stats->malloc_cached -= pages;
+}
+
+static void evict_fullest(void) {
+    release_batch_t* batch = &release_batch;
+    size_t fullest = batch->ranges[0].cls;
+
+    for(size_t i = 1; i != batch->n; i++) {
+        size_t cls = batch->ranges[i].cls;
+        if(batch->cached_pages[cls] > batch->cached_pages[fullest]) fullest = cls;
+    }
+
+    evict_class(fullest);
+}
+
+// Called with a run of pages we no longer hold any claims on
+static void release_pages(size_t base, size_t length, size_t cls) {
+    if(cache_limits.pages[cls] == 0) {
+        release_now(base, length, cls);
+        return;
+    }
+
+    release_batch_t* batch = &release_batch;
+    size_t merged = batch->n;
+
+    for(size_t i = 0; i != batch->n; i++) {
+        release_range_t* range = &batch->ranges[i];
+        if(range->cls != cls) continue;
+        if(range->base + range->length == base) {
+            range->length += length;
+            merged = i;
+            break;
+        }
+        if(base + length == range->base) {
+            range->base = base;
+            range->length += length;
+            merged = i;
+            break;
+        }
+    }
+
+    if(merged != batch->n) {
+        // We might have filled a gap between two ranges
+        release_range_t* range = &batch->ranges[merged];
+        for(size_t i = 0; i != batch->n; i++) {
+            release_range_t* other = &batch->ranges[i];
+            if(i == merged || other->cls != cls) continue;
+            if(other->base + other->length == range->base || range->base + range->length == other->base) {
+                if(other->base < range->base) range->base = other->base;
+                range->length += other->length;
+                *other = batch->ranges[--batch->n];
+                break;
+            }
+        }
+    } else {
+        if(batch->n == RELEASE_BATCH_RANGES) evict_fullest();
+        release_range_t* range = &batch->ranges[batch->n++];
+        range->base = base;
+        range->length = length;
+        range->cls = cls;
+    }
+
+    size_t pages = length >> UNTRANSLATED_BITS;
+
+    batch->cached_pages[cls] += pages;
+    CLASS_STAT_ADD(cls, cached, pages);
+    if(own_stats) own_stats->malloc_cached += pages;
+
+    if(batch->cached_pages[cls] > cache_limits.pages[cls]) evict_class(cls);
+}
+
+static int claim_now(size_t base, size_t length, size_t cls) {
+    CLASS_STAT_ADD(cls, claims, 1);
+    if(own_stats) own_stats->malloc_claims++;
+    return mem_claim(base, length, 1, own_mop);
+}
 
 l0_table_t l0_table;
 l1_table_t*volatile l1_free_chain;
@@ -157,6 +307,8 @@ T* allocate_obj(T*volatile* head) {
     return ret;
 }
 
+#if (!NO_CACHE)
+
 l2_table_t* allocate_l2_table(void) {
     return allocate_obj<l2_table_t>(&l2_free_chain);
 }
@@ -170,6 +322,7 @@ void deallocate_l2_table(l2_table_t* table) {
 }
 
 void deallocate_l1_table(l1_table_t* table) {
+    bzero((void*)table->owners, sizeof(table->owners));
     push_to_free_chain<l1_table_t>(table, table, &l1_free_chain);
 }
 
@@ -222,7 +375,7 @@ super_break:
     return *childPtr;
 }
 
-int add_claims_to_table(l0_table_t* table0, size_t base, size_t length, bool already_claimed) {
+int add_claims_to_table(l0_table_t* table0, size_t base, size_t length, bool already_claimed, size_t cls) {
 
     size_t ndx_end = (base + length) >> UNTRANSLATED_BITS;
     size_t ndx = base >> UNTRANSLATED_BITS;
@@ -268,7 +421,7 @@ int add_claims_to_table(l0_table_t* table0, size_t base, size_t length, bool alr
 
         if(!already_claimed && (was_before != 0)) {
             if(prev_ndx != ndx) {
-                res = mem_claim(prev_ndx << UNTRANSLATED_BITS, (ndx-prev_ndx) << UNTRANSLATED_BITS, 1, own_mop);
+                res = claim_now(prev_ndx << UNTRANSLATED_BITS, (ndx-prev_ndx) << UNTRANSLATED_BITS, cls);
                 assert_int_ex(-res, ==, 0);
                 if(res != 0) return res;
             }
@@ -285,7 +438,7 @@ int add_claims_to_table(l0_table_t* table0, size_t base, size_t length, bool alr
     res = 0;
 
     if(!already_claimed && prev_ndx != ndx) {
-        res = mem_claim(prev_ndx << UNTRANSLATED_BITS, (ndx-prev_ndx) << UNTRANSLATED_BITS, 1, own_mop);
+        res = claim_now(prev_ndx << UNTRANSLATED_BITS, (ndx-prev_ndx) << UNTRANSLATED_BITS, cls);
         assert_int_ex(-res, ==, 0);
     }
 
@@ -308,7 +461,7 @@ CT* remove_claims_from_parent(PT* table, size_t ndx, uint64_t total_to_remove) {
     return (old_val == total_to_remove) ? child : nullptr;
 }
 
-int remove_claims_from_table(l0_table_t* table0, size_t base, size_t length) {
+int remove_claims_from_table(l0_table_t* table0, size_t base, size_t length, size_t cls) {
 
     size_t ndx_end = (base + length) >> UNTRANSLATED_BITS;
     size_t ndx = base >> UNTRANSLATED_BITS;
@@ -370,9 +523,7 @@ int remove_claims_from_table(l0_table_t* table0, size_t base, size_t length) {
 
         if(was_before != 1) {
             if(ndx != prev_ndx) {
-                res = mem_release(prev_ndx << UNTRANSLATED_BITS, (ndx-prev_ndx) << UNTRANSLATED_BITS, 1, own_mop);
-                assert(res == 0);
-                if(res != 0) return res;
+                release_pages(prev_ndx << UNTRANSLATED_BITS, (ndx-prev_ndx) << UNTRANSLATED_BITS, cls);
             }
             prev_ndx = ndx+1;
         }
@@ -384,9 +535,7 @@ int remove_claims_from_table(l0_table_t* table0, size_t base, size_t length) {
     res = 0;
 
     if(ndx != prev_ndx) {
-        res = mem_release(prev_ndx << UNTRANSLATED_BITS, (ndx-prev_ndx) << UNTRANSLATED_BITS, 1, own_mop);
-        assert(res == 0);
-        if(res != 0) return res;
+        release_pages(prev_ndx << UNTRANSLATED_BITS, (ndx-prev_ndx) << UNTRANSLATED_BITS, cls);
     }
 
     if(to_free_1) deallocate_l1_table(to_free_1);
@@ -395,35 +544,59 @@ int remove_claims_from_table(l0_table_t* table0, size_t base, size_t length) {
     return res;
 }
 
+// Nothing can be freed while we hold a claim in the same subtable, so the l1 table will not go away under us
+
+static l1_table_t* l1_table_for(size_t addr) {
+    return l0_table.tables[addr >> (UNTRANSLATED_BITS + L2_BITS + L1_BITS)];
+}
+
+static void set_slab_owner(size_t base, remote_queue_t* queue) {
+    size_t ends[2] = {base, base + SLAB_SIZE - 1};
+
+    for(size_t i = 0; i != 2; i++) {
+        l1_table_t* table1 = l1_table_for(ends[i]);
+        if(table1) table1->owners[(ends[i] >> SLAB_SIZE_BITS) & ((1 << L1_BITS)-1)] = queue;
+    }
+}
+
+static remote_queue_t* get_slab_owner(size_t addr) {
+    l1_table_t* table1 = l1_table_for(addr);
+    return table1 ? table1->owners[(addr >> SLAB_SIZE_BITS) & ((1 << L1_BITS)-1)] : nullptr;
+}
+
+#else
+
+static void set_slab_owner(__unused size_t base, __unused remote_queue_t* queue) {}
+
+static remote_queue_t* get_slab_owner(__unused size_t addr) {
+    return nullptr;
+}
+
 #endif // (NO_CACHE)
 
-int claim_range(res_nfo_t nfo, bool claim_already_held) {
+int claim_range(res_nfo_t nfo, bool claim_already_held, size_t cls) {
 
     nfo = round_nfo_to_page(nfo);
 
 #if (NO_CACHE)
     if(claim_already_held) return 0;
-    else return mem_claim(nfo.base, nfo.length, 1, own_mop);
+    else return claim_now(nfo.base, nfo.length, cls);
 #else
 
-    return add_claims_to_table(&l0_table, nfo.base, nfo.length, claim_already_held);
+    return add_claims_to_table(&l0_table, nfo.base, nfo.length, claim_already_held, cls);
 
 #endif
 
 }
 
-void free_range(res_nfo_t nfo) {
+void free_range(res_nfo_t nfo, size_t cls) {
     nfo = round_nfo_to_page(nfo);
 
 #if (NO_CACHE)
-    int res = mem_release(nfo.base, nfo.length, 1, own_mop);
-    if(res != 0) {
-        printf("Bad free, error code: %d\n", res);
-    }
-    assert(res == 0);
+    release_pages(nfo.base, nfo.length, cls);
 #else
 
-    remove_claims_from_table(&l0_table, nfo.base, nfo.length);
+    remove_claims_from_table(&l0_table, nfo.base, nfo.length, cls);
 
 #endif
 }
@@ -439,8 +612,70 @@ static res_nfo_t memhandle_nfo(capability mem) {
     return (type == RES_TYPE) ? rescap_nfo(mem) : MAKE_NFO(cheri_getlen(mem), cheri_getbase(mem));
 }
 
-#define BIG_OBJECT_THRESHOLD 0xe000
-#define N_SLABS 47
+// Remote frees. Nodes are separate from the object as its contents must survive a free if there are other claims.
+
+struct remote_free_t {
+    remote_free_t* free_chain;
+    capability mem;
+};
+
+struct remote_queue_t {
+    remote_free_t* volatile head;
+    void* home; // The arena list of the owning thread
+};
+
+remote_free_t*volatile remote_free_node_chain;
+
+// Head of a queue whose thread has exited. Pushes onto it fail and the freeing thread frees in place.
+static remote_free_t remote_queue_retired;
+
+static remote_queue_t* new_remote_queue(void* home) {
+    remote_queue_t* queue = (remote_queue_t*)new_tracking_object(sizeof(remote_queue_t));
+    queue->head = nullptr;
+    queue->home = home;
+    return queue;
+}
+
+static bool push_remote_free(remote_queue_t* queue, capability mem) {
+    remote_free_t* node = allocate_obj<remote_free_t>(&remote_free_node_chain);
+    node->mem = mem;
+
+    int success;
+    do {
+        remote_free_t* old_head = queue->head;
+        if(old_head == &remote_queue_retired) {
+            push_to_free_chain<remote_free_t>(node, node, &remote_free_node_chain);
+            return false;
+        }
+        node->free_chain = old_head;
+        success = ATOMIC_CAS_RV(&queue->head, c, old_head, node);
+    } while(!success);
+
+    return true;
+}
+
+static void free_local(capability mem, res_nfo_t nfo);
+
+static void drain_remote_frees(remote_queue_t* queue, remote_free_t* replace_with) {
+    remote_free_t* first;
+    int success;
+
+    do {
+        first = queue->head;
+        success = ATOMIC_CAS_RV(&queue->head, c, first, replace_with);
+    } while(!success);
+
+    if(first == nullptr || first == &remote_queue_retired) return;
+
+    remote_free_t* last = first;
+    for(remote_free_t* node = first; node != nullptr; node = node->free_chain) {
+        free_local(node->mem, memhandle_nfo(node->mem));
+        node->mem = nullptr;
+        last = node;
+    }
+
+    push_to_free_chain<remote_free_t>(first, last, &remote_free_node_chain);
+}
 
 // The sizes of objects
 constexpr const size_t sizes[47] = { //skips 1 (0x3), 3 (0x5,6,7), 3 (10,12,14), 3 (20, 24, 28), 1 (40) ,1 (56) bucket sizes the nano kernel supports
@@ -514,6 +749,10 @@ constexpr size_t ndx_to_total(size_t size_ndx) {
     return totals_ar.value[size_ndx];
 }
 
+constexpr size_t size_to_class(size_t size) {
+    return (size > BIG_OBJECT_THRESHOLD) ? BIG_CLASS : size_to_ndx(size);
+}
+
 class Slab {
     res_t current_field;
     res_t next_field;
@@ -524,7 +763,7 @@ class Slab {
     uint64_t meta_claim_end;
     size_t dma_offset;
 
-    void new_field(size_t size_ndx, res_t from_res, size_t dma_addr, size_t total) {
+    void new_field(size_t size_ndx, res_t from_res, size_t dma_addr, size_t total, remote_queue_t* queue) {
 
         current_field = from_res;
 
@@ -549,12 +788,14 @@ class Slab {
         meta_claim_current = nfo.base & ~(UNTRANSLATED_PAGE_SIZE-1);
         meta_claim_end = meta_claim_current + SLAB_SIZE;
 
-        claim_range(MAKE_NFO(SLAB_SIZE, meta_claim_current), true);
+        claim_range(MAKE_NFO(SLAB_SIZE, meta_claim_current), true, size_ndx);
+
+        set_slab_owner(meta_claim_current, queue);
 
         rescap_splitsub(current_field, ndx_to_scale(size_ndx));
     }
 
-    void new_field(size_t size_ndx, bool dma, size_t total) {
+    void new_field(size_t size_ndx, bool dma, size_t total, remote_queue_t* queue) {
 
         res_t new_res;
         size_t dma_off = 0;
@@ -565,21 +806,24 @@ class Slab {
             new_res = mem_request(0, SLAB_SIZE - MEM_REQUEST_FAST_OFFSET, NONE, own_mop).val;
         }
 
-        new_field(size_ndx, new_res, dma_off, total);
+        CLASS_STAT_ADD(size_ndx, slabs, 1);
+        if(own_stats) own_stats->malloc_slabs++;
+
+        new_field(size_ndx, new_res, dma_off, total, queue);
     }
 
 public:
     constexpr Slab() : current_field(nullptr), next_field(nullptr), current_ndx(0), total_ndx(0),
                         at_addr(0), meta_claim_current(0), meta_claim_end(0), dma_offset(0) {}
 
-    res_t allocate(size_t size_ndx, bool dma, size_t* dma_off) {
+    res_t allocate(size_t size_ndx, bool dma, size_t* dma_off, remote_queue_t* queue) {
 
         size_t total = ndx_to_total(size_ndx);
         size_t ob_size = ndx_to_size(size_ndx);
 
         // Get new memory if needed
         if(current_field == nullptr) {
-            new_field(size_ndx, dma, total);
+            new_field(size_ndx, dma, total, queue);
         }
 
         // Get our object
@@ -590,19 +834,19 @@ public:
 
         // And finally do some bookkeeping
 
-        claim_range(MAKE_NFO(ob_size, at_addr), false);
+        claim_range(MAKE_NFO(ob_size, at_addr), false, size_ndx);
 
         if(!IN_SAME_PAGE(cheri_getbase(current_field), at_addr)) {
             // The metadata node is in another page and so we place a second claim there
 
-            claim_range(MAKE_NFO(RES_META_SIZE, cheri_getbase(current_field)), false);
+            claim_range(MAKE_NFO(RES_META_SIZE, cheri_getbase(current_field)), false, size_ndx);
         }
 
         at_addr += ob_size;
 
         if(++total_ndx == total) {
             // Finished with entire slab
-            free_range(MAKE_NFO(meta_claim_end-meta_claim_current, meta_claim_current));
+            free_range(MAKE_NFO(meta_claim_end-meta_claim_current, meta_claim_current), size_ndx);
 
             current_field = nullptr;
         } else if(++current_ndx == RES_SUBFIELD_BITMAP_BITS) {
@@ -624,7 +868,7 @@ public:
 
         // We no longer need a claim for our metadata, can release
         if(current_field && (meta_claim_current != next_meta_claim)) {
-            free_range(MAKE_NFO(next_meta_claim-meta_claim_current, meta_claim_current));
+            free_range(MAKE_NFO(next_meta_claim-meta_claim_current, meta_claim_current), size_ndx);
             meta_claim_current = next_meta_claim;
         }
 
@@ -636,6 +880,7 @@ struct Arena {
     DLL_LINK(Arena);
 
     bool dma;
+    remote_queue_t* queue;
     Slab slabs[N_SLABS];
 
     res_t allocate_with_request(size_t size, size_t* dma_off, bool align) {
@@ -682,7 +927,7 @@ struct Arena {
 
 public:
 
-    constexpr Arena (bool is_dma) : next(nullptr), prev(nullptr), dma(is_dma) {}
+    constexpr Arena (bool is_dma) : next(nullptr), prev(nullptr), dma(is_dma), queue(nullptr) {}
 
     void setDma(bool is_dma) {
         dma = is_dma;
@@ -693,17 +938,29 @@ public:
     // Why not a destructor? Just thread-local things.
     void removeFromList();
 
+    void retire();
+
     res_t allocate(size_t size, size_t* dma_off, bool requires_split) {
 
+        if(queue == nullptr) {
+            queue = new_remote_queue(home());
+        } else if(queue->head != nullptr) {
+            drain_remote_frees(queue, nullptr);
+        }
+
+        CLASS_STAT_ADD(size_to_class(size), live, 1);
+
         if(requires_split || (size > BIG_OBJECT_THRESHOLD)) {
             return allocate_with_request(size, dma_off, !requires_split);
         }
 
         size_t size_ndx = size_to_ndx(size);
 
-        return slabs[size_ndx].allocate(size_ndx, dma, dma_off);
+        return slabs[size_ndx].allocate(size_ndx, dma, dma_off, queue);
     }
 
+private:
+    static void* home();
 };
 
 __thread Arena default_arena(0);
@@ -721,6 +978,26 @@ void Arena::removeFromList() {
     DLL_REMOVE(&arena_list, this);
 }
 
+void* Arena::home() {
+    return &arena_list;
+}
+
+void Arena::retire() {
+    if(queue) drain_remote_frees(queue, &remote_queue_retired);
+}
+
+static void free_local(capability mem, res_nfo_t nfo) {
+    size_t cls = size_to_class(nfo.length);
+
+    CLASS_STAT_ADD(cls, live, -1);
+
+    free_range(nfo, cls);
+
+    if((cheri_gettype(mem) == RES_TYPE) && !IN_SAME_PAGE(cheri_getbase(mem), nfo.base)) {
+        free_range(MAKE_NFO(RES_META_SIZE, cheri_getbase(mem)), cls);
+    }
+}
+
 __BEGIN_DECLS
 
 void init_cap_malloc(void) {
@@ -740,36 +1017,73 @@ void cap_free(capability mem) {
 
     if(nfo.length > BIG_OBJECT_THRESHOLD) {
         nfo = round_nfo_to_page(nfo);
-        mem_release(nfo.base, nfo.length, 1, own_mop);
+        CLASS_STAT_ADD(BIG_CLASS, live, -1);
+        release_now(nfo.base, nfo.length, BIG_CLASS);
         return;
     }
 
-    free_range(nfo);
+    remote_queue_t* owner = get_slab_owner(nfo.base);
 
-    if((cheri_gettype(mem) == RES_TYPE) && !IN_SAME_PAGE(cheri_getbase(mem), nfo.base)) {
-        free_range(MAKE_NFO(RES_META_SIZE, cheri_getbase(mem)));
+    if(owner && owner->home == (void*)&arena_list) {
+        // Freeing our own memory is as good a time as any to do what other threads queued for us
+        remote_free_t* head = owner->head;
+        if(head != nullptr && head != &remote_queue_retired) drain_remote_frees(owner, nullptr);
+    } else if(owner && push_remote_free(owner, mem)) return;
+
+    free_local(mem, nfo);
+}
+
+void cap_malloc_thread_exit(void) {
+    DLL_FOREACH(Arena, arena, &arena_list) {
+        arena->retire();
+    }
+    cap_malloc_flush();
+}
+
+void cap_malloc_flush(void) {
+    while(release_batch.n != 0) {
+        evict_class(release_batch.ranges[0].cls);
     }
 }
 
+void capmalloc_set_cache_limit(size_t size, size_t pages) {
+    cache_limits.pages[size_to_class(size)] = pages;
+}
+
+size_t capmalloc_get_stats(capmalloc_class_stats* out, size_t n) {
+    if(n > N_CLASSES) n = N_CLASSES;
+
+    for(size_t i = 0; i != n; i++) {
+        out[i] = *(capmalloc_class_stats*)&class_stats[i];
+        out[i].size = (i == BIG_CLASS) ? 0 : ndx_to_size(i);
+    }
+
+    return n;
+}
+
 VIS_EXTERNAL
 void cap_free_handle(res_t res) {
     res_nfo_t nfo = rescap_nfo(res);
     if(!IN_SAME_PAGE(cheri_getbase(res), nfo.base)) {
-        free_range(MAKE_NFO(RES_META_SIZE, cheri_getbase(res)));
+        free_range(MAKE_NFO(RES_META_SIZE, cheri_getbase(res)), size_to_class(nfo.length));
     }
 }
 
 VIS_EXTERNAL
 int cap_claim(capability mem) {
     res_nfo_t nfo = memhandle_nfo(mem);
+    size_t cls = size_to_class(nfo.length);
 
-    int res = claim_range(nfo, false);
+    int res = claim_range(nfo, false, cls);
 
     // Also claim the metadata if claim is called on reservation
     if(res == 0 && (cheri_gettype(mem) == RES_TYPE) && !IN_SAME_PAGE(cheri_getbase(mem), nfo.base)) {
-        res = claim_range(MAKE_NFO(RES_META_SIZE,cheri_getbase(mem)), false);
+        res = claim_range(MAKE_NFO(RES_META_SIZE,cheri_getbase(mem)), false, cls);
     }
 
+    // Each claim is matched by a free
+    if(res == 0) CLASS_STAT_ADD(cls, live, 1);
+
     return res;
 }
 
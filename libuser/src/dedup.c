@@ -44,7 +44,12 @@ static act_kt dedup_service = NULL;
 
 act_kt get_dedup(void) {
     if(dedup_service == NULL) {
-        dedup_service = namespace_get_ref(namespace_num_dedup_service);
+        act_kt service = namespace_get_ref(namespace_num_dedup_service);
+        if(service != NULL) {
+            // The service has a few workers. Stick with whichever one it gives us.
+            act_kt worker = (act_kt)message_send_c(0, 0, 0, 0, NULL, NULL, NULL, NULL, service, SYNC_CALL, 6);
+            dedup_service = worker ? worker : service;
+        }
     }
     return dedup_service;
 }
@@ -56,6 +61,8 @@ act_kt set_custom_dedup(act_kt dedup) {
 
 MESSAGE_WRAP_ID_ASSERT_ERRT(entry_t, deduplicate, (uint64_t*, data, size_t, length), dedup_service, 0, namespace_num_dedup_service)
 MESSAGE_WRAP_ID_ASSERT_ERRT(entry_t, deduplicate_dont_create, (uint64_t*, data, size_t, length), dedup_service, 2, namespace_num_dedup_service)
+MESSAGE_WRAP_ID_ASSERT(int, deduplicate_batch, (dedup_batch_item*, items, size_t, n, int, allow_create), dedup_service, 4, namespace_num_dedup_service)
+MESSAGE_WRAP_ID_ASSERT(int, deduplicate_index_stats, (dedup_index_stats*, out), dedup_service, 5, namespace_num_dedup_service)
 
 entry_t             deduplicate_find(sha256_hash hash) {
     act_kt serv = get_dedup();
@@ -63,6 +70,23 @@ entry_t             deduplicate_find(sha256_hash hash) {
             serv, SYNC_CALL, 1);
 }
 
+// Turns a found entry into a capability to use instead of resolve (which is offset bytes before the original cursor)
+static capability deduplicate_open_entry(entry_t entry, capability resolve, register_t perms, register_t length, register_t offset) {
+    capability open = foundation_entry_expose(entry);
+
+    assert(cheri_getlen(open) >= length);
+
+    __unused int res = memcmp(resolve, open, length);
+
+    assert(res == 0);
+
+    open = cheri_incoffset(open, offset);
+
+    open = cheri_andperm(open, perms);
+
+    return open;
+}
+
 capability deduplicate_cap(capability cap, int allow_create, register_t perms, register_t length, register_t offset) {
 
     if(get_dedup() == NULL) {
@@ -86,21 +110,7 @@ capability deduplicate_cap(capability cap, int allow_create, register_t perms, r
         return cap;
     }
 
-    entry_t entry = result.val;
-
-    capability open = foundation_entry_expose(entry);
-
-    assert(cheri_getlen(open) >= length);
-
-    open = cheri_incoffset(open, offset);
-
-    __unused int res = memcmp(resolve, open, length);
-
-    assert(res == 0);
-
-    open = cheri_andperm(open, perms);
-
-    return open;
+    return deduplicate_open_entry(result.val, resolve, perms, length, offset);
 }
 
 capability deduplicate_cap_precise(capability cap, int allow_create, register_t perms) {
@@ -127,6 +137,49 @@ capability deduplicate_cap_unaligned(capability cap, int allow_create, register_
 
 // TODO we should do a similar thing as compact and detect when relocations target the same object and re-derive
 
+typedef struct dedup_pending {
+    capability* loc;
+    register_t perms;
+    uint64_t ob_size;
+    uint64_t ob_off;
+    int isfunc;
+} dedup_pending;
+
+static void deduplicate_flush(dedup_stats* stats, int allow_create,
+                              dedup_batch_item* items, dedup_pending* pending, size_t n) {
+
+    if(n == 0 || get_dedup() == NULL) return;
+
+    __unused int er = deduplicate_batch(items, n, allow_create);
+
+    if(er != 0) {
+        printf("Deduplication error: %d. ac: %d. batch of %lx\n", er, allow_create, n);
+        assert(0);
+        return;
+    }
+
+    for(size_t i = 0; i != n; i++) {
+        dedup_pending* p = &pending[i];
+
+        if(items[i].result == NULL) continue;
+
+        capability res = deduplicate_open_entry(items[i].result, (capability)items[i].data,
+                                                p->perms, items[i].length, p->ob_off);
+        res = cheri_setbounds(res, p->ob_size);
+
+        if(p->isfunc) {
+            stats->of_which_func_replaced++;
+            stats->of_which_func_bytes_replaced += p->ob_size;
+        }
+        else {
+            stats->of_which_data_replaced++;
+            stats->of_which_data_bytes_replaced += p->ob_size;
+        }
+
+        *p->loc = res;
+    }
+}
+
 dedup_stats deduplicate_all_target(int allow_create, size_t ndx, capability* segment_table, struct capreloc* start, struct capreloc* end) {
 
     dedup_stats stats;
@@ -134,7 +187,14 @@ dedup_stats deduplicate_all_target(int allow_create, size_t ndx, capability* seg
 
 #define ALIGN_COPY_SIZE 0x4000
 
+    // Objects are sent to the dedup service DEDUP_BATCH_MAX at a time. Misaligned ones are copied into buffer, which
+    // then has to live until the batch is flushed.
     uint64_t buffer[ALIGN_COPY_SIZE/sizeof(uint64_t)];
+    size_t buffer_used = 0;
+
+    dedup_batch_item items[DEDUP_BATCH_MAX];
+    dedup_pending pending[DEDUP_BATCH_MAX];
+    size_t n_pending = 0;
 
     for(struct capreloc* reloc = start; reloc != end; reloc++) {
 
@@ -161,16 +221,26 @@ dedup_stats deduplicate_all_target(int allow_create, size_t ndx, capability* seg
         int isfunc = ((((size_t)to_dedup) & 0x3) == 0) && (ob_off == 0) && ((ob_size & 0x3) == 0);
 
         uint64_t size_to_dedup = ob_size;
+        uint64_t* resolve;
 
         if(bad_align) {
             if(ob_size > ALIGN_COPY_SIZE) {
                 stats.too_large++;
                 continue;
             }
-            buffer[ob_size/8] = 0; // Pad out the last few (up to 8) bytes with zeros
-            memcpy(buffer, cheri_incoffset(to_dedup, -ob_off), ob_size); // Fill in the bytes to dedup
             size_to_dedup = (ob_size+7) & ~7;
-            to_dedup = cheri_incoffset(cheri_setbounds(buffer, size_to_dedup), ob_off);
+            if(buffer_used + size_to_dedup > ALIGN_COPY_SIZE) {
+                deduplicate_flush(&stats, allow_create, items, pending, n_pending);
+                n_pending = 0;
+                buffer_used = 0;
+            }
+            uint64_t* copy = buffer + (buffer_used / sizeof(uint64_t));
+            copy[ob_size/8] = 0; // Pad out the last few (up to 8) bytes with zeros
+            memcpy(copy, cheri_incoffset(to_dedup, -ob_off), ob_size); // Fill in the bytes to dedup
+            buffer_used += size_to_dedup;
+            resolve = cheri_setbounds(copy, size_to_dedup);
+        } else {
+            resolve = (uint64_t*)cheri_incoffset(to_dedup, -ob_off);
         }
 
         if(isfunc) {
@@ -182,23 +252,24 @@ dedup_stats deduplicate_all_target(int allow_create, size_t ndx, capability* seg
             stats.of_which_data_bytes += ob_size;
         }
 
-        capability res = deduplicate_cap((capability)to_dedup, allow_create, has_perms, size_to_dedup, ob_off);
-
-        if(res != to_dedup) {
-            res = cheri_setbounds(res, ob_size);
-            if(isfunc) {
-                stats.of_which_func_replaced++;
-                stats.of_which_func_bytes_replaced += ob_size;
-            }
-            else {
-                stats.of_which_data_replaced++;
-                stats.of_which_data_bytes_replaced += ob_size;
-            }
-
-            *loc = res;
+        items[n_pending].data = resolve;
+        items[n_pending].length = size_to_dedup;
+        items[n_pending].result = NULL;
+        pending[n_pending].loc = loc;
+        pending[n_pending].perms = has_perms;
+        pending[n_pending].ob_size = ob_size;
+        pending[n_pending].ob_off = ob_off;
+        pending[n_pending].isfunc = isfunc;
+
+        if(++n_pending == DEDUP_BATCH_MAX) {
+            deduplicate_flush(&stats, allow_create, items, pending, n_pending);
+            n_pending = 0;
+            buffer_used = 0;
         }
     }
 
+    deduplicate_flush(&stats, allow_create, items, pending, n_pending);
+
     return stats;
 }
 
@@ -35,6 +35,9 @@
 #include "assert.h"
 #include "stdio.h"
 #include "capmalloc.h"
+#include "namespace.h"
+#include "string.h"
+#include "spinlock.h"
 
 act_kt namespace_ref = NULL;
 
@@ -47,9 +50,84 @@ void namespace_init(act_kt ns_ref) {
 }
 
 MESSAGE_WRAP(int, namespace_register, (int, nb, act_kt, ref), namespace_ref, 0)
-MESSAGE_WRAP(act_kt, namespace_get_ref, (int, nb), namespace_ref, 1)
 MESSAGE_WRAP(int, namespace_register_found_id, (cert_t, cert), namespace_ref, 4)
 MESSAGE_WRAP(found_id_t*, namespace_get_found_id, (int, nb), namespace_ref, 3)
 MESSAGE_WRAP_DEF(int, namespace_get_num_services, (void), namespace_ref, 2, -1)
 MESSAGE_WRAP_DEF(int, namespace_register_name, (const char*, name, act_kt, ref), namespace_ref, 5, -1)
-MESSAGE_WRAP_DEF(act_kt, namespace_get_ref_by_name, (const char*, name), namespace_ref, 6, NULL)
+MESSAGE_WRAP_DEF(int, namespace_register_instance, (int, nb, act_kt, ref, int, policy, capability, key),
+                 namespace_ref, 7, -1)
+MESSAGE_WRAP_DEF(int, namespace_register_name_instance, (const char*, name, act_kt, ref, int, policy, capability, key),
+                 namespace_ref, 8, -1)
+MESSAGE_WRAP_DEF(int, namespace_report_load, (int, nb, const char*, name, act_kt, ref, size_t, load, capability, key),
+                 namespace_ref, 9, -1)
+MESSAGE_WRAP_DEF(int, namespace_watch_registrations, (act_notify_kt, waiter, int, watch), namespace_ref, 10, -1)
+static MESSAGE_WRAP_DEF(act_kt, namespace_lookup_ipc, (int, nb, const char*, name, int*, joinable), namespace_ref, 11,
+                        NULL)
+
+/* Services never leave the namespace, so once we have been handed the only instance of one we keep using it.
+ * Groups are looked up every time, otherwise each process would stick to whichever instance it was handed first and
+ * least-loaded picks would never happen. */
+
+#define REF_CACHE_NUMS      0x80
+#define NAME_CACHE_SLOTS    0x10
+#define NAME_CACHE_LENGTH   0x30
+
+typedef struct {
+    char name[NAME_CACHE_LENGTH];
+    act_kt ref;
+} name_cache_t;
+
+static act_kt ref_cache[REF_CACHE_NUMS];
+static name_cache_t name_cache[NAME_CACHE_SLOTS];
+static spinlock_t name_cache_lock;
+
+act_kt namespace_get_ref(int nb) {
+    int cacheable = nb >= 0 && nb < REF_CACHE_NUMS;
+
+    if(cacheable && ref_cache[nb] != NULL) return ref_cache[nb];
+
+    _unsafe int joinable = 1;
+    act_kt ref = namespace_lookup_ipc(nb, NULL, &joinable);
+
+    if(cacheable && ref != NULL && !joinable) ref_cache[nb] = ref;
+
+    return ref;
+}
+
+static name_cache_t* name_cache_slot(const char* name) {
+    size_t h = 0;
+    for(size_t i = 0; i != NAME_CACHE_LENGTH && name[i] != '\0'; i++) {
+        h = (h * 31) + (unsigned char)name[i];
+    }
+    return &name_cache[h & (NAME_CACHE_SLOTS-1)];
+}
+
+act_kt namespace_get_ref_by_name(const char* name) {
+    name_cache_t* slot = name_cache_slot(name);
+    act_kt ref = NULL;
+
+    spinlock_acquire(&name_cache_lock);
+    if(slot->ref != NULL && strncmp(slot->name, name, NAME_CACHE_LENGTH) == 0) ref = slot->ref;
+    spinlock_release(&name_cache_lock);
+
+    if(ref != NULL) return ref;
+
+    _unsafe int joinable = 1;
+    ref = namespace_lookup_ipc(-1, name, &joinable);
+
+    if(ref != NULL && !joinable && strlen(name) < NAME_CACHE_LENGTH) {
+        spinlock_acquire(&name_cache_lock);
+        strncpy(slot->name, name, NAME_CACHE_LENGTH);
+        slot->ref = ref;
+        spinlock_release(&name_cache_lock);
+    }
+
+    return ref;
+}
+
+void namespace_flush_cache(void) {
+    spinlock_acquire(&name_cache_lock);
+    bzero(ref_cache, sizeof(ref_cache));
+    bzero(name_cache, sizeof(name_cache));
+    spinlock_release(&name_cache_lock);
+}
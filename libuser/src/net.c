@@ -35,6 +35,7 @@
 #include "assert.h"
 #include "stdlib.h"
 #include "namespace.h"
+#include "string.h"
 
 act_kt net_act;
 act_kt net_try_get_ref(void) {
@@ -73,12 +74,20 @@ buffered_requesters_t* make_backlog_buffer(uint8_t backlog) {
     return bf;
 }
 
+int netsock_get_rx_stats(net_rx_stats* out) {
+    act_kt act = net_try_get_ref();
+    if(act == NULL) return -1;
+    message_send(0, 0, 0, 0, out, NULL, NULL, NULL, act, SYNC_CALL, 7);
+    return 0;
+}
+
 listening_token_or_er_t netsock_listen_tcp(struct tcp_bind* bind, uint8_t backlog,
-                       capability callback_arg, buffered_requesters_t* bufferedRequesters) {
+                       capability callback_arg, buffered_requesters_t* bufferedRequesters,
+                       enum netsock_listen_flags flags) {
     act_kt act = net_try_get_ref();
     assert(act != NULL);
 
-    capability res = message_send_c(MARSHALL_ARGUMENTS(bind, bufferedRequesters, act_self_ref, callback_arg, backlog, TCP_CALLBACK_PORT), act, SYNC_CALL, 1);
+    capability res = message_send_c(MARSHALL_ARGUMENTS(bind, bufferedRequesters, act_self_ref, callback_arg, backlog, TCP_CALLBACK_PORT, flags), act, SYNC_CALL, 1);
     return MAKE_VALID(listening_token, res);
 }
 
@@ -87,6 +96,21 @@ void netsock_stop_listen(listening_token token) {
     return;
 }
 
+capability netsock_listen_group_token(listening_token token) {
+    act_kt act = net_try_get_ref();
+    assert(act != NULL);
+    return message_send_c(0, 0, 0, 0, token, NULL, NULL, NULL, act, SYNC_CALL, 8);
+}
+
+listening_token_or_er_t netsock_join_tcp(capability group_token, uint8_t backlog,
+                                         capability callback_arg, buffered_requesters_t* bufferedRequesters) {
+    act_kt act = net_try_get_ref();
+    assert(act != NULL);
+
+    capability res = message_send_c(MARSHALL_ARGUMENTS(group_token, bufferedRequesters, act_self_ref, callback_arg, backlog, TCP_CALLBACK_PORT), act, SYNC_CALL, 9);
+    return MAKE_VALID(listening_token, res);
+}
+
 int netsock_connect_tcp(struct tcp_bind* bind, struct tcp_bind* server,
                         capability callback_arg) {
     act_kt act = net_try_get_ref();
@@ -194,6 +218,19 @@ NET_SOCK netsock_accept(enum SOCKET_FLAGS flags) {
     return netsock_accept_in(flags, NULL);
 }
 
+size_t netsock_accept_batch(enum SOCKET_FLAGS flags, NET_SOCK* out, size_t max) {
+    size_t n = 0;
+
+    while(n != max) {
+        NET_SOCK ns = netsock_accept_in(n == 0 ? flags : (flags | MSG_DONT_WAIT), NULL);
+        // A rejected connection still used up a message, so only stop when the queue is empty
+        if(ns != NULL) out[n++] = ns;
+        else if(msg_queue_empty()) break;
+    }
+
+    return n;
+}
+
 struct hostent_names {
     struct hostent he;
     char* aliases[1];        // Always set to null, no aliases
@@ -253,6 +290,7 @@ ERROR_T(unix_net_sock_ptr) socket_or_er(__unused int domain, __unused int type,
     fulfiller_t fulfiller = socket_malloc_fulfiller(SOCK_TYPE_PUSH);
 
     uns->sock.read.push_reader = fulfiller;
+    uns->listen_flags = NETSOCK_LISTEN_NONE;
 
     ssize_t  ret = socket_init(&uns->sock, MSG_NONE, NULL, 0, CONNECT_PUSH_READ);
 
@@ -309,11 +347,73 @@ static enum poll_events poll_listen(unix_like_socket* sock, enum poll_events ask
     return POLL_NONE;
 }
 
+int setsockopt(unix_net_sock* sockfd, int level, int optname, const void *optval, socklen_t optlen) {
+    if(level != SOL_SOCKET || optval == NULL || optlen < sizeof(int)) return -1;
+
+    int on = *(const int*)optval;
+
+    switch(optname) {
+        case SO_REUSEPORT:
+            if(sockfd->token != NULL) return -1; // Too late, the port has already been bound
+            if(on) sockfd->listen_flags |= NETSOCK_LISTEN_REUSEPORT;
+            else sockfd->listen_flags &= ~NETSOCK_LISTEN_REUSEPORT;
+            return 0;
+        case SO_REUSEADDR:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+// Ports this process is sharing between its own SO_REUSEPORT sockets, and the token to join each
+typedef struct reuseport_group {
+    struct tcp_bind bind;
+    capability group_token;
+    struct reuseport_group* next;
+} reuseport_group;
+
+static reuseport_group* reuseport_groups = NULL;
+
+static reuseport_group* find_reuseport_group(struct tcp_bind* bind) {
+    for(reuseport_group* g = reuseport_groups; g != NULL; g = g->next) {
+        if(g->bind.port == bind->port && ip_addr_cmp(&g->bind.addr, &bind->addr)) return g;
+    }
+    return NULL;
+}
+
+static listening_token_or_er_t listen_reuseport(unix_net_sock* sockfd, uint8_t backlog,
+                                                buffered_requesters_t* bufferedRequesters) {
+    reuseport_group* group = find_reuseport_group(&sockfd->bind);
+
+    if(group != NULL) {
+        listening_token_or_er_t res = netsock_join_tcp(group->group_token, backlog, sockfd, bufferedRequesters);
+        // If every socket in the group has closed, the token is no good and we start a new one
+        if(IS_VALID(res) || res.er != ERR_ARG) return res;
+    }
+
+    listening_token_or_er_t res = netsock_listen_tcp(&sockfd->bind, backlog, sockfd, bufferedRequesters,
+                                                     NETSOCK_LISTEN_REUSEPORT);
+    if(!IS_VALID(res)) return res;
+
+    if(group == NULL) {
+        group = (reuseport_group*)malloc(sizeof(reuseport_group));
+        group->bind = sockfd->bind;
+        group->next = reuseport_groups;
+        reuseport_groups = group;
+    }
+
+    group->group_token = netsock_listen_group_token(res.val);
+
+    return res;
+}
+
 int listen(unix_net_sock* sockfd, int backlog) {
     if(sockfd->token != NULL) return -1; // We don't support changing the backlog via calling listen twice
     buffered_requesters_t* bufferedRequesters = make_backlog_buffer(backlog);
     sockfd->backlog_requesters = bufferedRequesters;
-    listening_token_or_er_t res = netsock_listen_tcp(&sockfd->bind, backlog, sockfd, bufferedRequesters);
+    listening_token_or_er_t res = (sockfd->listen_flags & NETSOCK_LISTEN_REUSEPORT) ?
+            listen_reuseport(sockfd, backlog, bufferedRequesters) :
+            netsock_listen_tcp(&sockfd->bind, backlog, sockfd, bufferedRequesters, NETSOCK_LISTEN_NONE);
     assert(res.val != NULL);
     if(!IS_VALID(res)) return res.er;
     sockfd->sock.custom_close = (close_fun*)&close_listen;
@@ -423,21 +523,48 @@ NET_SOCK accept(unix_net_sock* sockfd, struct sockaddr *addr, socklen_t *addrlen
     return accept4(sockfd, addr, addrlen, MSG_NONE);
 }
 
+static void accept_finish(NET_SOCK ns, int flags) {
+    if((flags ^ ns->sock.flags) & SOCKF_GIVE_SOCK_N) {
+        assign_socket_n(&ns->sock);
+    }
+}
+
 NET_SOCK accept4(unix_net_sock* sockfd, struct sockaddr *addr, __unused socklen_t *addrlen, int flags) {
 
     NET_SOCK ns = accept_until_correct(sockfd, (sockfd->sock.flags | flags) & MSG_DONT_WAIT);
 
     if(!ns) return NULL;
 
+    accept_finish(ns, flags | sockfd->sock.flags);
+
+    if(addr) bind_to_sockaddr(addr, &ns->bind);
+
+    return ns;
+}
+
+ssize_t accept_batch(unix_net_sock* sockfd, NET_SOCK* out, size_t max, int flags) {
+    if(max == 0) return 0;
+
     flags |= sockfd->sock.flags;
 
-    if((flags ^ ns->sock.flags) & SOCKF_GIVE_SOCK_N) {
-        assign_socket_n(&ns->sock);
+    NET_SOCK ns = accept_until_correct(sockfd, flags & MSG_DONT_WAIT);
+
+    if(!ns) return -1;
+
+    size_t n = 0;
+    out[n++] = ns;
+
+    // Move everything else that has arrived onto the wait lists, then take as many of ours as will fit
+    empty_accept_queue();
+
+    while(n != max && (ns = sockfd->next_to_accept) != NULL) {
+        sockfd->next_to_accept = ns->next_to_accept;
+        out[n++] = ns;
     }
 
-    if(addr) bind_to_sockaddr(addr, &ns->bind);
+    for(size_t i = 0; i != n; i++) accept_finish(out[i], flags);
 
-    return ns;
+    return (ssize_t)n;
 }
 
 ssize_t shutdown(NET_SOCK sockfd, int how) {
@@ -478,3 +605,201 @@ ssize_t shutdown(NET_SOCK sockfd, int how) {
 
     return -1;
 }
+
+UDP_SOCK udp_socket(struct tcp_bind* bind) {
+    act_kt act = net_try_get_ref();
+    if(act == NULL) return NULL;
+
+    udp_sock* us = (udp_sock*)malloc(sizeof(udp_sock));
+
+    if(us == NULL) return NULL;
+
+    requester_t out = socket_malloc_requester_32(SOCK_TYPE_PUSH, NULL);
+    fulfiller_t in = socket_malloc_fulfiller(SOCK_TYPE_PUSH);
+
+    if(out == NULL || in == NULL) {
+        if(out) free(out);
+        if(in) free(in);
+        free(us);
+        return NULL;
+    }
+
+    requester_t lwip_out = (requester_t)message_send_c(MARSHALL_ARGUMENTS(bind, socket_make_ref_for_fulfill(out)),
+                                                       act, SYNC_CALL, 6);
+
+    if(lwip_out == NULL) {
+        free(out);
+        free(in);
+        free(us);
+        return NULL;
+    }
+
+    socket_requester_connect(out);
+    socket_fulfiller_connect(in, lwip_out);
+
+    // Datagrams are never copied into a data buffer, sends instead wait for lwip once per batch
+    __unused int res = socket_init(&us->sock, MSG_NO_COPY_WRITE, NULL, 0, CONNECT_PUSH_READ | CONNECT_PUSH_WRITE);
+    assert_int_ex(res, ==, 0);
+
+    us->sock.read.push_reader = in;
+    us->sock.write.push_writer = out;
+    us->bind = *bind;
+
+    return us;
+}
+
+ssize_t udp_close(UDP_SOCK us) {
+    fulfiller_t in = us->sock.read.push_reader;
+    requester_t out = us->sock.write.push_writer;
+
+    // lwip frees the requester this fulfills as part of its close, so this end goes first
+    socket_close_fulfiller(in, 0, 0);
+
+    /* lwip keeps using our requester until it closes its fulfiller, which also ends this wait. It never finishes the
+     * close request, so a wait that returns anything else has not seen lwip close and nothing can be freed. */
+    ssize_t res = socket_requester_space_wait(out, 1, 0, 0);
+
+    if(res == 0) {
+        socket_request_oob(out, REQUEST_CLOSE, (intptr_t)NULL, 0, 0);
+        res = socket_requester_space_wait(out, SPACE_AMOUNT_ALL, 0, 0);
+    }
+
+    if(res != E_SOCKET_CLOSED) return (res < 0) ? res : E_AGAIN;
+
+    free(in);
+    free(out);
+    free(us);
+    return 0;
+}
+
+ssize_t udp_sendmmsg(UDP_SOCK us, struct udp_msg* msgs, size_t n) {
+    requester_t out = us->sock.write.push_writer;
+
+    intptr_t tags[UDP_BATCH_MAX];
+    socket_iovec iov[UDP_BATCH_MAX];
+
+    size_t sent = 0;
+    ssize_t res = 0;
+
+    while(sent != n) {
+        uint16_t batch = (n - sent) > UDP_BATCH_MAX ? UDP_BATCH_MAX : (uint16_t)(n - sent);
+
+        for(uint16_t i = 0; i != batch; i++) {
+            struct udp_msg* msg = &msgs[sent + i];
+            if(msg->buf_len > UDP_MAX_DGRAM) return sent ? (ssize_t)sent : E_MSG_SIZE;
+            tags[i] = UDP_TAG(msg->addr.addr.addr, msg->addr.port, msg->buf_len);
+            iov[i].base = msg->buf;
+            iov[i].length = msg->buf_len;
+        }
+
+        res = socket_requester_space_wait(out, 2 * batch, 0, 0);
+        if(res < 0) break;
+
+        res = socket_request_oob_ind_vec(out, REQUEST_UDP_DGRAM, tags, iov, batch, 0);
+        if(res < 0) break;
+
+        // The buffers belong to the caller again once lwip has copied them out
+        res = socket_requester_wait_all_finish(out, 0);
+        if(res < 0) break;
+
+        sent += batch;
+    }
+
+    return (sent == 0 && res < 0) ? res : (ssize_t)sent;
+}
+
+struct udp_recv_state {
+    struct udp_msg* msgs;
+    size_t n;
+    size_t got;
+    size_t copied;
+};
+
+ssize_t TRUSTED_CROSS_DOMAIN(udp_ful_copy)(capability arg, char* buf, uint64_t offset, uint64_t length);
+__used ssize_t udp_ful_copy(capability arg, char* buf, __unused uint64_t offset, uint64_t length) {
+    struct udp_recv_state* state = (struct udp_recv_state*)arg;
+
+    if(state->got != 0) {
+        struct udp_msg* msg = &state->msgs[state->got - 1];
+        if(state->copied < msg->buf_len) {
+            size_t to_copy = msg->buf_len - state->copied;
+            if(to_copy > length) to_copy = length;
+            memcpy(msg->buf + state->copied, buf, to_copy);
+        }
+        state->copied += length;
+    }
+
+    // Anything that does not fit is dropped, as with recvmmsg
+    return length;
+}
+
+ssize_t TRUSTED_CROSS_DOMAIN(udp_ful_oob)(capability arg, request_t* request, uint64_t offset, uint64_t partial_bytes, uint64_t length);
+__used ssize_t udp_ful_oob(capability arg, request_t* request, __unused uint64_t offset,
+                           __unused uint64_t partial_bytes, uint64_t length) {
+    struct udp_recv_state* state = (struct udp_recv_state*)arg;
+
+    if(request->type != REQUEST_UDP_DGRAM) return length;
+
+    // Stop at the start of a datagram there is no room for. It is left for the next call.
+    if(state->got == state->n) return E_AGAIN;
+
+    struct udp_msg* msg = &state->msgs[state->got++];
+    intptr_t tag = request->request.oob;
+    msg->addr.addr.addr = UDP_TAG_ADDR(tag);
+    msg->addr.port = UDP_TAG_PORT(tag);
+    msg->dgram_len = UDP_TAG_LEN(tag);
+    state->copied = 0;
+
+    return length;
+}
+
+ssize_t udp_recvmmsg(UDP_SOCK us, struct udp_msg* msgs, size_t n, enum SOCKET_FLAGS flags) {
+    fulfiller_t in = us->sock.read.push_reader;
+
+    struct udp_recv_state state;
+    state.msgs = msgs;
+    state.n = n;
+    state.got = 0;
+    state.copied = 0;
+
+    if(n == 0) return 0;
+
+    while(1) {
+        // Take everything already queued (up to n datagrams), but never wait part way through a batch
+        ssize_t res = socket_fulfill_progress_bytes_unauthorised(in, SOCK_INF, F_CHECK | F_PROGRESS | F_DONT_WAIT,
+                                                                 &TRUSTED_CROSS_DOMAIN(udp_ful_copy), (capability)&state, 0,
+                                                                 &TRUSTED_CROSS_DOMAIN(udp_ful_oob), NULL,
+                                                                 TRUSTED_DATA, TRUSTED_DATA);
+
+        if(state.got != 0) {
+            // The last datagram may have been empty, in which case its data was never visited
+            return (ssize_t)state.got;
+        }
+
+        if(res < 0 && res != E_AGAIN) return res;
+
+        if(flags & MSG_DONT_WAIT) return E_AGAIN;
+
+        res = socket_fulfiller_outstanding_wait(in, 1, 0, 0);
+        if(res < 0) return res;
+    }
+}
+
+ssize_t udp_sendto(UDP_SOCK us, const char* buf, size_t length, struct tcp_bind* to) {
+    struct udp_msg msg;
+    msg.addr = *to;
+    msg.buf = __DECONST(char*, buf);
+    msg.buf_len = length;
+    ssize_t res = udp_sendmmsg(us, &msg, 1);
+    return (res == 1) ? (ssize_t)length : res;
+}
+
+ssize_t udp_recvfrom(UDP_SOCK us, char* buf, size_t length, struct tcp_bind* from, enum SOCKET_FLAGS flags) {
+    struct udp_msg msg;
+    msg.buf = buf;
+    msg.buf_len = length;
+    ssize_t res = udp_recvmmsg(us, &msg, 1, flags);
+    if(res != 1) return res;
+    if(from) *from = msg.addr;
+    return (ssize_t)((msg.dgram_len < length) ? msg.dgram_len : length);
+}
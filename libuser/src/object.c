@@ -202,6 +202,8 @@ void object_init(act_control_kt self_ctrl, queue_t * queue,
         thread_init();
     }
 
+    temporal_thread_start();
+
     // This creates two sockets with the UART driver and sets stdout/stderr to them
 #ifndef USE_SYSCALL_PUTS
 
@@ -216,7 +218,8 @@ void object_init(act_control_kt self_ctrl, queue_t * queue,
 
     int res;
 
-    int flags = MSG_NO_CAPS | SOCKF_DRB_INLINE | SOCKF_SOCK_INLINE;
+    // The console service never makes writers wait, so output only backs up here if it is far behind. Drop then too.
+    int flags = MSG_NO_CAPS | SOCKF_DRB_INLINE | SOCKF_SOCK_INLINE | SOCKF_DROP_IF_FULL;
 
 #define MAKE_STD_SOCK(S,IPC_NO)                                                                                 \
         S.sock.write.push_writer = socket_malloc_requester_32(SOCK_TYPE_PUSH, &S.sock.write_copy_buffer);       \
@@ -273,6 +276,10 @@ void object_init_post_compact(startup_flags_e startup_flags, __unused int first_
     setup_temporal_handle(startup_flags);
     setup_unaligned_handle(startup_flags);
     init_kernel_if_t_change_mode(was_secure_loaded ? plt_common_untrusting: &plt_common_complete_trusting);
+#if !(UNSAFE_STACKS_OFF) && !defined(LIB_EARLY)
+    // Early processes may be running before the proc manager, they replace stacks without a worker
+    if(first_thread && !(startup_flags & (STARTUP_NO_EXCEPTIONS | STARTUP_NO_THREADS))) temporal_start_worker();
+#endif
 #else
     (void)startup_flags;
 #endif // !LIGHTWEIGHT
@@ -299,6 +306,8 @@ void object_destroy() {
         flush_file(stderr);
     #endif
     process_async_closes(1);
+    temporal_thread_exit();
+    cap_malloc_thread_exit();
 #endif // !LIGHTWEIGHT
     syscall_act_terminate(act_self_ctrl);
 
@@ -122,7 +122,12 @@ int fputc(int character, FILE *f) {
     data_ring_buffer* drb = &f->write_copy_buffer;
 
     if(drb->requeste_ptr + drb->partial_length - drb->fulfill_ptr == drb->buffer_size) {
-        // FIXME: This disrespects the DONT_WAIT flag
+        if(f->flags & SOCKF_DROP_IF_FULL) {
+            // The reader has not caught up. Rather than stall until it does, lose this character.
+            f->dropped++;
+            return character;
+        }
+        if(f->flags & MSG_DONT_WAIT) return EOF;
         __unused ssize_t bw = socket_requester_wait_all_finish(f->write.push_writer, 0);
         assert_int_ex(-bw, ==, 0);
     }
@@ -144,13 +149,13 @@ int putchar(int character)
     return fputc(character, stdout);
 }
 
-//FIXME: it only works because be know fputc does not fail
+// fputc only fails on a MSG_DONT_WAIT socket that is full. The part of a block written before then is not taken back.
 size_t fwrite(const void *ptr, size_t size, size_t count, FILE *f)
 {
     const char *cptr = (const char *) ptr;
     for (size_t block=0; block<count; block++) {
         for (size_t i=0; i<size; i++) {
-            fputc(cptr[block*size + i], f);
+            if(fputc((unsigned char)cptr[block*size + i], f) == EOF) return block;
         }
     }
     return count;
@@ -0,0 +1,84 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "pthread.h"
+#include "errno.h"
+#include "spinlock.h"
+
+int pthread_barrier_init(pthread_barrier_t *barrier, __unused const pthread_barrierattr_t *attr, unsigned count) {
+    if(count == 0) return EINVAL;
+    spinlock_init(&barrier->lock);
+    barrier->count = count;
+    barrier->waiting = 0;
+    barrier->head = NULL;
+    barrier->tail = NULL;
+    return 0;
+}
+
+int pthread_barrier_destroy(pthread_barrier_t *barrier) {
+    if(barrier->waiting) return EBUSY;
+    return 0;
+}
+
+int pthread_barrier_wait(pthread_barrier_t *barrier) {
+    spinlock_acquire(&barrier->lock);
+
+    if(++barrier->waiting == barrier->count) {
+        // Last to arrive. Take everyone else and reset for the next round.
+        notify_queue_t* wake = barrier->head;
+        barrier->head = NULL;
+        barrier->tail = NULL;
+        barrier->waiting = 0;
+
+        spinlock_release(&barrier->lock);
+
+        while(wake) {
+            notify_queue_t* next = wake->next;
+            act_notify_kt notify = wake->notify_me;
+            wake->granted = 1;
+            syscall_cond_notify(notify);
+            wake = next;
+        }
+
+        return PTHREAD_BARRIER_SERIAL_THREAD;
+    }
+
+    notify_queue_t* link = &own_link;
+    link->notify_me = act_self_notify_ref;
+    notify_queue_push(&barrier->head, &barrier->tail, link);
+
+    spinlock_release(&barrier->lock);
+
+    while(!link->granted) {
+        syscall_cond_wait(0, 0);
+    }
+
+    return 0;
+}
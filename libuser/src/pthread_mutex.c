@@ -32,20 +32,32 @@
 #include "errno.h"
 #include "atomic.h"
 #include "assert.h"
+#include "spinlock.h"
 
 // A thread can only be waiting on a single mutex, so allocate space for the chain here
 
 __thread notify_queue_t own_link;
 
 int pthread_mutex_init(pthread_mutex_t *mutex, __unused const pthread_mutexattr_t *attr) {
+    spinlock_init(&mutex->queue_lock);
+    mutex->head = NULL;
+    mutex->tail = NULL;
     mutex->owner_id = 0;
     mutex->lock_count = 0;
-    mutex->head = NULL;
+    mutex->spin_estimate = 0;
     return 0;
 }
 
-int pthread_mutex_destroy(__unused pthread_mutex_t *mutex) {
-    // nop
+int pthread_mutex_destroy(pthread_mutex_t *mutex) {
+    if(mutex->owner_id || mutex->head) return EBUSY;
+    return 0;
+}
+
+static inline int try_claim(pthread_mutex_t *mutex, uint64_t own_id) {
+    if(ATOMIC_CAS_RV(&mutex->owner_id, 64, 0, own_id)) {
+        mutex->lock_count = 1;
+        return 1;
+    }
     return 0;
 }
 
@@ -64,97 +76,84 @@ int pthread_mutex_trylock(pthread_mutex_t *mutex) {
 
     if(mutex->owner_id) return EBUSY;
 
-    int result;
+    return try_claim(mutex, own_id) ? 0 : EBUSY;
+}
 
-    // Claim ownership
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
 
-    result = ATOMIC_CAS_RV(&mutex->owner_id, 64, 0, own_id);
+    uint64_t own_id = (uint64_t)act_self_notify_ref;
 
-    // If this works fill in other fields
+    // Handle recursion
 
-    if(result) {
-        mutex->lock_count = 1;
+    if (mutex->owner_id == own_id) {
+        mutex->lock_count++;
         return 0;
     }
 
-    return EBUSY;
-}
-
-int pthread_mutex_lock(pthread_mutex_t *mutex) {
-
-    // Handle recursion
+    if (mutex->owner_id == 0 && try_claim(mutex, own_id)) return 0;
 
-    do {
+    // Spin for a bit. Owners are usually only briefly in their critical section, and sleeping costs two syscalls.
+    // Ownership is handed over directly if there are waiters, so owner_id is only ever 0 if the queue is empty
+    // and spinning here never jumps the queue.
 
-        uint64_t own_id = (uint64_t)act_self_notify_ref;
+    uint16_t max_spin = (mutex->spin_estimate * 2) + PTHREAD_MUTEX_SPIN_MIN;
+    if(max_spin > PTHREAD_MUTEX_SPIN_MAX) max_spin = PTHREAD_MUTEX_SPIN_MAX;
 
-        if (mutex->owner_id == own_id) {
-            mutex->lock_count++;
+    for(uint16_t spins = 0; spins != max_spin; spins++) {
+        if (mutex->owner_id == 0 && try_claim(mutex, own_id)) {
+            mutex->spin_estimate += (int16_t)(spins - mutex->spin_estimate) / 8;
             return 0;
         }
+        HW_SYNC;
+    }
 
-        while (mutex->owner_id == 0) {
-            if (pthread_mutex_trylock(mutex) == 0) return 0;
-        }
-
-        // Tentatively, the mutex is locked. Add self to queue.
+    // Missed. Decay towards spinning the max so we try harder next time.
+    mutex->spin_estimate += (int16_t)(max_spin - mutex->spin_estimate) / 8;
 
-        notify_queue_t *link = &own_link;
-        link->notify_me = act_self_notify_ref;
+    // Join the back of the queue. The mutex may have been released since we last looked, check under the queue lock.
+    // Unlock pops under the same lock, so either we see owner_id == 0 or the unlocker sees us.
 
-        int result;
+    notify_queue_t *link = &own_link;
+    link->notify_me = act_self_notify_ref;
 
-        do {
-            notify_queue_t *old = mutex->head;
-            link->next = old;
-            result = ATOMIC_CAS_RV(&mutex->head, c, old, link);
-        } while (result == 0);
+    spinlock_acquire(&mutex->queue_lock);
 
-        // We are now in the queue, if the mutex is subsequently unlocked we will be woken.
-        // However, the mutex may ALREADY have been freed, and if we are the head, we should remove ourself and try again.
+    if (mutex->owner_id == 0 && try_claim(mutex, own_id)) {
+        spinlock_release(&mutex->queue_lock);
+        return 0;
+    }
 
-        notify_queue_t *head_copy = mutex->head;
+    notify_queue_push(&mutex->head, &mutex->tail, link);
 
-        if (mutex->owner_id == 0 && head_copy == link) {
-            notify_queue_t *next = link->next;
-            result = ATOMIC_CAS_RV(&mutex->head, c, link, next);
-            if (result) continue; // Removed self from head
-            // Otherwise we are either deeper in the queue or something else removed us.
-        }
+    spinlock_release(&mutex->queue_lock);
 
-        while(mutex->owner_id != own_id) {
-            syscall_cond_wait(0, 0);
-        }
+    // The unlocker sets owner_id to us before notifying. Notifies are not lost if they arrive before we wait.
+    while(mutex->owner_id != own_id) {
+        syscall_cond_wait(0, 0);
+    }
 
-    } while(1);
+    mutex->lock_count = 1;
 
+    return 0;
 }
 
-
-
 int pthread_mutex_unlock(pthread_mutex_t * mutex) {
     assert(mutex->owner_id == (uint64_t)act_self_notify_ref);
 
     if(--mutex->lock_count == 0) {
-        // Try POP
-        notify_queue_t* hd_copy = mutex->head;
 
         act_notify_kt next_owner = NULL;
 
-        while(hd_copy) {
-            notify_queue_t* next = hd_copy->next;
-            int result = ATOMIC_CAS_RV(&mutex->head, c, hd_copy, next);
-            if(result) {
-                // We have extracted the next owner.
-                next_owner = hd_copy->notify_me;
-                break;
-            }
-            hd_copy = mutex->head;
-        }
+        spinlock_acquire(&mutex->queue_lock);
+
+        notify_queue_t* next = notify_queue_pop(&mutex->head, &mutex->tail);
+
+        // Hand over directly to the longest waiter
+        if(next) next_owner = next->notify_me;
 
         mutex->owner_id = (uint64_t)next_owner;
 
-        HW_SYNC;
+        spinlock_release(&mutex->queue_lock);
 
         if(next_owner) {
             syscall_cond_notify(next_owner);
@@ -0,0 +1,151 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "pthread.h"
+#include "errno.h"
+#include "assert.h"
+#include "spinlock.h"
+
+int pthread_rwlock_init(pthread_rwlock_t *rwlock, __unused const pthread_rwlockattr_t *attr) {
+    spinlock_init(&rwlock->lock);
+    rwlock->writer = 0;
+    rwlock->readers = 0;
+    rwlock->head = NULL;
+    rwlock->tail = NULL;
+    return 0;
+}
+
+int pthread_rwlock_destroy(pthread_rwlock_t *rwlock) {
+    if(rwlock->writer || rwlock->readers || rwlock->head) return EBUSY;
+    return 0;
+}
+
+static int rwlock_try(pthread_rwlock_t *rwlock, int write) {
+    // Anybody queued means we would be overtaking them
+    if(rwlock->writer || rwlock->head) return 0;
+    if(write) {
+        if(rwlock->readers) return 0;
+        rwlock->writer = 1;
+    } else {
+        rwlock->readers++;
+    }
+    return 1;
+}
+
+static int rwlock_lock(pthread_rwlock_t *rwlock, int write, int dont_wait) {
+    spinlock_acquire(&rwlock->lock);
+
+    if(rwlock_try(rwlock, write)) {
+        spinlock_release(&rwlock->lock);
+        return 0;
+    }
+
+    if(dont_wait) {
+        spinlock_release(&rwlock->lock);
+        return EBUSY;
+    }
+
+    notify_queue_t* link = &own_link;
+    link->notify_me = act_self_notify_ref;
+    link->is_writer = (uint8_t)write;
+    notify_queue_push(&rwlock->head, &rwlock->tail, link);
+
+    spinlock_release(&rwlock->lock);
+
+    // Whoever grants us the lock will have already accounted for us in readers / writer
+    while(!link->granted) {
+        syscall_cond_wait(0, 0);
+    }
+
+    return 0;
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock) {
+    return rwlock_lock(rwlock, 0, 0);
+}
+
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock) {
+    return rwlock_lock(rwlock, 0, 1);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock) {
+    return rwlock_lock(rwlock, 1, 0);
+}
+
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock) {
+    return rwlock_lock(rwlock, 1, 1);
+}
+
+int pthread_rwlock_unlock(pthread_rwlock_t *rwlock) {
+
+    notify_queue_t* wake = NULL;
+
+    spinlock_acquire(&rwlock->lock);
+
+    if(rwlock->writer) {
+        rwlock->writer = 0;
+    } else {
+        assert(rwlock->readers != 0);
+        rwlock->readers--;
+    }
+
+    if(!rwlock->writer && rwlock->readers == 0 && rwlock->head) {
+        // Grant either the writer at the head of the queue, or every reader up until the next writer
+        if(rwlock->head->is_writer) {
+            wake = notify_queue_pop(&rwlock->head, &rwlock->tail);
+            wake->next = NULL;
+            rwlock->writer = 1;
+        } else {
+            wake = rwlock->head;
+            notify_queue_t* last = wake;
+            rwlock->readers++;
+            while(last->next && !last->next->is_writer) {
+                last = last->next;
+                rwlock->readers++;
+            }
+            rwlock->head = last->next;
+            if(rwlock->head == NULL) rwlock->tail = NULL;
+            last->next = NULL;
+        }
+    }
+
+    spinlock_release(&rwlock->lock);
+
+    // The chain is now private to us, but each link belongs to a thread that may return as soon as it sees granted
+    while(wake) {
+        notify_queue_t* next = wake->next;
+        act_notify_kt notify = wake->notify_me;
+        wake->granted = 1;
+        syscall_cond_notify(notify);
+        wake = next;
+    }
+
+    return 0;
+}
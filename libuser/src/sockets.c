@@ -33,6 +33,7 @@
 #include "sockets.h"
 #include "stdlib.h"
 #include "misc.h"
+#include "trace.h"
 
 ALLOCATE_PLT_SOCKETS
 
@@ -265,6 +266,7 @@ int socket_init(unix_like_socket* sock, enum SOCKET_FLAGS flags,
     sock->con_type = con_type;
 
     sock->flags = flags;
+    sock->dropped = 0;
 
     if(flags & SOCKF_GIVE_SOCK_N) alloc_sockn(sock);
 
@@ -326,6 +328,8 @@ ssize_t socket_send(unix_like_socket* sock, const char* buf, size_t length, enum
 
     flags |= sock->flags;
 
+    TRACE_EVENT(TRACE_SOCK_REQUEST, TRACE_PTR(sock), length, flags);
+
     if(!(flags & MSG_BUFFER_WRITES)) {
         // If we are buffering writes then we can skip flushing the DRB
         ssize_t flush = socket_flush_drb(sock);
@@ -444,6 +448,143 @@ ssize_t socket_recv(unix_like_socket* sock, char* buf, size_t length, enum SOCKE
     return ret;
 }
 
+// Makes a copy of iov with each buffer bounded (and optionally stripped of caps), returns the total length
+static ssize_t bound_iov(socket_iovec* out, const socket_iovec* iov, uint16_t iovcnt, register_t perms) {
+    if(iovcnt > SOCKET_IOV_MAX) return E_MSG_SIZE;
+
+    size_t total = 0;
+    for(uint16_t i = 0; i != iovcnt; i++) {
+        out[i].base = cheri_andperm(cheri_setbounds(iov[i].base, iov[i].length), perms);
+        out[i].length = iov[i].length;
+        total += iov[i].length;
+    }
+
+    return (ssize_t)total;
+}
+
+ssize_t socket_sendv(unix_like_socket* sock, const socket_iovec* iov, uint16_t iovcnt, enum SOCKET_FLAGS flags) {
+
+    flags |= sock->flags;
+
+    register_t perms = CHERI_PERM_LOAD;
+    if(!(flags & MSG_NO_CAPS)) perms |= CHERI_PERM_LOAD_CAP;
+
+    socket_iovec bounded[SOCKET_IOV_MAX];
+    ssize_t length = bound_iov(bounded, iov, iovcnt, perms);
+
+    if(length <= 0) return length;
+
+    if(!(flags & MSG_BUFFER_WRITES)) {
+        ssize_t flush = socket_flush_drb(sock);
+        if(flush < 0) return flush;
+    }
+
+    if((flags) & MSG_EMULATE_SINGLE_PTR) catch_up_write(sock);
+
+    int dont_wait = flags & MSG_DONT_WAIT;
+
+    ssize_t ret = E_SOCKET_WRONG_TYPE;
+    if(sock->con_type & CONNECT_PUSH_WRITE) {
+        requester_t requester = sock->write.push_writer;
+
+        if((flags) & MSG_NO_COPY_WRITE) {
+            if(dont_wait) return E_COPY_NEEDED;
+
+            ret = socket_requester_space_wait(requester, iovcnt, 0, 0);
+            if(ret < 0) return ret;
+
+            ret = socket_request_ind_vec(requester, bounded, iovcnt, 0);
+            if(ret >= 0) ret = socket_requester_wait_all_finish(requester, 0);
+            if(ret >= 0) ret = length;
+
+        } else {
+            sock->write_before_read = 1;
+
+            if(flags & MSG_BUFFER_WRITES) {
+                for(uint16_t i = 0; i != iovcnt; i++) {
+                    ret = copy_into_drb(&sock->write_copy_buffer, bounded[i].base, bounded[i].length);
+                    if(ret < 0) return ret;
+                }
+
+                ret = length;
+
+                if(sock->write_copy_buffer.partial_length >= (sock->write_copy_buffer.buffer_size >> 1)) {
+                    __unused ssize_t flush = socket_flush_drb(sock);
+                    assert(flush >= 0);
+                }
+            } else {
+                ret = socket_request_ind_db_vec(requester, bounded, iovcnt, &sock->write_copy_buffer, dont_wait, perms);
+            }
+        }
+
+    } else if(sock->con_type & CONNECT_PULL_WRITE) {
+        fulfiller_t fulfiller = sock->write.pull_writer;
+        ful_func * ff = (ful_func*)OTHER_DOMAIN_FP(copy_in_vec);
+        enum FULFILL_FLAGS progress = (enum FULFILL_FLAGS)(((flags) & MSG_PEEK) ^ F_PROGRESS);
+        enum FULFILL_FLAGS trace = (enum FULFILL_FLAGS)((flags) & MSG_TRACE);
+        ret = socket_fulfill_progress_bytes_unauthorised(fulfiller, (size_t)length,
+                                                     F_CHECK | progress | dont_wait | trace,
+                                                     ff, cheri_setbounds(bounded, iovcnt * sizeof(socket_iovec)),
+                                                     0, NULL, NULL, LIB_SOCKET_DATA, NULL);
+    }
+
+    if(ret > 0 && ((flags) & MSG_EMULATE_SINGLE_PTR)) sock->read_behind+=ret;
+    return ret;
+}
+
+ssize_t socket_recvv(unix_like_socket* sock, const socket_iovec* iov, uint16_t iovcnt, enum SOCKET_FLAGS flags) {
+
+    flags |= sock->flags;
+
+    socket_iovec bounded[SOCKET_IOV_MAX];
+    ssize_t length = bound_iov(bounded, iov, iovcnt, CHERI_PERM_ALL);
+
+    if(length <= 0) return length;
+
+    ssize_t flush = socket_flush_drb(sock);
+    if(flush < 0) return flush;
+
+    if(((flags) & MSG_EMULATE_SINGLE_PTR)) catch_up_read(sock);
+
+    int dont_wait = flags & MSG_DONT_WAIT;
+
+    if(sock->write_before_read) {
+        ssize_t failed_wait = socket_requester_wait_all_finish(sock->write.push_writer, dont_wait);
+        if(failed_wait < 0) return failed_wait;
+        sock->write_before_read = 0;
+    }
+
+    ssize_t ret = E_SOCKET_WRONG_TYPE;
+    if(sock->con_type & CONNECT_PULL_READ) {
+        requester_t requester = sock->read.pull_reader;
+
+        if((flags) & MSG_NO_COPY_READ) {
+            ret = socket_requester_space_wait(requester, iovcnt, 0, 0);
+            if(ret < 0) return ret;
+
+            ret = socket_request_ind_vec(requester, bounded, iovcnt, 0);
+            if(ret >= 0) ret = socket_requester_wait_all_finish(requester, 0);
+            if(ret >= 0) ret = length;
+        } else {
+            ret = E_UNSUPPORTED;
+        }
+
+    } else if(sock->con_type & CONNECT_PUSH_READ) {
+        fulfiller_t fulfiller = sock->read.push_reader;
+        ful_func * ff = (ful_func *)(((flags) & MSG_NO_CAPS) ? OTHER_DOMAIN_FP(copy_out_vec_no_caps) : OTHER_DOMAIN_FP(copy_out_vec));
+        enum FULFILL_FLAGS progress = (enum FULFILL_FLAGS)(((flags) & MSG_PEEK) ^ F_PROGRESS);
+        enum FULFILL_FLAGS trace = (enum FULFILL_FLAGS)((flags) & MSG_TRACE);
+        ret = socket_fulfill_progress_bytes_unauthorised(fulfiller, (size_t)length,
+                                                     F_CHECK | progress | dont_wait | trace,
+                                                     ff, cheri_setbounds(bounded, iovcnt * sizeof(socket_iovec)),
+                                                     0, NULL, NULL, LIB_SOCKET_DATA, NULL);
+    }
+
+    if(ret > 0 && ((flags) & MSG_EMULATE_SINGLE_PTR)) sock->write_behind+=ret;
+
+    return ret;
+}
+
 ssize_t socket_sendfile(unix_like_socket* sockout, unix_like_socket* sockin, size_t count) {
     uint8_t in_type;
     uint8_t out_type;
@@ -34,6 +34,8 @@
 #include "stdlib.h"
 #include "mman.h"
 #include "temporal.h"
+#include "thread.h"
+#include "object.h"
 
 // WARN: It is a _really_ bad idea to call a function that will use too much unsafe stack from here.
 // WARN: We can cope with exactly 1 use of the unsafe stack (enough for secure loaded things to make a call out)
@@ -73,20 +75,15 @@
 
 
 
-capability new_stack(capability old_c10) {
-
-    assert(cheri_getlen(old_c10) != EXCEPTION_UNSAFE_STACK_SIZE);
-
-    uint64_t default_unsafe_stack_size = NewTemporalStackSize;
-
-    if(old_c10 != NULL) {
-        assert(cheri_getoffset(old_c10) < MinStackSize);
-        mem_release(cheri_getbase(old_c10), default_unsafe_stack_size, 1, own_mop);
-    }
+__thread capability stack_pool[UNSAFE_STACK_POOL_SIZE];
+__thread size_t stack_pool_n;
+__thread size_t stack_retired[UNSAFE_STACK_RETIRE_BATCH];
+__thread size_t stack_retired_n;
 
+static capability request_stack(void) {
     // FIXME: mem_request will consume some of the temporal unsafe stack
     // FIXME: we should give ourselves a new one if it looks like its running out
-    ERROR_T(res_t) stack_res = mem_request(0, default_unsafe_stack_size, EXACT_SIZE | COMMIT_NOW | REPRESENTABLE, own_mop);
+    ERROR_T(res_t) stack_res = mem_request(0, NewTemporalStackSize, EXACT_SIZE | COMMIT_NOW | REPRESENTABLE, own_mop);
     // if(!IS_VALID(stack_res)) return 1; // We failed to get a new stack
 
     assert(IS_VALID(stack_res));
@@ -98,13 +95,209 @@ capability new_stack(capability old_c10) {
     _safe cap_pair pair;
     rescap_take(stack_res.val, &pair);
 
-    capability new_c10 = pair.data;
+    return cheri_setoffset(pair.data, NewTemporalStackSize);
+}
 
-    new_c10 = cheri_setoffset(new_c10, default_unsafe_stack_size);
+void temporal_pool_refill(void) {
+    while(stack_pool_n != UNSAFE_STACK_POOL_SIZE) {
+        stack_pool[stack_pool_n++] = request_stack();
+    }
+}
 
-    return new_c10;
+#if !(LIGHTWEIGHT_OBJECT)
+
+/* A worker thread keeps a process wide reserve of stacks topped up, and hands retired stacks back to memmgt. A thread
+ * whose own pool runs dry takes a pool's worth from the reserve, and pokes the worker once the reserve is low. So the
+ * exception path only ever sends the worker a message. It only goes to memmgt itself if the worker has fallen behind
+ * and the reserve is empty, or if the worker has not started yet. */
+
+_Static_assert(UNSAFE_STACK_RETIRE_BATCH <= 4, "A retired batch is sent in the four argument registers");
+
+enum temporal_worker_op {
+    TEMPORAL_OP_REFILL = 1,
+    TEMPORAL_OP_RETIRE = 2,
+    TEMPORAL_OP_EXIT = 3,
+};
+
+static spinlock_t reserve_lock;
+static capability stack_reserve[UNSAFE_STACK_RESERVE_SIZE];
+static size_t stack_reserve_n;
+static int refill_pending;
+
+static act_kt temporal_worker_act;
+static __thread int is_temporal_worker;
+
+// Threads other than the worker. The worker exits with the last of them so it does not keep the process alive.
+static size_t live_threads;
+
+void temporal_thread_start(void) {
+    spinlock_acquire(&reserve_lock);
+    live_threads++;
+    spinlock_release(&reserve_lock);
+}
+
+static void temporal_worker_start(__unused register_t arg, __unused capability carg) {
+    is_temporal_worker = 1;
+
+    spinlock_acquire(&reserve_lock);
+    live_threads--;
+    temporal_worker_act = act_self_ref;
+    int exit = (live_threads == 0);
+    spinlock_release(&reserve_lock);
+
+    while(!exit) {
+        msg_t* msg = get_message();
+
+        if(msg->v0 == TEMPORAL_OP_RETIRE) {
+            register_t bases[4] = {msg->a0, msg->a1, msg->a2, msg->a3};
+            for(size_t i = 0; i != UNSAFE_STACK_RETIRE_BATCH; i++) {
+                mem_release((size_t)bases[i], NewTemporalStackSize, 1, own_mop);
+            }
+        } else if(msg->v0 == TEMPORAL_OP_REFILL) {
+            while(1) {
+                spinlock_acquire(&reserve_lock);
+                int full = (stack_reserve_n == UNSAFE_STACK_RESERVE_SIZE);
+                if(full) refill_pending = 0;
+                spinlock_release(&reserve_lock);
+
+                if(full) break;
+
+                // Request outside of the lock, a trapping thread may be waiting on it
+                capability stack = request_stack();
+
+                spinlock_acquire(&reserve_lock);
+                if(stack_reserve_n != UNSAFE_STACK_RESERVE_SIZE) {
+                    stack_reserve[stack_reserve_n++] = stack;
+                    stack = NULL;
+                }
+                spinlock_release(&reserve_lock);
+
+                if(stack) mem_release(cheri_getbase(stack), NewTemporalStackSize, 1, own_mop);
+            }
+        } else if(msg->v0 == TEMPORAL_OP_EXIT) {
+            exit = 1;
+        }
+
+        next_msg();
+    }
+
+    // Every other thread has exited, so nothing else touches the reserve now
+    temporal_worker_act = NULL;
+    while(stack_reserve_n != 0) {
+        capability stack = stack_reserve[--stack_reserve_n];
+        stack_reserve[stack_reserve_n] = NULL;
+        mem_release(cheri_getbase(stack), NewTemporalStackSize, 1, own_mop);
+    }
+}
+
+void temporal_start_worker(void) {
+    const char* name = syscall_get_name(act_self_ref);
+    char wrkrname[] = "___tmprl";
+    wrkrname[0] = name[0];
+    wrkrname[1] = name[1];
+    wrkrname[2] = name[2];
+    thread_new(wrkrname, 0, NULL, &temporal_worker_start);
+}
+
+static void take_from_reserve(void) {
+    int poke;
+    act_kt worker = temporal_worker_act;
+
+    if(worker == NULL) return;
+
+    spinlock_acquire(&reserve_lock);
+    while(stack_reserve_n != 0 && stack_pool_n != UNSAFE_STACK_POOL_SIZE) {
+        stack_pool[stack_pool_n++] = stack_reserve[--stack_reserve_n];
+        stack_reserve[stack_reserve_n] = NULL;
+    }
+    poke = (stack_reserve_n <= UNSAFE_STACK_RESERVE_LOW) && !refill_pending;
+    if(poke) refill_pending = 1;
+    spinlock_release(&reserve_lock);
+
+    if(poke) message_send(0, 0, 0, 0, NULL, NULL, NULL, NULL, worker, SEND, TEMPORAL_OP_REFILL);
 }
 
+static void retire_stack(capability old_c10) {
+    act_kt worker = temporal_worker_act;
+
+    if(worker == NULL) {
+        mem_release(cheri_getbase(old_c10), NewTemporalStackSize, 1, own_mop);
+        return;
+    }
+
+    stack_retired[stack_retired_n++] = cheri_getbase(old_c10);
+
+    if(stack_retired_n == UNSAFE_STACK_RETIRE_BATCH) {
+        // Nobody is waiting on these, so the worker releases the whole batch in its own time
+        size_t b[4] = {0, 0, 0, 0};
+        for(size_t i = 0; i != UNSAFE_STACK_RETIRE_BATCH; i++) b[i] = stack_retired[i];
+        message_send(b[0], b[1], b[2], b[3], NULL, NULL, NULL, NULL, worker, SEND, TEMPORAL_OP_RETIRE);
+        stack_retired_n = 0;
+    }
+}
+
+void temporal_thread_exit(void) {
+    // Whatever the reserve has room for goes back to it, everything else goes back to memmgt
+    spinlock_acquire(&reserve_lock);
+    while(stack_pool_n != 0 && stack_reserve_n != UNSAFE_STACK_RESERVE_SIZE) {
+        stack_reserve[stack_reserve_n++] = stack_pool[--stack_pool_n];
+        stack_pool[stack_pool_n] = NULL;
+    }
+    spinlock_release(&reserve_lock);
+
+    while(stack_pool_n != 0) {
+        capability stack = stack_pool[--stack_pool_n];
+        stack_pool[stack_pool_n] = NULL;
+        mem_release(cheri_getbase(stack), NewTemporalStackSize, 1, own_mop);
+    }
+
+    while(stack_retired_n != 0) {
+        mem_release(stack_retired[--stack_retired_n], NewTemporalStackSize, 1, own_mop);
+    }
+
+    if(is_temporal_worker) return;
+
+    spinlock_acquire(&reserve_lock);
+    int last = (--live_threads == 0);
+    act_kt worker = temporal_worker_act;
+    spinlock_release(&reserve_lock);
+
+    if(last && worker) message_send(0, 0, 0, 0, NULL, NULL, NULL, NULL, worker, SEND, TEMPORAL_OP_EXIT);
+}
+
+#else
+
+void temporal_thread_start(void) {
+}
+
+static void take_from_reserve(void) {
+}
+
+static void retire_stack(capability old_c10) {
+    mem_release(cheri_getbase(old_c10), NewTemporalStackSize, 1, own_mop);
+}
+
+#endif
+
+capability new_stack(capability old_c10) {
+
+    assert(cheri_getlen(old_c10) != EXCEPTION_UNSAFE_STACK_SIZE);
+
+    if(old_c10 != NULL) {
+        assert(cheri_getoffset(old_c10) < MinStackSize);
+        retire_stack(old_c10);
+    }
+
+    if(stack_pool_n == 0) take_from_reserve();
+
+    // The worker has fallen behind. We need a stack now, so get just the one.
+    if(stack_pool_n == 0) stack_pool[stack_pool_n++] = request_stack();
+
+    capability new_c10 = stack_pool[--stack_pool_n];
+    stack_pool[stack_pool_n] = NULL;
+
+    return new_c10;
+}
 int temporal_check_insts(uint32_t fault_instr, uint32_t prev_fault_instr);
 
 int temporal_exception_handle(__unused register_t cause, __unused register_t ccause, exception_restore_frame* restore_frame) {
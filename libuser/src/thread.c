@@ -56,7 +56,8 @@ extern link_session_t own_link_session;
 
 void c_thread_call_start(register_t arg, capability carg, thread_start_func_t* start, __unused capability clean_me_up) {
 
-    // TODO: Clean up argument if one is provided. Cant do this right now due to broken cross thread free
+    // The only thing passed here is a secure start message. It cannot be freed: its once lock is all that stops the
+    // invocable that points at it from being entered again, and that invocable may outlive this thread.
 
     start(arg, carg);
 
@@ -0,0 +1,76 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "cheric.h"
+#include "syscalls.h"
+#include "trace.h"
+
+void trace_event(uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2) {
+    // User space can only read the rings. The kernel writes the event for us and never marks it TRACE_F_KERNEL.
+    syscall_trace_event(id, a0, a1, a2);
+}
+
+size_t trace_ring_drain(trace_ring_t* ring, uint64_t* tail, trace_event_t* out, size_t max, uint64_t* lost) {
+    uint64_t head = ring->head;
+    uint64_t pos = *tail;
+    size_t n = 0;
+
+    // Anything more than a ring behind has already been overwritten
+    if(head - pos > TRACE_RING_ENTRIES) {
+        *lost += (head - TRACE_RING_ENTRIES) - pos;
+        pos = head - TRACE_RING_ENTRIES;
+    }
+
+    while(pos != head && n != max) {
+        trace_event_t* ev = &ring->events[pos & (TRACE_RING_ENTRIES-1)];
+
+        uint64_t seq = ev->seq;
+
+        // Still being written. Pick it up next time.
+        if(seq < pos + 1) break;
+
+        if(seq == pos + 1) {
+            HW_SYNC;
+            out[n] = *ev;
+            HW_SYNC;
+            // A writer may have lapped us while we copied
+            if(ev->seq == pos + 1) n++;
+            else (*lost)++;
+        } else {
+            (*lost)++;
+        }
+
+        pos++;
+    }
+
+    *tail = pos;
+
+    return n;
+}
@@ -334,3 +334,73 @@ typedef capability dir_token_t;
 MESSAGE_WRAP_ID(dir_token_t, opendir, (const char*, name), fs_act, 5, namespace_num_fs, NULL);
 MESSAGE_WRAP_ID(FRESULT, readdir, (dir_token_t, dir, FILINFO*, fno), fs_act, 6, namespace_num_fs, FR_NOT_READY);
 MESSAGE_WRAP_ID(FRESULT, closedir, (dir_token_t, dir), fs_act, 7, namespace_num_fs, FR_NOT_READY);
+MESSAGE_WRAP_ID(capability, map_file_page, (const char*, name, uint64_t, offset, uint64_t*, file_size,
+                capability*, lease), fs_act, 8, namespace_num_fs, NULL);
+MESSAGE_WRAP_ASYNC_ID_ASSERT(unmap_file_page, (capability, lease), fs_act, 9, namespace_num_fs);
+
+ssize_t cached_file_size(const char* name) {
+    _unsafe uint64_t file_size = (uint64_t)-1;
+    // Without a lease this only looks up the size
+    map_file_page(name, 0, &file_size, NULL);
+    return (file_size == (uint64_t)-1) ? E_UNSUPPORTED : (ssize_t)file_size;
+}
+
+#define SENDFILE_CACHED_BATCH 8
+
+ssize_t sendfile_cached(unix_like_socket* sockout, const char* name, uint64_t offset, size_t count) {
+    if(!(sockout->con_type & CONNECT_PUSH_WRITE)) return E_SOCKET_WRONG_TYPE;
+    if(sockout->flags & MSG_EMULATE_SINGLE_PTR) return E_UNSUPPORTED;
+
+    ssize_t ret = socket_flush_drb(sockout);
+    if(ret < 0) return ret;
+
+    requester_t push_write = sockout->write.push_writer;
+    int dont_wait = sockout->flags & MSG_DONT_WAIT;
+    size_t sent = 0;
+    int stop = 0;
+
+    _unsafe capability leases[SENDFILE_CACHED_BATCH];
+
+    // The fs keeps each page we map pinned until we unmap it. Our consumer reads pages after we return from
+    // socket_request_ind, so pages are only unmapped once a whole batch has been consumed.
+    while(sent != count && !stop) {
+        size_t n_pinned = 0;
+        size_t queued = 0;
+
+        while(n_pinned != SENDFILE_CACHED_BATCH && sent + queued != count) {
+            _unsafe uint64_t file_size;
+            char* page = (char*)map_file_page(name, offset + sent + queued, &file_size, &leases[n_pinned]);
+            if(page == NULL) {
+                stop = 1;
+                break;
+            }
+
+            n_pinned++;
+
+            size_t length = cheri_getlen(page);
+            if(length > count - (sent + queued)) length = count - (sent + queued);
+
+            ret = socket_requester_space_wait(push_write, 1, dont_wait, 0);
+            if(ret >= 0) ret = socket_request_ind(push_write, page, length, 0);
+            if(ret < 0) {
+                stop = 1;
+                break;
+            }
+
+            queued += length;
+        }
+
+        ssize_t finished = socket_requester_wait_all_finish(push_write, 0);
+
+        for(size_t i = 0; i != n_pinned; i++) unmap_file_page(leases[i]);
+
+        if(finished < 0) {
+            ret = finished;
+            break;
+        }
+
+        sent += queued;
+    }
+
+    return (sent == 0 && ret < 0) ? ret : (ssize_t)sent;
+}
@@ -0,0 +1,101 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "cheric.h"
+#include "namespace.h"
+#include "thread.h"
+#include "syscalls.h"
+#include "stdio.h"
+#include "assert.h"
+
+// Checks who may join service groups, and that lookups of a group are balanced rather than pinned by the cache
+
+#define INSTANCES 3
+
+static void instance_start(__unused register_t arg, __unused capability carg) {
+    // The namespace only needs a reference, these are never sent anything
+}
+
+static act_kt new_instance(void) {
+    thread t = thread_new("ns_inst", 0, NULL, &instance_start);
+    assert(t != NULL);
+    return syscall_act_ctrl_get_ref(t);
+}
+
+// Keys can be any capability. Nobody else has these.
+static char key_obj;
+static char other_obj;
+
+int main(void) {
+    act_kt inst[INSTANCES];
+    capability key = cheri_setbounds(&key_obj, 1);
+    capability wrong = cheri_setbounds(&other_obj, 1);
+
+    for(size_t i = 0; i != INSTANCES; i++) inst[i] = new_instance();
+
+    // Exclusive registrations stay first come first served and cannot be joined
+    assert_int_ex(namespace_register_name("ns_test_excl", inst[0]), ==, 0);
+    assert_int_ex(namespace_register_name("ns_test_excl", inst[1]), !=, 0);
+    assert_int_ex(namespace_register_name_instance("ns_test_excl", inst[1], NS_POLICY_ROUND_ROBIN, key), !=, 0);
+    assert(namespace_get_ref_by_name("ns_test_excl") == inst[0]);
+
+    // Joining a group needs the key its first instance chose, and no key is not a key
+    assert_int_ex(namespace_register_name_instance("ns_test_rr", inst[0], NS_POLICY_ROUND_ROBIN, NULL), !=, 0);
+    assert_int_ex(namespace_register_name_instance("ns_test_rr", inst[0], NS_POLICY_ROUND_ROBIN, key), ==, 0);
+    assert_int_ex(namespace_register_name_instance("ns_test_rr", inst[1], NS_POLICY_ROUND_ROBIN, wrong), !=, 0);
+    assert_int_ex(namespace_register_name("ns_test_rr", inst[1]), !=, 0);
+    assert_int_ex(namespace_register_name_instance("ns_test_rr", inst[1], NS_POLICY_ROUND_ROBIN, key), ==, 0);
+    assert_int_ex(namespace_register_name_instance("ns_test_rr", inst[2], NS_POLICY_ROUND_ROBIN, key), ==, 0);
+
+    // Every instance gets a turn, even though we are a single process looking up by the same name
+    act_kt seen[INSTANCES];
+    for(size_t i = 0; i != INSTANCES; i++) {
+        seen[i] = namespace_get_ref_by_name("ns_test_rr");
+        for(size_t j = 0; j != i; j++) assert(seen[i] != seen[j]);
+    }
+    assert(namespace_get_ref_by_name("ns_test_rr") == seen[0]);
+
+    // Load reports need the key too
+    assert_int_ex(namespace_register_name_instance("ns_test_ll", inst[0], NS_POLICY_LEAST_LOADED, key), ==, 0);
+    assert_int_ex(namespace_register_name_instance("ns_test_ll", inst[1], NS_POLICY_LEAST_LOADED, key), ==, 0);
+    assert_int_ex(namespace_register_name_instance("ns_test_ll", inst[2], NS_POLICY_LEAST_LOADED, key), ==, 0);
+
+    assert_int_ex(namespace_report_load(-1, "ns_test_ll", inst[2], 1000, wrong), !=, 0);
+    assert_int_ex(namespace_report_load(-1, "ns_test_ll", inst[0], 1000, key), ==, 0);
+    assert_int_ex(namespace_report_load(-1, "ns_test_ll", inst[1], 1000, key), ==, 0);
+
+    for(size_t i = 0; i != 10; i++) {
+        assert(namespace_get_ref_by_name("ns_test_ll") == inst[2]);
+    }
+
+    printf("Namespace test passes!\n");
+
+    return 0;
+}
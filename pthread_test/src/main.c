@@ -56,6 +56,88 @@ void* start_func(void* arg) {
     return arg;
 }
 
+// Contention microbenchmark. Every thread hammers the same lock with a tiny critical section.
+
+#define BENCH_ITERATIONS    2000
+#define BENCH_MAX_THREADS   8
+#define BENCH_WRITE_EVERY   0x10
+
+pthread_mutex_t bench_mutex;
+pthread_rwlock_t bench_rwlock;
+pthread_barrier_t bench_barrier;
+volatile uint64_t bench_shared;
+
+void* mutex_bench_func(void* arg) {
+    pthread_barrier_wait(&bench_barrier);
+    for(int i = 0; i != BENCH_ITERATIONS; i++) {
+        pthread_mutex_lock(&bench_mutex);
+        bench_shared++;
+        pthread_mutex_unlock(&bench_mutex);
+    }
+    pthread_barrier_wait(&bench_barrier);
+    return arg;
+}
+
+void* rwlock_bench_func(void* arg) {
+    uint64_t seen = 0;
+    pthread_barrier_wait(&bench_barrier);
+    for(int i = 0; i != BENCH_ITERATIONS; i++) {
+        if((i % BENCH_WRITE_EVERY) == 0) {
+            pthread_rwlock_wrlock(&bench_rwlock);
+            bench_shared++;
+        } else {
+            pthread_rwlock_rdlock(&bench_rwlock);
+            seen += bench_shared;
+        }
+        pthread_rwlock_unlock(&bench_rwlock);
+    }
+    pthread_barrier_wait(&bench_barrier);
+    return (void*)seen;
+}
+
+static void contention_bench(const char* name, void* (*func)(void*), int nthreads, uint64_t expect) {
+    pthread_t threads[BENCH_MAX_THREADS];
+
+    bench_shared = 0;
+    pthread_barrier_init(&bench_barrier, NULL, (unsigned)nthreads + 1);
+
+    for(int i = 0; i != nthreads; i++) {
+        pthread_create(&threads[i], NULL, func, NULL);
+    }
+
+    // Start everyone at once, and wait for the last to finish
+    pthread_barrier_wait(&bench_barrier);
+    register_t start = syscall_now();
+    pthread_barrier_wait(&bench_barrier);
+    register_t end = syscall_now();
+
+    for(int i = 0; i != nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_barrier_destroy(&bench_barrier);
+
+    assert_int_ex(bench_shared, ==, expect);
+
+    printf("******BENCH: %s x%d: %lx clocks (%lx per op)\n", name, nthreads,
+           end - start, (end - start) / (nthreads * BENCH_ITERATIONS));
+}
+
+static void run_contention_benches(void) {
+    pthread_mutex_init(&bench_mutex, NULL);
+    pthread_rwlock_init(&bench_rwlock, NULL);
+
+    for(int n = 1; n <= BENCH_MAX_THREADS; n*=2) {
+        contention_bench("mutex", mutex_bench_func, n, (uint64_t)n * BENCH_ITERATIONS);
+    }
+
+    for(int n = 1; n <= BENCH_MAX_THREADS; n*=2) {
+        contention_bench("rwlock", rwlock_bench_func, n, (uint64_t)n * (BENCH_ITERATIONS / BENCH_WRITE_EVERY));
+    }
+
+    pthread_rwlock_destroy(&bench_rwlock);
+    pthread_mutex_destroy(&bench_mutex);
+}
 
 int main(void) {
     pthread_t t1, t2, t3, t4, t5;
@@ -89,6 +171,8 @@ int main(void) {
 
     printf("PThread test passes %d!\n", global_ctr);
 
+    run_contention_benches();
+
     // Done
 
     return 0;
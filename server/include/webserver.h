@@ -47,9 +47,13 @@ enum http_method {
 
 struct initial {
     enum http_method method;
+    int http_minor;
     char* file;
 };
 
+// parse_initial found the connection closed before a new request started
+#define PARSE_EOF (-2)
+
 struct header {
     char header[100];
     char value[100];
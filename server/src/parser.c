@@ -87,7 +87,10 @@ int parse_initial(fulfiller_t push_read, struct initial* initial, char* name_to,
 
     enum http_method method;
 
-    POP(a);
+    // A client that is done with a persistent connection just closes it, which is not an error
+    res = socket_fulfill_progress_bytes_unauthorised(push_read,1,F_CHECK | F_PROGRESS,OTHER_DOMAIN_FP(copy_out), (capability)&a, 0, NULL, NULL, LIB_SOCKET_DATA, NULL);
+    if(res != 1) return PARSE_EOF;
+
     switch (a) {
         case 'C':
             EXPECT("ONNECT ");
@@ -147,7 +150,11 @@ int parse_initial(fulfiller_t push_read, struct initial* initial, char* name_to,
         return -1;
     }
 
-    EXPECT("HTTP/1.0\n");
+    EXPECT("HTTP/1.");
+    POP(a);
+    if(a != '0' && a != '1') return -1;
+    initial->http_minor = a - '0';
+    EXPECT("\n");
 
     return 0;
 }
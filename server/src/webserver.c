@@ -43,8 +43,9 @@ struct session {
     char file_name_buf[100];
     size_t server_root_length;
     unix_like_socket* sock;
-    int sent_initial;
-    int sent_headers;
+    int responded;
+    int keep_alive;
+    size_t served;
 };
 
 #define ERR(...)    printf(__VA_ARGS__)
@@ -53,61 +54,80 @@ struct session {
 #define ROOT "/websrv"
 
 #define LEN_HDR "Content-Length"
+#define CONNECTION_HDR "Connection"
 
-#define HTTP_VER "HTTP/1.0 "
+#define HTTP_VER "HTTP/1.1 "
 #define NOT_FOUND "File not found"
 #define YOU_SUCK "You suck"
 #define WE_SUCK "This server sucks"
 
-int send_response_initial(struct session* s, int code, const char* reason, size_t reason_len) {
+#define STATUS_LINE(code, reason) HTTP_VER #code " " reason "\n"
 
-    ssize_t ret = socket_send(s->sock, HTTP_VER, sizeof(HTTP_VER)-1, MSG_NONE);
+#define HDR_MAX 0x80
 
-    if(ret != sizeof(HTTP_VER)-1) return -1;
+// There is only one thread serving, so a client can only hold on to it for so long
+#define IDLE_TIMEOUT        MS_TO_CLOCK(5000)
+#define MAX_CONN_REQUESTS   100
 
-    char str_code[] = "000 ";
-    itoa(code, str_code, 10);
-    str_code[3] = ' ';
-
-    ret = socket_send(s->sock, str_code, 4, MSG_NONE);
-
-    if(ret != 4) return -1;
-
-    ret = socket_send(s->sock, reason, reason_len, MSG_NONE);
-
-    if((size_t)ret != reason_len) return -1;
-
-    s->sent_initial = 1;
-
-    return 0;
+// Status lines are constant so are built by the compiler, not per response
+static const char* status_line(int code) {
+    switch (code) {
+        case 200: return STATUS_LINE(200, "OK");
+        case 404: return STATUS_LINE(404, NOT_FOUND);
+        case 500: return STATUS_LINE(500, WE_SUCK);
+        default:  return STATUS_LINE(400, YOU_SUCK);
+    }
 }
 
-int send_ok(struct session* s) {
-    return send_response_initial(s, 200, "OK" "\n", 3);
+// Assembles a full header block so a response costs one request on the socket, not one per line
+static size_t build_headers(char* buf, int code, size_t content_length, int keep_alive) {
+    int len = snprintf(buf, HDR_MAX, "%s" LEN_HDR ": %lu\n" CONNECTION_HDR ": %s\n\n",
+                       status_line(code), content_length, keep_alive ? "keep-alive" : "close");
+    assert(len > 0 && len < HDR_MAX);
+    return (size_t)len;
 }
 
-int send_header(struct session*s, const char* header, size_t hdr_len, char* value, size_t value_len) {
-    ssize_t ret = socket_send(s->sock, header, hdr_len, MSG_NONE);
-    if((size_t)ret != hdr_len) return -1;
-    ret = socket_send(s->sock, value, value_len, MSG_NONE);
-    if((size_t)ret != value_len) return -1;
-    ret = socket_send(s->sock, "\n", 1, MSG_NONE);
-    if(ret != 1) return -1;
+static int send_block(struct session* s, const char* buf, size_t len) {
+    ssize_t ret = socket_send(s->sock, buf, len, MSG_NONE);
+    s->responded = 1;
+    if(ret < 0 || (size_t)ret != len) return -1;
     return 0;
 }
 
-int send_content_length(struct session*s, int length) {
-    char len_buf[100];
-    itoa(length, len_buf, 10);
-    size_t l = strlen(len_buf);
-    return send_header(s, LEN_HDR ": ", sizeof(LEN_HDR)+1, len_buf, l);
+int send_response(struct session* s, int code, size_t content_length) {
+    char buf[HDR_MAX];
+    // The last request a connection gets tells the client so it does not pipeline more behind it
+    if(s->served + 1 == MAX_CONN_REQUESTS) s->keep_alive = 0;
+    size_t len = build_headers(buf, code, content_length, s->keep_alive);
+    return send_block(s, buf, len);
 }
 
-int finish_headers(struct session*s) {
-    ssize_t ret = socket_send(s->sock, "\n", 1, MSG_NONE);
-    s->sent_headers = 1;
-    if(ret == 1) return 0;
-    else return -1;
+/* Static content comes out of the fs page cache where it can, which does not involve the fs past the first read.
+ * Returns 1 if the file is not cached and should be sent the normal way */
+int send_cached(struct session* s, const char* path) {
+    ssize_t size = cached_file_size(path);
+    if(size < 0) return 1;
+
+    send_response(s, 200, (size_t)size);
+
+    ssize_t sent = sendfile_cached(s->sock, path, 0, (size_t)size);
+    if(sent < 0) sent = 0;
+
+    if(sent != size) {
+        // The fs stopped caching it part way through, the rest comes through the file
+        FILE_t f = open_file(path, FA_READ, MSG_NONE);
+        ssize_t result = -1;
+        if(f != NULL) {
+            if(lseek_file(f, sent, SEEK_SET) == 0) result = sendfile((FILE_t)s->sock, f, (size_t)(size - sent));
+            close_file(f);
+        }
+        if(result != size - sent) {
+            s->keep_alive = 0;
+            ER_R("Error sending rest of %s\n", path);
+        }
+    }
+
+    return 0;
 }
 
 int handle_get_post(struct session* s, struct initial* ini) {
@@ -127,6 +147,11 @@ int handle_get_post(struct session* s, struct initial* ini) {
                 int res = atoi(hdr.value);
                 if(res < 0) ER_R("Negative sized length\n");
                 file_size = (size_t)res;
+            } else if(strcmp(CONNECTION_HDR, hdr.header) == 0) {
+                const char* value = hdr.value;
+                while(*value == ' ') value++;
+                if(strcmp(value, "close") == 0) s->keep_alive = 0;
+                else if(strcmp(value, "keep-alive") == 0) s->keep_alive = 1;
             } else {
                 printf("Ignoring header %s\n", hdr.header);
             }
@@ -136,11 +161,19 @@ int handle_get_post(struct session* s, struct initial* ini) {
 
     if(ini->method == POST && file_size == 0) ER_R("POST should include a file size\n");
 
+    if(ini->method == GET && file_size == 0) {
+        result = send_cached(s, ini->file);
+        if(result <= 0) return (int)result;
+    }
+
     FILE_t f = open_file(ini->file, FA_OPEN_ALWAYS | FA_WRITE | FA_READ, MSG_NONE);
 
     if(f == NULL) {
-        send_response_initial(s, 404, NOT_FOUND "\n", sizeof(NOT_FOUND));
-        ER_R("Error opening file %s\n", ini->file);
+        ERR("Error opening file %s\n", ini->file);
+        // Nothing of a GET's is left to read, so the connection can carry on. A POST's body is still in the way.
+        if(ini->method == POST) s->keep_alive = 0;
+        send_response(s, 404, 0);
+        return ini->method == GET ? 0 : -1;
     }
 
     if(ini->method == GET && file_size == 0) {
@@ -153,9 +186,7 @@ int handle_get_post(struct session* s, struct initial* ini) {
     }
 
     if(ini->method == GET) {
-        send_ok(s);
-        send_content_length(s, (int)file_size);
-        finish_headers(s);
+        send_response(s, 200, file_size);
         result = sendfile((FILE_t)s->sock, f, file_size);
     } else {
         result = sendfile(f,(FILE_t)s->sock, file_size);
@@ -164,15 +195,15 @@ int handle_get_post(struct session* s, struct initial* ini) {
     close_file(f);
 
     if(result < 0 || (size_t)result != file_size){
+        s->keep_alive = 0;
         if(ini->method == POST) {
-            send_response_initial(s, 500, WE_SUCK "\n", sizeof(WE_SUCK));
-            finish_headers(s);
+            send_response(s, 500, 0);
         }
         ER_R("Error in sendfile %d\n", (int)-result);
     }
 
     if(ini->method == POST) {
-        send_ok(s);
+        send_response(s, 200, 0);
     }
 
     return 0;
@@ -186,8 +217,12 @@ int handle_request(struct session* s) {
     int result = parse_initial(s->sock->read.push_reader, &ini,
                                ini.file + s->server_root_length, sizeof(s->file_name_buf) - s->server_root_length);
 
+    if(result == PARSE_EOF) return PARSE_EOF;
     if(result < 0) ER_R("Error parsing initial line\n");
 
+    // 1.1 connections persist unless the client asks otherwise, 1.0 ones only if it asks
+    s->keep_alive = (ini.http_minor != 0);
+
     switch (ini.method) {
         case GET:
         case POST:
@@ -197,7 +232,39 @@ int handle_request(struct session* s) {
     }
 }
 
+/* Serves requests until the client closes, one of them goes wrong, it sits idle for IDLE_TIMEOUT or it has had
+ * MAX_CONN_REQUESTS. Requests are parsed straight out of the stream, so any the client pipelined behind the current one
+ * are waiting in the socket for the next time around, and responses are queued without waiting for the previous to be
+ * drained */
+void handle_connection(struct session* s) {
+    s->served = 0;
+
+    do {
+        poll_sock_t poll_sock;
+        poll_sock.fd = s->sock;
+        poll_sock.events = POLL_IN;
+
+        if(socket_poll(&poll_sock, 1, (int)IDLE_TIMEOUT, NULL) == 0) {
+            printf("Closing idle connection\n");
+            return;
+        }
+
+        s->responded = 0;
+        s->keep_alive = 0;
+
+        int result = handle_request(s);
 
+        if(result == PARSE_EOF) return;
+
+        if(result < 0) {
+            s->keep_alive = 0;
+            if(!s->responded) {
+                send_response(s, 400, 0);
+            }
+        }
+        s->served++;
+    } while(s->keep_alive);
+}
 
 void handle_loop(void) {
     struct session s;
@@ -220,7 +287,7 @@ void handle_loop(void) {
     struct tcp_bind bind;
     bind.port = 666;
     bind.addr.addr = IP_ADDR_ANY->addr;
-    netsock_listen_tcp(&bind, 4, NULL, NULL);
+    netsock_listen_tcp(&bind, 4, NULL, NULL, NETSOCK_LISTEN_NONE);
 
     while(1) {
         printf("Server accept...\n");
@@ -233,16 +300,7 @@ void handle_loop(void) {
 
         s.sock = &netsock->sock;
 
-        s.sent_initial = 0;
-        s.sent_headers = 0;
-        handle_request(&s);
-
-        if(!s.sent_initial) {
-            send_response_initial(&s, 400, YOU_SUCK "\n", sizeof(YOU_SUCK));
-        }
-        if(!s.sent_headers) {
-            finish_headers(&s);
-        }
+        handle_connection(&s);
 
         res = close_file((FILE_t)netsock);
 
@@ -50,6 +50,19 @@
     } sha256_hash;
 
     void sha256(uint64_t * in, sha256_hash* hash, size_t length);
+
+// Multi-buffer hashing. Up to SHA256_MULTI_LANES independent messages have their rounds interleaved so that the
+// dependency chain of one hides the latency of the others. Same length / alignment restrictions as sha256.
+
+#define SHA256_MULTI_LANES  4
+
+    typedef struct sha256_job {
+        const uint64_t* in;
+        size_t length;
+        sha256_hash* hash;
+    } sha256_job;
+
+    void sha256_multi(sha256_job* jobs, size_t n);
 #endif
 
 #endif
@@ -0,0 +1,199 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "cheric.h"
+#include "string.h"
+#include "sha256.h"
+
+// A portable multi-buffer version of the sha256 in platform/*/sha256.S. Each step compresses one block from every
+// active lane. Lanes that finish are immediately refilled from the job list, so messages of very different lengths
+// still keep all the lanes busy.
+
+static const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t H_init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define BLOCK_WORDS     (SHA256_BLOCK_SIZE / sizeof(uint32_t))
+
+#define ROTR(x, n)      (((x) >> (n)) | ((x) << (32 - (n))))
+#define S0(x)           (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define S1(x)           (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define s0(x)           (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define s1(x)           (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+#define CH(x, y, z)     (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z)    (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+typedef struct sha256_lane {
+    sha256_job* job;
+    const uint32_t* src;        // Next full block in the message
+    size_t src_blocks;          // Full blocks left in the message
+    size_t tail_blocks;         // The last partial block plus padding, 1 or 2 blocks
+    size_t tail_index;
+    uint32_t H[8];
+    uint64_t tail[(2 * SHA256_BLOCK_SIZE) / sizeof(uint64_t)];
+} sha256_lane;
+
+static inline uint32_t load_be32(const uint32_t* p) {
+#if (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return *p;
+#else
+    return __builtin_bswap32(*p);
+#endif
+}
+
+static void lane_start(sha256_lane* lane, sha256_job* job) {
+    size_t length = job->length;
+    size_t rem = length & (SHA256_BLOCK_SIZE - 1);
+    uint64_t bits = (uint64_t)length * 8;
+    uint8_t* tail = (uint8_t*)lane->tail;
+
+    lane->job = job;
+    lane->src = (const uint32_t*)job->in;
+    lane->src_blocks = length / SHA256_BLOCK_SIZE;
+    lane->tail_blocks = (rem + 1 + sizeof(uint64_t) > SHA256_BLOCK_SIZE) ? 2 : 1;
+    lane->tail_index = 0;
+    memcpy(lane->H, H_init, sizeof(H_init));
+
+    // Build the padding now, it is the same work whenever we do it
+    size_t tail_len = lane->tail_blocks * SHA256_BLOCK_SIZE;
+    bzero(tail, tail_len);
+    if(rem) memcpy(tail, ((const char*)job->in) + (length - rem), rem);
+    tail[rem] = 0x80;
+    for(size_t i = 0; i != sizeof(uint64_t); i++) {
+        tail[tail_len - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+}
+
+static inline const uint32_t* lane_next_block(sha256_lane* lane) {
+    if(lane->src_blocks) {
+        const uint32_t* block = lane->src;
+        lane->src += BLOCK_WORDS;
+        lane->src_blocks--;
+        return block;
+    }
+    return ((const uint32_t*)lane->tail) + (BLOCK_WORDS * lane->tail_index++);
+}
+
+static inline int lane_done(sha256_lane* lane) {
+    return lane->src_blocks == 0 && lane->tail_index == lane->tail_blocks;
+}
+
+static void lane_finish(sha256_lane* lane) {
+    sha256_hash* hash = lane->job->hash;
+    for(size_t i = 0; i != 4; i++) {
+        hash->doublewords[i] = ((uint64_t)lane->H[2 * i] << 32) | lane->H[(2 * i) + 1];
+    }
+}
+
+// Written lane-innermost so that, once inlined with a constant nl, every round is nl independent chains
+static inline __attribute__((always_inline))
+void compress_lanes(sha256_lane* lanes, const uint32_t** blocks, const size_t nl) {
+    uint32_t W[64][SHA256_MULTI_LANES];
+    uint32_t a[SHA256_MULTI_LANES], b[SHA256_MULTI_LANES], c[SHA256_MULTI_LANES], d[SHA256_MULTI_LANES];
+    uint32_t e[SHA256_MULTI_LANES], f[SHA256_MULTI_LANES], g[SHA256_MULTI_LANES], h[SHA256_MULTI_LANES];
+
+    for(size_t i = 0; i != 16; i++) {
+        for(size_t l = 0; l != nl; l++) W[i][l] = load_be32(blocks[l] + i);
+    }
+
+    for(size_t i = 16; i != 64; i++) {
+        for(size_t l = 0; l != nl; l++) {
+            W[i][l] = s1(W[i-2][l]) + W[i-7][l] + s0(W[i-15][l]) + W[i-16][l];
+        }
+    }
+
+    for(size_t l = 0; l != nl; l++) {
+        a[l] = lanes[l].H[0]; b[l] = lanes[l].H[1]; c[l] = lanes[l].H[2]; d[l] = lanes[l].H[3];
+        e[l] = lanes[l].H[4]; f[l] = lanes[l].H[5]; g[l] = lanes[l].H[6]; h[l] = lanes[l].H[7];
+    }
+
+    for(size_t i = 0; i != 64; i++) {
+        for(size_t l = 0; l != nl; l++) {
+            uint32_t t1 = h[l] + S1(e[l]) + CH(e[l], f[l], g[l]) + K[i] + W[i][l];
+            uint32_t t2 = S0(a[l]) + MAJ(a[l], b[l], c[l]);
+            h[l] = g[l]; g[l] = f[l]; f[l] = e[l]; e[l] = d[l] + t1;
+            d[l] = c[l]; c[l] = b[l]; b[l] = a[l]; a[l] = t1 + t2;
+        }
+    }
+
+    for(size_t l = 0; l != nl; l++) {
+        lanes[l].H[0] += a[l]; lanes[l].H[1] += b[l]; lanes[l].H[2] += c[l]; lanes[l].H[3] += d[l];
+        lanes[l].H[4] += e[l]; lanes[l].H[5] += f[l]; lanes[l].H[6] += g[l]; lanes[l].H[7] += h[l];
+    }
+}
+
+static void compress_full(sha256_lane* lanes, const uint32_t** blocks) {
+    compress_lanes(lanes, blocks, SHA256_MULTI_LANES);
+}
+
+static void compress_partial(sha256_lane* lanes, const uint32_t** blocks, size_t nl) {
+    compress_lanes(lanes, blocks, nl);
+}
+
+void sha256_multi(sha256_job* jobs, size_t n) {
+    sha256_lane lanes[SHA256_MULTI_LANES];
+    const uint32_t* blocks[SHA256_MULTI_LANES];
+    size_t active = 0;
+    size_t next = 0;
+
+    while(1) {
+        while(active != SHA256_MULTI_LANES && next != n) {
+            lane_start(&lanes[active++], &jobs[next++]);
+        }
+
+        if(active == 0) break;
+
+        for(size_t l = 0; l != active; l++) {
+            blocks[l] = lane_next_block(&lanes[l]);
+        }
+
+        if(active == SHA256_MULTI_LANES) compress_full(lanes, blocks);
+        else compress_partial(lanes, blocks, active);
+
+        // Keep active lanes packed at the front
+        for(size_t l = 0; l != active;) {
+            if(lane_done(&lanes[l])) {
+                lane_finish(&lanes[l]);
+                lanes[l] = lanes[--active];
+            } else l++;
+        }
+    }
+}
@@ -307,6 +307,17 @@ void connector_start(__unused register_t arg, __unused capability carg) {
 
     assert(sent == size3);
 
+    // Test vectored receives and sends
+
+    socket_iovec r_iov[2] = {{.base = buf, .length = 7}, {.base = buf + 7, .length = size2 + size3 - 7}};
+    rec = socket_recvv(sock, r_iov, 2, MSG_NONE);
+    assert_int_ex(rec, ==, size2 + size3);
+    assert(strcmp(buf, str4) == 0);
+
+    socket_iovec s_iov[2] = {{.base = (char*)str2, .length = size2}, {.base = (char*)str3, .length = size3}};
+    sent = socket_sendv(sock, s_iov, 2, MSG_NONE);
+    assert_int_ex(sent, ==, size2 + size3);
+
     // Test sending a large amount of data in small parts
     big_test_recv(sock);
 
@@ -529,6 +540,18 @@ int main(void) {
     // Test multiple sends with partial reads
     assert(strcmp(buf, str4) == 0);
 
+    // Test vectored sends and receives
+
+    socket_iovec s_iov[2] = {{.base = (char*)str2, .length = size2}, {.base = (char*)str3, .length = size3}};
+    sent = socket_sendv(sock, s_iov, 2, MSG_NONE);
+    assert_int_ex(sent, ==, size2 + size3);
+
+    bzero(buf, sizeof(buf));
+    socket_iovec r_iov[2] = {{.base = buf, .length = p1}, {.base = buf + p1, .length = p2}};
+    rec = socket_recvv(sock, r_iov, 2, MSG_NO_COPY_READ);
+    assert_int_ex(rec, ==, p1 + p2);
+    assert(strcmp(buf, str4) == 0);
+
     // Test sending a large number of bytes in small bits and bit bits
     big_test_send(sock);
     big_test_send2(sock);
@@ -39,7 +39,7 @@
 #define MAX_TRACK 100
 #define MAX_DISPLAY 30
 
-act_info_t* info_global;
+act_kstats_t* info_global;
 
 int cmp(const void* a, const void* b) {
     int64_t diff = (int64_t)(info_global[*(const size_t*)b].had_time - info_global[*(const size_t*)a].had_time);
@@ -59,10 +59,10 @@ int cmp(const void* a, const void* b) {
 #define USTAT_STR_EMP(item, ...) "       "
 
 
-#define H1 "|--------------------------------------------------------------------------------------"USER_STATS_LIST(USTAT_STR_TOP)STAT_DEBUG_LIST(STAT_STR_TOP)"|\n"
-#define H2 "|      Name      |Total Time| Time |CPU| Switches | Sent | Recv |QIN|CMTFT|   Status   "USER_STATS_LIST(USTAT_STR_MID)STAT_DEBUG_LIST(STAT_STR_MID)"|\n"
-#define H3 "|----------------+----------+------+---+----------+------+------+---+-----+------------"USER_STATS_LIST(USTAT_STR_BOT)STAT_DEBUG_LIST(STAT_STR_BOT)"|\n"
-#define H4 "                                                                                       "USER_STATS_LIST(USTAT_STR_EMP)STAT_DEBUG_LIST(STAT_STR_EMP)" \n"
+#define H1 "|-----------------------------------------------------------------------------------------------------"USER_STATS_LIST(USTAT_STR_TOP)STAT_DEBUG_LIST(STAT_STR_TOP)"|\n"
+#define H2 "|      Name      |Total Time| Time |CPU| Switches | Sent | Recv |QHWM|CMTFT|RQ avg|RQ max|   Status   "USER_STATS_LIST(USTAT_STR_MID)STAT_DEBUG_LIST(STAT_STR_MID)"|\n"
+#define H3 "|----------------+----------+------+---+----------+------+------+----+-----+------+------+------------"USER_STATS_LIST(USTAT_STR_BOT)STAT_DEBUG_LIST(STAT_STR_BOT)"|\n"
+#define H4 "                                                                                                      "USER_STATS_LIST(USTAT_STR_EMP)STAT_DEBUG_LIST(STAT_STR_EMP)" \n"
 
 #define LL (sizeof(H1)-1)
 #define LC0 (sizeof(CTRL_START)-1)
@@ -94,10 +94,19 @@ static n_short make_short(uint64_t large, size_t largest) {
 int main(void) {
     // This just displays some stats every few seconds
     char table_buffer[LTOTAL];
-    act_info_t info[MAX_TRACK];
+    act_kstats_t info[MAX_TRACK];
     info_global = info;
     size_t order[MAX_TRACK];
 
+    // The kernel keeps all the counters we want in one read only region, so after this we need no more syscalls
+    const kstats_t* kstats = syscall_kstats();
+
+    // had_time as of the last refresh, so we can show how much time each activation had since then
+    uint64_t last_generation[KSTATS_MAX_ACTS];
+    uint64_t last_had_time[KSTATS_MAX_ACTS];
+    uint64_t epoch_time[MAX_TRACK];
+    bzero(last_generation, sizeof(last_generation));
+
     // setup the display
 
     // Set window
@@ -121,20 +130,29 @@ int main(void) {
         // get info about all the activations
         size_t n_acts = 0;
         uint64_t total_time = 0;
-        act_control_kt act = syscall_actlist_first();
 
-        while(act != NULL) {
+        for(size_t slot = 0; slot != kstats->acts_end && n_acts != MAX_TRACK; slot++) {
+            const act_kstats_t* stats = &kstats->acts[slot];
+            uint64_t generation = stats->generation;
+            if(!(generation & 1)) continue;
+
+            info[n_acts] = *stats;
+
+            // The slot might have been reused under us. Just skip it this time around.
+            if(stats->generation != generation) continue;
+
+            uint64_t last = (last_generation[slot] == generation) ? last_had_time[slot] : 0;
+            last_generation[slot] = generation;
+            last_had_time[slot] = info[n_acts].had_time;
+
+            epoch_time[n_acts] = info[n_acts].had_time - last;
+            total_time += epoch_time[n_acts];
             order[n_acts] = n_acts;
-            syscall_act_info(act, &info[n_acts]);
-            total_time += info[n_acts].had_time_epoch;
             n_acts++;
-            act = syscall_actlist_next(act);
         }
 
         if(total_time == 0) total_time = 1;
 
-        syscall_info_epoch();
-
         // sort by time had
         qsort(order, n_acts, sizeof(size_t), &cmp);
 
@@ -143,7 +161,7 @@ int main(void) {
         char* buf = table_buffer + LC0 + (LL * 3);
 
         for(size_t i = 0; i != n_acts && i != MAX_DISPLAY; i++) {
-            act_info_t* act_info = &info[order[i]];
+            act_kstats_t* act_info = &info[order[i]];
 
             char status[] = "Block:XXXXXX";
             size_t flags = 6;
@@ -172,11 +190,16 @@ int main(void) {
                     sched_str = status;
             }
 
-            uint64_t per_k = (act_info->had_time_epoch * 1000) / total_time;
+            uint64_t per_k = (epoch_time[order[i]] * 1000) / total_time;
             uint64_t per_c = per_k / 10;
             uint64_t decimal = per_k % 10;
             uint64_t total = CLOCK_TO_MS(act_info->had_time) / 1000;
 
+            // Run queue waits in microseconds
+            uint64_t waits = act_info->switches ? act_info->switches : 1;
+            n_short wait_avg = make_short(CLOCK_TO_MS(act_info->runq_wait_time * 1000) / waits, 9999);
+            n_short wait_max = make_short(CLOCK_TO_MS(act_info->runq_wait_max * 1000), 9999);
+
 #define STAT_FORMAT(item, ...) "|%6ld%c/%1ld.%02ld%c"
 
 #define STAT_DEF(item, ...) n_short item ## _short = make_short(act_info-> item, 999999); \
@@ -194,9 +217,11 @@ int main(void) {
             STAT_DEBUG_LIST(STAT_DEF)
             USER_STATS_LIST(USTAT_DEF)
 
-            snprintf(buf, LL + 1, "|%16s|%9lds|%3ld.%1ld%%|%3d|%10ld|%6ld|%6ld|%3d|%5ld|%12s"USER_STATS_LIST(USTAT_FORMAT)STAT_DEBUG_LIST(STAT_FORMAT)"|\n",
+            snprintf(buf, LL + 1, "|%16.16s|%9lds|%3ld.%1ld%%|%3d|%10ld|%6ld|%6ld|%4ld|%5ld|%5ld%c|%5ld%c|%12s"USER_STATS_LIST(USTAT_FORMAT)STAT_DEBUG_LIST(STAT_FORMAT)"|\n",
                    act_info->name, total, per_c, decimal, act_info->cpu, act_info->switches,
-                   act_info->sent_n, act_info->received_n, act_info->queue_fill, act_info->commit_faults, sched_str USER_STATS_LIST(USTAT_VAL) STAT_DEBUG_LIST(STAT_VAL));
+                   act_info->sent_n, act_info->recv_n, act_info->queue_hwm, act_info->commit_faults,
+                   wait_avg.val, wait_avg.suffix, wait_max.val, wait_max.suffix,
+                   sched_str USER_STATS_LIST(USTAT_VAL) STAT_DEBUG_LIST(STAT_VAL));
             buf += LL;
         }
 
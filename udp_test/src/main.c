@@ -0,0 +1,117 @@
+/*-
+ * Copyright (c) 2020 Lawrence Esswood
+ * All rights reserved.
+ *
+ * This software was developed by SRI International and the University of
+ * Cambridge Computer Laboratory under DARPA/AFRL contract FA8750-10-C-0237
+ * ("CTSRD"), as part of the DARPA CRASH research programme.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "cheric.h"
+#include "syscalls.h"
+#include "net.h"
+#include "stdio.h"
+#include "string.h"
+#include "assert.h"
+
+// Sends a batch of datagrams to ourselves over loopback, then a reply back the other way, and checks what arrives
+
+#define RX_PORT     778
+#define TX_PORT     779
+#define N_DGRAMS    8
+
+static void fill_bind(struct tcp_bind* bind, uint32_t addr, uint16_t port) {
+    bind->addr.addr = addr;
+    bind->port = port;
+}
+
+int main(void) {
+    while(!net_try_get_ref()) {
+        sleep(0);
+    }
+
+    struct tcp_bind rx_bind, tx_bind, to;
+    fill_bind(&rx_bind, IP_ADDR_ANY->addr, RX_PORT);
+    fill_bind(&tx_bind, IP_ADDR_ANY->addr, TX_PORT);
+    fill_bind(&to, PP_HTONL(IPADDR_LOOPBACK), RX_PORT);
+
+    UDP_SOCK rx = udp_socket(&rx_bind);
+    UDP_SOCK tx = udp_socket(&tx_bind);
+    assert(rx != NULL && tx != NULL);
+
+    // Every datagram has a different length and fill, so any that are merged, split or reordered show up
+    char out_bufs[N_DGRAMS][N_DGRAMS];
+    struct udp_msg out[N_DGRAMS];
+
+    for(size_t i = 0; i != N_DGRAMS; i++) {
+        memset(out_bufs[i], 'a' + (int)i, i + 1);
+        out[i].addr = to;
+        out[i].buf = out_bufs[i];
+        out[i].buf_len = i + 1;
+    }
+
+    assert_int_ex(udp_sendmmsg(tx, out, N_DGRAMS), ==, N_DGRAMS);
+
+    char in_bufs[N_DGRAMS][N_DGRAMS + 1];
+    struct udp_msg in[N_DGRAMS];
+    size_t got = 0;
+
+    // They may be handed up over more than one batch
+    while(got != N_DGRAMS) {
+        for(size_t i = got; i != N_DGRAMS; i++) {
+            in[i].buf = in_bufs[i];
+            in[i].buf_len = sizeof(in_bufs[i]);
+        }
+        ssize_t res = udp_recvmmsg(rx, &in[got], N_DGRAMS - got, MSG_NONE);
+        assert_int_ex(res, >, 0);
+        got += (size_t)res;
+    }
+
+    for(size_t i = 0; i != N_DGRAMS; i++) {
+        assert_int_ex(in[i].dgram_len, ==, i + 1);
+        assert_int_ex(in[i].addr.port, ==, TX_PORT);
+        assert_int_ex(memcmp(in_bufs[i], out_bufs[i], i + 1), ==, 0);
+    }
+
+    // Reply to where the last one came from. Only part of it fits, the rest should be dropped.
+    const char* reply = "Hello UDP!";
+    size_t reply_len = strlen(reply);
+    char small[4];
+    struct tcp_bind from;
+
+    assert_int_ex(udp_sendto(rx, reply, reply_len, &in[N_DGRAMS - 1].addr), ==, (ssize_t)reply_len);
+    assert_int_ex(udp_recvfrom(tx, small, sizeof(small), &from, MSG_NONE), ==, sizeof(small));
+    assert_int_ex(from.port, ==, RX_PORT);
+    assert_int_ex(memcmp(small, reply, sizeof(small)), ==, 0);
+
+    // Nothing else should be waiting
+    assert_int_ex(udp_recvfrom(tx, small, sizeof(small), NULL, MSG_DONT_WAIT), ==, E_AGAIN);
+
+    assert_int_ex(udp_close(tx), ==, 0);
+    assert_int_ex(udp_close(rx), ==, 0);
+
+    printf("UDP test passes!\n");
+
+    return 0;
+}